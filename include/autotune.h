@@ -0,0 +1,15 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include "raytracing_openCL.h"
+#include "options.h"
+
+// Autotuned launch configurations, one line per device: NAME;DRIVER;LOCAL_X;LOCAL_Y;SPP_CHUNK;BUILD_OPTIONS
+#define OPENCL_PROFILE_PATH "opencl_profile.txt"
+
+uint8_t loadLaunchConfig(const char* deviceName, const char* driverVersion, launchConfig_t* launch);
+void saveLaunchConfig(const char* deviceName, const char* driverVersion, const launchConfig_t* launch);
+
+int autotune_openCL(const options_t* options);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef BANDED_OPENCL_H
+#define BANDED_OPENCL_H
+
+#include "raytracing_openCL.h"
+
+// Device band buffers: band N is read back from one while band N + 1 renders into the other
+#define BAND_BUFFERS 2
+
+// --bands: the frame is rendered in horizontal bands on the compute queue, each band is read back on the transfer queue
+// while the next one renders, and converted to 8 bits on the host while the following ones render & transfer.
+// Writes the PNG to "filename" and returns the linear image (host "image").
+color_t* raytracingBands_openCL(openCL_t* openCL, color_t* image, const char* filename, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, const options_t* options);
+
+// --mem-budget: host & device bytes of the full frame render (float image on both sides, 8 bits image on the host)
+uint64_t fullFrameMemory(const uint16_t width, const uint16_t height);
+// Rows per band of the streamed renders within the budget (bytes): BAND_BUFFERS band buffers on the device & on the
+// host, 0 when the full frame fits
+uint16_t memoryBudgetBandRows(const uint16_t width, const uint16_t height, const uint64_t memoryBudget);
+
+// Bands as raytracingBands_openCL(), with neither a host frame nor an 8 bits frame: each band is read back into one of
+// BAND_BUFFERS host band buffers & streamed to the PNG file while the next one renders. Top band first (PNG row order)
+void raytracingStreamed_openCL(openCL_t* openCL, const char* filename, const uint16_t width, const uint16_t height, const uint16_t bandRows, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, const options_t* options);
+
+#endif
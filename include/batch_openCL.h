@@ -0,0 +1,37 @@
+#ifndef BATCH_OPENCL_H
+#define BATCH_OPENCL_H
+
+#include "raytracing_openCL.h"
+
+// --thumbnails: images per batch (bounds the device memory of the packed buffers)
+#define THUMBNAILS_PER_BATCH 256
+
+// Image of a batch, rendered with its own camera & spheres
+typedef struct batchImage_t
+{
+    color_t* image;             // Output, width * height linear colors
+    uint16_t width;
+    uint16_t height;
+    const camera_t* camera;
+    const sphere_t* spheres;
+    uint16_t numberOfSpheres;
+} batchImage_t;
+
+// Device offset table (batchEntry_t in kernel/raytracing_gpu.cl)
+typedef struct batchEntry_t
+{
+    cl_uint pixelOffset;        // First pixel of the image in the packed images
+    cl_uint sphereOffset;       // First sphere of the image in the packed spheres
+    cl_ushort width;
+    cl_ushort height;
+    cl_ushort numberOfSpheres;
+    cl_ushort padding;
+} batchEntry_t;
+
+// Packs the cameras, spheres & outputs of the images into one set of buffers and renders them in a single NDRange
+void raytracingBatch_openCL(openCL_t* openCL, batchImage_t* images, const uint32_t numberOfImages, const uint16_t raysPerPixel, const uint8_t raysDepth);
+
+// --thumbnails=N: N images of a random scene each, seen from around it, rendered one call per image then in batches
+int thumbnails_openCL(const uint32_t numberOfImages, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint8_t sqrtNumberOfSpheres, const options_t* options);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "options.h"
+
+// Results of --bench: the columns of the hand-collected result.csv (medians, `python plot_results.py result_bench.csv`)
+// followed by the percentiles & rates; result.csv itself is never written
+#define BENCH_RESULT_PATH "result_bench.csv"
+// Per thread CPU ray counters of --bench --stats (first CPU render of each point: a warm-up one unless --warmup=0), one
+// row per thread then the total (thread "all")
+#define BENCH_CPU_STATS_PATH "result_cpu_stats.csv"
+// Every timed run of every point & phase (opencl, data_transfert, cpu), the samples of the --compare statistics
+#define BENCH_SAMPLES_PATH "result_samples.csv"
+
+// Scene of --bench without --seed
+#define BENCH_SEED 42
+
+// Rays per sample of each scene & depth, counted once on untimed renders of this width (16:9) & samples per pixel (the
+// count per sample depends on neither)
+#define BENCH_RAYS_WIDTH 256
+#define BENCH_RAYS_SPP 10
+
+// Percentiles of the timed renders (nearest rank)
+#define BENCH_LOW_PERCENTILE 10
+#define BENCH_HIGH_PERCENTILE 90
+
+int bench(const options_t* options);
+
+#endif
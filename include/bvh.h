@@ -0,0 +1,23 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "vec3_color.h"
+#include "sphere.h"
+
+// Flattened bounding volume hierarchy (one sphere per leaf), nodes stored in depth-first order:
+// the first child of an inner node is the next node, escapeIndex is the node after its subtree.
+// It is traversed without stack: hit -> next node, miss (or leaf done) -> escapeIndex, until escapeIndex == numberOfNodes.
+typedef struct bvhNode_t
+{
+    vec3_t aabbMin;
+    int32_t escapeIndex;
+    vec3_t aabbMax;
+    int32_t sphereIndex;    // Leaf: sphere of the node, inner node: -1
+} bvhNode_t;
+
+// Number of nodes of the BVH of numberOfSpheres spheres
+#define BVH_NUMBER_OF_NODES(numberOfSpheres) (2 * (numberOfSpheres) - 1)
+
+uint32_t buildBVH(bvhNode_t* nodes, const sphere_t* spheres, const uint16_t numberOfSpheres);
+
+#endif
@@ -18,5 +18,6 @@ typedef struct camera_t
 } camera_t;
 
 camera_t initializeCamera(const uint16_t WITDH, const uint16_t HEIGHT);
+camera_t initializeCameraFrom(const uint16_t WITDH, const uint16_t HEIGHT, const vec3_t lookFrom);
 
 #endif
\ No newline at end of file
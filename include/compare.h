@@ -0,0 +1,26 @@
+#ifndef COMPARE_H
+#define COMPARE_H
+
+#include "options.h"
+
+// Every point & phase of --compare with its verdict
+#define COMPARE_RESULT_PATH "result_compare.csv"
+
+// Baseline of --compare without a path: a result_samples.csv of --bench kept aside (written by the first --compare)
+#define COMPARE_DEFAULT_BASELINE_PATH "baseline_samples.csv"
+
+// Point & phase flagged when its median time changed by more than the threshold (--threshold=PERCENT) and the two sided
+// Mann-Whitney test rejects equal distributions at COMPARE_SIGNIFICANCE
+#define COMPARE_DEFAULT_THRESHOLD 5
+#define COMPARE_SIGNIFICANCE 0.05
+// Fewer timed runs on a side can never reach the significance (normal approximation of the test, tie corrected)
+#define COMPARE_MIN_SAMPLES 4
+
+// Exit status of --compare (0: no flagged change)
+#define COMPARE_EXIT_REGRESSION 1
+#define COMPARE_EXIT_IMPROVEMENT 2  // Improvements only: the baseline is out of date
+
+// --bench over its grid, then each point & phase of result_samples.csv against the same one of the baseline
+int compare(const options_t* options);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef HETEROGENEOUS_H
+#define HETEROGENEOUS_H
+
+#include "raytracing_openCL.h"
+
+typedef struct heterogeneousStats_t
+{
+    uint32_t deviceRows;
+    uint32_t deviceTiles;
+    uint32_t cpuRows;
+    uint32_t cpuTiles;
+    uint64_t elapsedTime;   // us
+} heterogeneousStats_t;
+
+// --hetero: one frame shared by the OpenCL device and the OpenMP CPU threads, pulling row tiles from a tile queue
+void raytracingHeterogeneous(openCL_t* openCL, color_t* image, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, const options_t* options, heterogeneousStats_t* stats);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef MEMORY_TRACKER_H
+#define MEMORY_TRACKER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Bytes in use of the frame-sized host buffers (trackedMalloc) & of the OpenCL buffers (createBuffer_openCL), with their
+// peaks. Buffers created on host memory (CL_MEM_USE_HOST_PTR) are only counted on the host
+typedef enum memorySpace_t
+{
+    MEMORY_HOST,
+    MEMORY_DEVICE,
+    MEMORY_SPACES
+} memorySpace_t;
+
+// Peaks of one phase: the highest use between startMemoryPhase() & stopMemoryPhase() (phases may be nested)
+typedef struct memoryPhase_t
+{
+    size_t peak[MEMORY_SPACES];
+    size_t outerPeak[MEMORY_SPACES];    // Peak of the enclosing phases, restored by stopMemoryPhase()
+} memoryPhase_t;
+
+// Allocation (bytes > 0) or release (bytes < 0)
+void trackMemory(const memorySpace_t space, const int64_t bytes);
+size_t memoryInUse(const memorySpace_t space);
+
+void* trackedMalloc(size_t size);
+void* trackedAlignedAlloc(size_t alignment, size_t size);
+void trackedFree(void* pointer);
+
+void startMemoryPhase(memoryPhase_t* phase);
+void stopMemoryPhase(memoryPhase_t* phase);
+
+#endif
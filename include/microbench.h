@@ -0,0 +1,19 @@
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+#include "options.h"
+
+// Results of --microbench, one line per primitive
+#define MICROBENCH_RESULT_PATH "result_microbench.csv"
+
+// Calls per timed run, over MICROBENCH_INPUTS precomputed inputs (fixed seed: same inputs on every run & build)
+#define MICROBENCH_OPS (1u << 22)
+#define MICROBENCH_INPUTS 4096
+#define MICROBENCH_SEED 42
+#define MICROBENCH_SQRT_NUMBER_OF_SPHERES 6
+
+// The random stream, sampling & scattering primitives and the ray-sphere test of the CPU renderer timed alone on the
+// calling thread: median ns per call & calls per cycle (hardware counters) of the timed runs
+int microbench(const options_t* options);
+
+#endif
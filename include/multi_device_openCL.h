@@ -0,0 +1,24 @@
+#ifndef MULTI_DEVICE_OPENCL_H
+#define MULTI_DEVICE_OPENCL_H
+
+#include "raytracing_openCL.h"
+#include "tile_queue.h"
+
+#define MULTI_DEVICE_MAX_PLATFORMS 8
+#define MULTI_DEVICE_MAX_DEVICES TILE_QUEUE_MAX_WORKERS
+
+// --multi-device: every available device of every platform, each with its own context, program & queue
+typedef struct multiDevice_t
+{
+    openCL_t devices[MULTI_DEVICE_MAX_DEVICES];
+    uint8_t numberOfDevices;
+} multiDevice_t;
+
+void initializeMultiDevice_openCL(multiDevice_t* multiDevice, const options_t* options);
+void releaseMultiDevice_openCL(multiDevice_t* multiDevice);
+
+// The devices pull row tiles of the frame from a tile queue (throughput proportional), each tile is read back to its
+// place in the host image
+color_t* raytracingMultiDevice_openCL(multiDevice_t* multiDevice, color_t* image, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, const options_t* options);
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdint.h>
+
+// OpenCL output buffer allocation
+typedef enum zeroCopyMode_t
+{
+    ZERO_COPY_NONE,             // Device buffer + clEnqueueReadBuffer into the host image
+    ZERO_COPY_ALLOC_HOST_PTR,   // CL_MEM_ALLOC_HOST_PTR, image accessed through clEnqueueMapBuffer
+    ZERO_COPY_USE_HOST_PTR      // CL_MEM_USE_HOST_PTR on the (page aligned) host image, accessed through clEnqueueMapBuffer
+} zeroCopyMode_t;
+
+// What the application does
+typedef enum runMode_t
+{
+    MODE_RENDER,        // Render the scene with OpenCL then with the CPU (default)
+    MODE_AUTOTUNE,      // Sweep the OpenCL launch configurations and save the best one for this device
+    MODE_BENCH,         // Time the OpenCL & CPU renders over the parameter grid of timing.sh in one process
+    MODE_SCALING,       // Strong & weak scaling of the CPU render from 1 thread to the maximum
+    MODE_QUALITY,       // Equal-time image quality of the CPU & OpenCL configurations against a high spp reference
+    MODE_MICROBENCH,    // Time the sampling & intersection primitives of the CPU renderer alone
+    MODE_COMPARE        // Bench, then flag the significant changes against a stored baseline
+} runMode_t;
+
+// CPU threads of --scaling
+typedef enum pinning_t
+{
+    PINNING_NONE,       // Threads free to run on every CPU of the process (default)
+    PINNING_CLOSE,      // Thread t on the t-th CPU of the process
+    PINNING_SPREAD      // Threads evenly spaced over the CPUs of the process
+} pinning_t;
+
+// OpenCL kernel organization
+typedef enum kernelVariant_t
+{
+    KERNEL_MEGAKERNEL,  // One work-item traces all the samples and bounces of a pixel (default)
+    KERNEL_WAVEFRONT,   // Generate / extend / shade / accumulate kernels over compacted path queues
+    KERNEL_PERSISTENT,  // About one wave of work-items pulling pixel batches from a global atomic counter
+    KERNEL_FLOAT4,      // Megakernel on float4 vectors & native intrinsics (kernel/raytracing_float4.cl, packed scene)
+    KERNEL_HALF         // Megakernel with the image & path throughput in half (cl_khr_fp16 devices, else float megakernel)
+} kernelVariant_t;
+
+// OpenCL closest hit search
+typedef enum accelMode_t
+{
+    ACCEL_AUTO,     // BVH from BVH_MIN_SPHERES spheres, all the spheres below (default)
+    ACCEL_NONE,     // All the spheres for every ray
+    ACCEL_BVH       // Stackless BVH traversal
+} accelMode_t;
+
+// OpenCL memory holding the spheres during the closest hit search
+typedef enum sphereMemory_t
+{
+    SPHERE_MEMORY_AUTO,         // __constant if the scene fits in it, else __local staging (brute force megakernel), else __global (default)
+    SPHERE_MEMORY_GLOBAL,       // Read from __global memory by every work-item
+    SPHERE_MEMORY_CONSTANT,     // __constant memory (program built with -DSPHERE_ADDRESS_SPACE=__constant)
+    SPHERE_MEMORY_LOCAL         // Chunks staged in __local memory by the work-group (megakernel without BVH)
+} sphereMemory_t;
+
+typedef struct options_t
+{
+    runMode_t mode;
+    zeroCopyMode_t zeroCopy;
+    kernelVariant_t kernel;
+    accelMode_t accel;
+    sphereMemory_t sphereMemory;
+    uint16_t localSize[2];      // OpenCL work-group shape (x: columns, y: rows), 0: autotuned profile or default
+    uint8_t isProfileIgnored;   // Reference renders: default work-group shape & build options, no autotuned profile nor --local-size
+    uint32_t sampleSeedBase;    // Reference renders: first sample index of the OpenCL random sequences (0: the renders one)
+    uint16_t launches;          // OpenCL launches sharing the rays per pixel, 0: autotuned profile or single launch
+    uint16_t readbackInterval;  // Intermediate OpenCL image saved every N launches, 0: final image only
+    uint32_t seed;              // Scene random seed (default: current time, fixed in --bench)
+    uint8_t isSeedSet;          // --seed given
+    uint8_t isValidated;        // Compare the OpenCL image to the reference megakernel image
+    uint32_t batchSize;         // Pixels pulled at once from the work queue by a work-item of the persistent kernel
+    uint16_t bands;             // OpenCL frame rendered in bands, read back & converted while the next band renders, 0: whole frame
+    uint8_t isHeterogeneous;    // Render the frame once more with the OpenCL device & the CPU threads pulling from one tile queue
+    uint32_t thumbnails;        // Render this many small images one OpenCL call per image, then batched (0: normal render)
+    uint8_t isMultiDevice;      // OpenCL frame split between every available device of every platform
+    uint32_t memoryBudget;      // MiB of host & device frame buffers, larger frames rendered in bands streamed to the PNG files (0: no limit)
+    const char* timelinePath;   // Chrome trace-event JSON of the CPU rows, device tiles & OpenCL commands, NULL: no timeline
+    uint8_t isRayStats;         // OpenCL kernels built with their ray counters (-DRAY_STATS) & counted CPU render, reported after the render
+    uint16_t warmups;           // --bench: untimed renders before the timed ones
+    uint16_t repetitions;       // --bench: timed renders per grid point
+    pinning_t pinning;          // --scaling: CPU of each thread
+    uint32_t timeBudget;        // ms, render: deadline of the OpenCL & CPU progressive renders, --quality: longest budget of the error-vs-time curves (0: rays per pixel argument, default)
+    const char* baselinePath;   // --compare: samples of a previous bench, NULL: default path
+    uint8_t regressionThreshold; // %, --compare: smallest flagged change of a median time
+} options_t;
+
+void initializeOptions(options_t* options);
+void parseOptions(options_t* options, const int argc, char* argv[], const int firstOption);
+
+#endif
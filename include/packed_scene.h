@@ -0,0 +1,32 @@
+#ifndef PACKED_SCENE_H
+#define PACKED_SCENE_H
+
+#include <CL/cl.h>
+
+#include "camera.h"
+#include "sphere.h"
+
+// Scene layout of kernel/raytracing_float4.cl: 16 bytes aligned float4 fields, w components used for scalars
+
+typedef struct sphere4_t
+{
+    cl_float4 positionRadius;   // xyz: position, w: radius
+    cl_float4 albedoParameter;  // xyz: albedo, w: roughness, fuzziness or refraction index
+    cl_uint material;
+    cl_uint padding[3];
+} sphere4_t;
+
+typedef struct camera4_t
+{
+    cl_float4 lookFrom;
+    cl_float4 viewportUpperLeft;
+    cl_float4 step_u, step_v;
+    cl_float4 defocus_disk_u, defocus_disk_v;
+    cl_float defocusAngle;
+    cl_float padding[3];
+} camera4_t;
+
+void packSpheres(sphere4_t* packedSpheres, const sphere_t* spheres, const uint16_t numberOfSpheres);
+camera4_t packCamera(const camera_t* camera);
+
+#endif
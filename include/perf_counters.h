@@ -0,0 +1,39 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+
+#include "memory_tracker.h"
+
+// Hardware counters of the process (perf_event_open), counted in user space for all the threads created after
+// initializePerfCounters() (OpenMP workers, OpenCL runtime threads)
+typedef enum perfEvent_t
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_NUMBER_OF_EVENTS
+} perfEvent_t;
+
+// One render phase: counts & time since startPerfPhase(), deltas after stopPerfPhase()
+typedef struct perfPhase_t
+{
+    uint64_t counts[PERF_NUMBER_OF_EVENTS];
+    uint64_t time;  // us
+    memoryPhase_t memory;
+} perfPhase_t;
+
+// Before the first OpenMP region & OpenCL call: the threads created before are not counted
+void initializePerfCounters(void);
+void releasePerfCounters(void);
+uint8_t isPerfEventAvailable(const perfEvent_t event);
+
+void startPerfPhase(perfPhase_t* phase);
+void stopPerfPhase(perfPhase_t* phase);
+
+// Cycles per pixel, instructions, IPC, cache & branch misses of a stopped phase (time per pixel without counters), then
+// its peak host & device memory
+void reportPerfPhase(const char* name, const perfPhase_t* phase, const uint32_t numberOfPixels);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef PNG_STREAM_H
+#define PNG_STREAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "vec3_color.h"
+
+// PNG written a few rows at a time (stb_image_write needs the whole image): 8 bits RGB rows without filter, in stored
+// (uncompressed) deflate blocks, so that only one row is held on the host. Bigger files than stbi_write_png
+typedef struct pngStream_t
+{
+    FILE* file;
+    uint16_t width;
+    uint16_t rowsLeft;
+    uint32_t crc;       // CRC-32 of the current chunk
+    uint32_t adler;     // Adler-32 of the rows (zlib stream trailer)
+    uint8_t* row;       // Filter byte & pixels of one row
+} pngStream_t;
+
+void openPngStream(pngStream_t* stream, const char* filename, const uint16_t width, const uint16_t height);
+// Linear rows in render order (bottom-up, like stbi_flip_vertically_on_write): gamma corrected, quantized & written last
+// row first. The bands of the image are written from the top one
+void writePngStreamRows(pngStream_t* stream, const color_t* rows, const uint16_t numberOfRows);
+void closePngStream(pngStream_t* stream);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef QUALITY_H
+#define QUALITY_H
+
+#include "options.h"
+
+// Results of --quality, one line per candidate & time budget
+#define QUALITY_RESULT_PATH "result_quality.csv"
+
+// Scene of --quality without scene arguments (the rays per pixel & depth arguments are the ones of the reference)
+#define QUALITY_WIDTH 640
+#define QUALITY_HEIGHT 360
+#define QUALITY_REFERENCE_SPP 1024
+#define QUALITY_REFERENCE_DEPTH 50
+#define QUALITY_SQRT_NUMBER_OF_SPHERES 6
+
+// Samples per launch of the reference render (device watchdogs)
+#define QUALITY_REFERENCE_LAUNCH_SPP 16
+
+// First sample index of the reference: its samples are disjoint from the ones of the candidates (which start at 0), so
+// that their error is not biased low by shared noise
+#define QUALITY_REFERENCE_SAMPLE_BASE (1u << 20)
+
+// Longest time budget without --time-budget (ms), the curves also use 1/2, 1/4 & 1/8 of it
+#define QUALITY_TIME_BUDGET 1000
+#define QUALITY_BUDGET_STEPS 4
+
+// Equal-time image quality: a high spp reference (OpenCL megakernel, cached in quality_reference_*.bin next to the
+// results), then every candidate configuration rendered progressively under each time budget, with its samples per pixel
+// & its RMSE, PSNR and relative MSE against the reference
+int quality(const uint16_t width, const uint16_t height, const uint16_t referenceRaysPerPixel, const uint8_t referenceRaysDepth, const uint8_t sqrtNumberOfSpheres, const options_t* options);
+
+#endif
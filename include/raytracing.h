@@ -5,6 +5,75 @@
 #include "sphere.h"
 #include "camera.h"
 
-void raytracing(color_t* image, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera);
+#include <math.h>
+
+#define CPU_RAY_STATS_DEPTH_BINS 16
+#define CPU_RAY_STATS_MAX_THREADS 256
+
+// Build switch of the CPU ray counters (make CPU_RAY_STATS=0: the counted copy of the render loop is not compiled, the
+// CPU renders are the uncounted loop whatever the options and --stats only counts on the OpenCL side)
+#ifndef CPU_RAY_STATS
+#define CPU_RAY_STATS 1
+#endif
+
+// Ray counters of one OpenMP thread (--stats, same definitions as the OpenCL RAY_STATS counters): kept on the thread
+// stack during the render & merged once at its end. Without --stats the rows are traced by a copy of the loop without
+// them. Cost of the counters on the threaded raytracing(), 4 OpenMP threads sharing one core (640x360, 10 samples per
+// pixel, 2/6/11 squared spheres x depth 5/15/50, median of 7 runs): -0.9% to +3.1% of the uncounted render time, +0.6%
+// on average; not measured on several cores (see timing_cpu_stats.sh)
+typedef struct cpuRayCounters_t
+{
+    uint64_t samples;
+    uint64_t rays;                                  // Closest hit searches (bounces, plus the ray escaping to the sky)
+    uint64_t sphereTests;
+    uint64_t skyHits;
+    uint64_t truncated;                             // Paths stopped by the depth limit
+    uint64_t materialHits[NUMBER_OF_MATERIAL];
+    uint64_t depth[CPU_RAY_STATS_DEPTH_BINS];       // Bounces before the sky (last bin: that many or more)
+} cpuRayCounters_t;
+
+typedef struct cpuRayStats_t
+{
+    cpuRayCounters_t total;
+    cpuRayCounters_t threads[CPU_RAY_STATS_MAX_THREADS];    // Threads beyond the last slot are merged into it
+    uint16_t numberOfThreads;
+} cpuRayStats_t;
+
+// Distance along rayDirection (in rayDirection lengths) to the first hit of the sphere, INFINITY when missed or behind
+// the ray. The ray-sphere test of the bounce loop, inlined there (and timed alone by --microbench)
+static inline float raySphereDistance(const vec3_t* rayPosition, const vec3_t* rayDirection, const sphere_t* sphere)
+{
+    // Maths (line == sphere equation)
+    vec3_t originToCenter = vec3_sub(rayPosition, &sphere->position);
+    float a = vec3_dot(rayDirection, rayDirection);
+    float half_b = vec3_dot(&originToCenter, rayDirection);
+    float c = vec3_dot(&originToCenter, &originToCenter) - sphere->radius * sphere->radius;
+    float delta = half_b*half_b - a*c;
+
+    // 0 solution => no hit
+    if (delta < 0)
+        return INFINITY;
+
+    // Ignore digital noise
+    float distance = (-half_b - sqrtf(delta))/ a;
+    return distance <= 0.001f ? INFINITY : distance;
+}
+
+// stats: counters added to (reset by the caller), NULL: not counted
+void raytracing(color_t* image, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, cpuRayStats_t* stats);
+// Rows [firstRow, firstRow + numberOfRows) of the image (same pixels as the whole frame render). sampleOffset: samples
+// already averaged in the image by the previous passes of a progressive render (0: the image is overwritten)
+void raytracingRows(color_t* image, const uint16_t width, const uint16_t firstRow, const uint16_t numberOfRows, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, const uint32_t sampleOffset, cpuRayStats_t* stats);
+// Same rows into a band buffer holding only them (its first row is the row firstRow of the image)
+void raytracingBand(color_t* band, const uint16_t width, const uint16_t firstRow, const uint16_t numberOfRows, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, const uint32_t sampleOffset, cpuRayStats_t* stats);
+// --mem-budget: the frame bandRows rows at a time into one band buffer, each band streamed to the PNG file (gamma, 8 bits
+// & encoding included)
+void raytracingStreamed(const char* filename, const uint16_t width, const uint16_t height, const uint16_t bandRows, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, cpuRayStats_t* stats);
+// Progressive passes until the time budget (us) is spent, at least 1 sample per pixel: returns the samples per pixel
+// (stats: counters of all the passes)
+uint32_t raytracingBudget(color_t* image, const uint16_t width, const uint16_t height, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, const uint64_t timeBudget, cpuRayStats_t* stats);
+
+void resetCpuRayStats(cpuRayStats_t* stats);
+void reportCpuRayStats(const cpuRayStats_t* stats);
 
 #endif
\ No newline at end of file
@@ -1,10 +1,154 @@
 #ifndef RAYTRACING_OPENCL_H
 #define RAYTRACING_OPENCL_H
 
+#include <CL/cl.h>
+
 #include "vec3_color.h"
 #include "sphere.h"
 #include "camera.h"
+#include "options.h"
+#include "bvh.h"
+
+// Host image alignment required by CL_MEM_USE_HOST_PTR to be truly zero-copy (PoCL, Intel)
+#define ZERO_COPY_ALIGNMENT 4096
+
+#define BUILD_OPTIONS_LENGTH 128
+
+// Smallest scene traced with the BVH in --accel=auto (below, testing all the spheres is faster)
+#define BVH_MIN_SPHERES 512
+
+// --validate: largest RMSE between the image of a kernel variant and the reference megakernel image
+#define VALIDATION_RMSE_TOLERANCE 1e-2f
+
+// Resident work-groups per compute unit of the persistent kernel (about one wave, enough to hide memory latency)
+#define PERSISTENT_GROUPS_PER_COMPUTE_UNIT 4
+
+// --stats: counters of the kernels built with -DRAY_STATS (mirrored by the RAY_STATS_* enum of kernel/raytracing_gpu.cl),
+// 64 bits each as a (low, high) pair of cl_uint in statsMemObj
+#define RAY_STATS_DEPTH_BINS 16
+typedef enum rayStatsCounter_t
+{
+    RAY_STATS_SAMPLES,          // Camera rays
+    RAY_STATS_RAYS,             // Closest hit searches (camera rays & bounces)
+    RAY_STATS_SPHERE_TESTS,     // Ray-sphere intersection tests
+    RAY_STATS_NODE_TESTS,       // Ray-AABB tests of the BVH traversal
+    RAY_STATS_SKY_HITS,         // Paths ending in the sky
+    RAY_STATS_TRUNCATED,        // Paths cut at the maximum depth (black)
+    RAY_STATS_LANE_SLOTS,       // Work-group size x rays of its longest work-item: SIMD lanes held by the bounce loops
+    RAY_STATS_DEPTH,            // Histogram of the bounces before the sky (last bin: RAY_STATS_DEPTH_BINS - 1 or more)
+    RAY_STATS_COUNTERS = RAY_STATS_DEPTH + RAY_STATS_DEPTH_BINS
+} rayStatsCounter_t;
+
+// Launch configuration (--local-size, autotuned profile or defaults)
+typedef struct launchConfig_t
+{
+    uint16_t localSize[2];                      // Work-group shape (x: columns, y: rows)
+    uint16_t sppChunk;                          // Samples per launch (0: all samples in one launch)
+    char buildOptions[BUILD_OPTIONS_LENGTH];    // clBuildProgram options
+} launchConfig_t;
+
+typedef struct openCL_t
+{
+    cl_platform_id platformId;
+    cl_device_id deviceID;
+    cl_context context;
+    cl_command_queue commandQueue;
+    cl_command_queue transferQueue;     // Band readbacks overlapping the launches of commandQueue
+    cl_program program;
+    cl_kernel kernel;
+    cl_kernel persistentKernel;
+    cl_kernel localKernel;
+    cl_kernel batchKernel;
+    cl_kernel halfKernel;
+    cl_kernel wavefrontGenerateKernel;
+    cl_kernel wavefrontExtendKernel;
+    cl_kernel wavefrontShadeKernel;
+    cl_kernel wavefrontAccumulateKernel;
+
+    // Device identification (autotuned profile key)
+    char deviceName[128];
+    char driverVersion[64];
+    cl_uint computeUnits;
+    cl_ulong maxConstantBufferSize;
+    cl_ulong localMemSize;
+    cl_device_local_mem_type localMemType;
+
+    // Kernel source, kept to rebuild the program with other options
+    char* kernelSource;
+    size_t kernelSize;
+    uint8_t isPackedScene;      // kernel/raytracing_float4.cl: packed scene, megakernel only
+    uint8_t isHalfImage;        // --kernel=half on a cl_khr_fp16 device: 3 halves per pixel in imageMemObj
+    uint8_t isRayStats;         // --stats: program built with -DRAY_STATS, the counters are the last kernel argument
+    uint32_t sampleSeedBase;    // Program built with -DSAMPLE_SEED_BASE when not 0 (reference renders)
+    uint16_t timelineDevice;    // --timeline: row of the device commands (index of the device in --multi-device)
+
+    launchConfig_t launch;
+    accelMode_t accel;
+    sphereMemory_t sphereMemoryOption;
+    sphereMemory_t sphereMemory;        // Memory used for the current scene (never AUTO)
+    uint16_t localChunkSize;            // Spheres staged at once in __local memory
+
+    // Scene
+    cl_mem sphereMemObj;
+    cl_mem cameraMemObj;
+    cl_mem bvhMemObj;
+    uint32_t numberOfNodes;     // 0: no BVH, the kernels test all the spheres
+
+    // Next pixel of the persistent kernel
+    cl_mem workCounterMemObj;
+
+    // --stats counters (NULL without --stats)
+    cl_mem statsMemObj;
+
+    // Wavefront path pool, queues & queue counters (include/wavefront_openCL.h), created by the first wavefront launch
+    // of a pool size & kept for the next ones
+    uint32_t wavefrontPoolSize;     // 0: no buffers
+    cl_mem pathMemObj;
+    cl_mem rayQueueMemObj[2];
+    cl_mem materialQueueMemObj;
+    cl_mem queueCounterMemObj;
+    cl_mem sampleColorMemObj;
+
+    // Output image, kept alive while it is mapped on the host
+    cl_mem imageMemObj;
+    size_t imageSize;
+    color_t* mappedImage;
+} openCL_t;
+
+void initializeOpenCL(openCL_t* openCL, const options_t* options);
+// Context, queues & kernels of the device: the build error (reported) when the kernels do not build, nothing left allocated
+cl_int initializeOpenCLDevice(openCL_t* openCL, cl_platform_id platformId, cl_device_id deviceID, const options_t* options);
+cl_int buildProgram_openCL(openCL_t* openCL, const char* buildOptions);
+void releaseOpenCL(openCL_t* openCL);
+
+// Buffers counted by the memory tracker (device memory, except on top of host memory with CL_MEM_USE_HOST_PTR)
+cl_mem createBuffer_openCL(cl_context context, cl_mem_flags flags, size_t size, void* hostPtr, cl_int* ret);
+void releaseBuffer_openCL(cl_mem memObj);
+
+void uploadScene_openCL(openCL_t* openCL, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera);
+void createImage_openCL(openCL_t* openCL, color_t* image, const uint16_t width, const uint16_t height, const zeroCopyMode_t zeroCopy);
+cl_int enqueueRaytracing_openCL(openCL_t* openCL, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint16_t numberOfSpheres, const uint32_t sampleOffset, cl_event* event);
+cl_int renderRows_openCL(openCL_t* openCL, cl_mem tileMemObj, color_t* image, const uint16_t width, const uint16_t firstRow, const uint16_t numberOfRows, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint16_t numberOfSpheres, const uint16_t sppChunk);
+cl_int enqueueRaytracingRows_openCL(openCL_t* openCL, cl_mem imageMemObj, const uint16_t width, const uint16_t firstRow, const uint16_t numberOfRows, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint16_t numberOfSpheres, const uint32_t sampleOffset, const cl_event* waitEvent, cl_event* event);
+cl_int enqueuePersistent_openCL(openCL_t* openCL, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint16_t numberOfSpheres, const uint32_t sampleOffset, const uint32_t batchSize, cl_event* event);
+
+uint16_t samplesPerLaunch_openCL(const openCL_t* openCL, const uint16_t raysPerPixel, const options_t* options);
+color_t* raytracing_openCL(openCL_t* openCL, color_t* image, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, const options_t* options);
+void unmapImage_openCL(openCL_t* openCL);
+// Blocking readback of imageMemObj as floats (half image converted)
+cl_int readImage_openCL(openCL_t* openCL, color_t* image, const uint32_t numberOfPixels);
+// Progressive launches until the time budget (us) is spent (readback excluded), at least 1 sample per pixel: returns the
+// samples per pixel
+uint32_t raytracingBudget_openCL(openCL_t* openCL, color_t* image, const uint16_t width, const uint16_t height, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, const uint64_t timeBudget, const options_t* options);
+
+// --timeline: profiled command on the host clock, through a reference command enqueued just after the host time
+// referenceTime (timelineNow())
+void recordTimelineCommand_openCL(const openCL_t* openCL, const char* name, cl_event event, const uint32_t arg, cl_event reference, const uint64_t referenceTime);
+
+void resetRayStats_openCL(openCL_t* openCL);
+void readRayStats_openCL(openCL_t* openCL, uint64_t counters[RAY_STATS_COUNTERS]);
+void reportRayStats_openCL(openCL_t* openCL);
 
-void raytracing_openCL(color_t* image, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera);
+uint8_t validate_openCL(const color_t* image, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, const options_t* options);
 
-#endif
\ No newline at end of file
+#endif
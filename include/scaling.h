@@ -0,0 +1,26 @@
+#ifndef SCALING_H
+#define SCALING_H
+
+#include "options.h"
+
+// Results of --scaling, one line per thread count
+#define SCALING_RESULT_PATH "result_scaling.csv"
+
+// Scene of --scaling without scene arguments
+#define SCALING_WIDTH 1280
+#define SCALING_HEIGHT 720
+#define SCALING_RAYS_PER_PIXEL 10
+#define SCALING_RAYS_DEPTH 15
+#define SCALING_SQRT_NUMBER_OF_SPHERES 6
+
+// Limit reported below this parallel efficiency: more threads than CPUs, load imbalance above SCALING_IMBALANCE (busiest
+// thread rays / mean), else memory & shared core resources when the IPC falls below SCALING_IPC_DROP of the single thread IPC
+#define SCALING_EFFICIENCY 0.9
+#define SCALING_IMBALANCE 1.1
+#define SCALING_IPC_DROP 0.85
+
+// CPU render with 1, 2, 4... up to omp_get_max_threads() threads (OMP_NUM_THREADS): strong scaling on the given frame,
+// weak scaling on the same view with pixels proportional to the threads (the given frame at the maximum)
+int scaling(const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint8_t sqrtNumberOfSpheres, const options_t* options);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef TILE_QUEUE_H
+#define TILE_QUEUE_H
+
+#include <stdint.h>
+
+// Work of a pulled tile at the measured throughput of its worker (seconds): long enough to hide the launch & readback
+// overheads of a device, short enough for all the workers to finish together
+#define TILE_QUEUE_TILE_TIME 0.02
+
+#define TILE_QUEUE_MAX_WORKERS 16
+
+// Row tiles of a frame shared by workers (OpenCL devices, CPU threads) running at different speeds. Each worker sizes its
+// next tile from its own measured throughput, bounded by its throughput share of the rows left (guided schedule).
+typedef struct tileQueue_t
+{
+    uint32_t nextRow;
+    uint16_t height;
+    uint8_t numberOfWorkers;
+    double rowsPerSecond[TILE_QUEUE_MAX_WORKERS];   // 0: not measured yet
+} tileQueue_t;
+
+void initializeTileQueue(tileQueue_t* queue, const uint16_t height, const uint8_t numberOfWorkers);
+
+// First row of the next tile of a worker (whole granules, clipped to the image), height when the frame is done
+uint16_t pullTile(tileQueue_t* queue, const uint8_t worker, const uint16_t granularity, uint16_t* numberOfRows);
+
+// Throughput of the tile the worker just finished
+void reportTile(tileQueue_t* queue, const uint8_t worker, const uint16_t numberOfRows, const double seconds);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdint.h>
+
+// Default file of --timeline (Chrome trace-event JSON, opened by https://ui.perfetto.dev or chrome://tracing)
+#define TIMELINE_DEFAULT_PATH "timeline.json"
+
+// Recording threads (ring buffers) & events kept per thread: a full ring overwrites its oldest events
+#define TIMELINE_MAX_THREADS 256
+#define TIMELINE_RING_EVENTS 16384
+#define TIMELINE_MAX_DEVICES 16
+
+// Rows of the trace viewer: host threads (row of the thread recording the span) & OpenCL devices (device commands)
+typedef enum timelineProcess_t
+{
+    TIMELINE_HOST,
+    TIMELINE_OPENCL
+} timelineProcess_t;
+
+// One span, names are string literals (only the pointer is kept)
+typedef struct timelineEvent_t
+{
+    const char* name;
+    uint64_t begin;     // ns since initializeTimeline()
+    uint64_t end;
+    uint32_t arg;       // Row, tile first row, launch index...
+    uint16_t track;     // Device of TIMELINE_OPENCL spans
+    uint8_t process;
+} timelineEvent_t;
+
+// --timeline: every recording thread writes to its own ring buffer (no lock, no shared cache line on the record path),
+// the rings are dumped by writeTimeline() once the recording threads are done
+void initializeTimeline(const char* path);
+uint8_t isTimelineEnabled(void);
+uint64_t timelineNow(void);    // ns since initializeTimeline()
+void nameTimelineDevice(const uint16_t device, const char* name);
+
+void recordTimelineSpan(const char* name, const uint64_t begin, const uint64_t end, const uint32_t arg);
+void recordTimelineDeviceSpan(const uint16_t device, const char* name, const uint64_t begin, const uint64_t end, const uint32_t arg);
+
+// Writes the JSON file & releases the rings
+void writeTimeline(void);
+
+#endif
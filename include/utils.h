@@ -6,7 +6,27 @@
 
 void imageFloatToU8(const color_t* src, color_u8_t* dst, uint32_t imgSize);
 void imageLinearToGamma(color_t* image, uint32_t imgSize);
-
+void imageHalfToFloat(const uint16_t* src, color_t* dst, uint32_t imgSize);
+void imageLinearToGammaU8(const color_t* src, color_u8_t* dst, uint32_t imgSize);
+void renderImage(color_t* image, const char* filename, const uint16_t width, const uint16_t height);
+float imageRMSE(const color_t* image, const color_t* reference, uint32_t imgSize, float* maxError);
+// Mean of (error / (reference + RELATIVE_MSE_EPSILON))^2 over the channels: the noise of the dark areas counts as much
+// as the noise of the bright ones
+#define RELATIVE_MSE_EPSILON 0.01f
+float imageRelativeMSE(const color_t* image, const color_t* reference, uint32_t imgSize);
+
+// Monotonic clock (us)
+uint64_t monotonicTime(void);
+
+// Time budgeted renders: passes of at most 1/BUDGET_PASSES of the budget, so that the last one ends close to it
+#define BUDGET_PASSES 8
+// Share of the time left planned for the next pass
+#define BUDGET_MARGIN 0.95
+// Samples per pixel of the next pass at the speed of the previous one, 0: not even one sample fits in the time left
+uint16_t nextPassSamples(const uint64_t elapsedTime, const uint64_t timeBudget, const uint64_t passTime, const uint16_t passSamples);
+
+// PCG hash random stream: returns the hash of the seed & advances it
+uint32_t pcg_hash(uint32_t* seed);
 float randomFloatInUnitInterval(uint32_t* seed);
 float randomFloat(uint32_t* seed, float min, float max);
 vec3_t randomInUnitDisk(uint32_t* seed);
@@ -0,0 +1,38 @@
+#ifndef WAVEFRONT_OPENCL_H
+#define WAVEFRONT_OPENCL_H
+
+#include "raytracing_openCL.h"
+
+// Paths in flight (bounds the device memory of the wavefront buffers), pixels are processed by pools of this size
+#define WAVEFRONT_POOL_SIZE (1 << 20)
+#define WAVEFRONT_LOCAL_SIZE 64
+
+// Device path state (path_t in kernel/raytracing_gpu.cl)
+typedef struct wavefrontPath_t
+{
+    vec3_t position;
+    vec3_t direction;
+    color_t throughput;
+    uint32_t seed;
+    int32_t sphereIndex;
+    float hitDistance;
+} wavefrontPath_t;
+
+// Queue counters of the device: one per material queue, then the two ray queues
+#define WAVEFRONT_RAY_COUNTER NUMBER_OF_MATERIAL
+#define WAVEFRONT_QUEUE_COUNTERS (NUMBER_OF_MATERIAL + 2)
+
+// SIMD lane utilization: work-items launched (rounded up to work-groups) vs. work-items with a path to process (queue
+// occupancy, from the queue counters read back asynchronously after every bounce)
+typedef struct wavefrontStats_t
+{
+    uint64_t rays;
+    uint64_t launchedItems;
+    uint64_t usefulItems;
+} wavefrontStats_t;
+
+// stats may be NULL
+cl_int enqueueWavefront_openCL(openCL_t* openCL, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint16_t numberOfSpheres, const uint32_t sampleOffset, wavefrontStats_t* stats);
+void releaseWavefront_openCL(openCL_t* openCL);
+
+#endif
@@ -0,0 +1,445 @@
+// float4 variant of kernel/raytracing_gpu.cl (--kernel=float4): same algorithm & random streams, but vectors and colors
+// are float4 values (w = 0) handled with the OpenCL built-ins (dot, normalize, fmin, ...) and native_ / half_
+// intrinsics where the result only feeds sampling or shading. The scene is packed by the host (include/packed_scene.h).
+
+// Sphere memory, set by the host at build time: __global (default) or __constant when the scene fits in it
+#ifndef SPHERE_ADDRESS_SPACE
+#define SPHERE_ADDRESS_SPACE __global
+#endif
+
+// First sample index of the random sequences, set by the host at build time: reference renders draw samples disjoint
+// from the ones of the renders compared to them
+#ifndef SAMPLE_SEED_BASE
+#define SAMPLE_SEED_BASE 0u
+#endif
+
+// Structs
+typedef struct color_t
+{
+    float r;
+    float g;
+    float b;
+} color_t;
+
+// Packed scene (mirrored by sphere4_t / camera4_t on the host)
+typedef struct sphere4_t
+{
+    float4 positionRadius;      // xyz: position, w: radius
+    float4 albedoParameter;     // xyz: albedo, w: roughness, fuzziness or refraction index
+    uint material;
+    uint padding[3];
+} sphere4_t;
+
+typedef struct camera4_t
+{
+    float4 lookFrom;
+    float4 viewportUpperLeft;
+    float4 step_u, step_v;
+    float4 defocus_disk_u, defocus_disk_v;
+    float defocusAngle;
+    float padding[3];
+} camera4_t;
+
+// Same memory as bvhNode_t: the w components hold the escape index & the sphere index bits
+typedef struct bvhNode4_t
+{
+    float4 aabbMin;
+    float4 aabbMax;
+} bvhNode4_t;
+
+enum { LAMBERTIAN, METAL, DIELECTRIC };
+
+// Types
+typedef uchar 	uint8_t;
+typedef ushort 	uint16_t;
+typedef short 	int16_t;
+typedef uint 	uint32_t;
+typedef ulong 	uint64_t;
+
+// Ray statistics: same counters & flush as kernel/raytracing_gpu.cl (mirrored by rayStatsCounter_t on the host)
+#define RAY_STATS_DEPTH_BINS 16
+enum { RAY_STATS_SAMPLES, RAY_STATS_RAYS, RAY_STATS_SPHERE_TESTS, RAY_STATS_NODE_TESTS, RAY_STATS_SKY_HITS, RAY_STATS_TRUNCATED, RAY_STATS_LANE_SLOTS, RAY_STATS_DEPTH, RAY_STATS_COUNTERS = RAY_STATS_DEPTH + RAY_STATS_DEPTH_BINS };
+#ifdef RAY_STATS
+#define RAY_STATS_DECLARE uint64_t rayStats[RAY_STATS_COUNTERS] = { 0 };
+#define RAY_STATS_PARAMETER , uint64_t* rayStats
+#define RAY_STATS_ARGUMENT , rayStats
+#define RAY_STATS_KERNEL_PARAMETER , __global uint32_t* restrict stats
+#define RAY_STATS_ADD(counter, count) (rayStats[counter] += (count))
+#else
+#define RAY_STATS_DECLARE
+#define RAY_STATS_PARAMETER
+#define RAY_STATS_ARGUMENT
+#define RAY_STATS_KERNEL_PARAMETER
+#define RAY_STATS_ADD(counter, count)
+#endif
+
+// Prototypes
+uint32_t sampleSeed(uint32_t pixelIndex, uint32_t sampleIndex);
+float randomFloatInUnitInterval(uint32_t* seed);
+float4 randomInUnitDisk(uint32_t* seed);
+float4 randomUnitVector(uint32_t* seed);
+float shlickReflectance(float cos_theta, float refractionRatio);
+float4 reflect4(const float4 v, const float4 n);
+float4 refract4(const float4 uv, const float4 n, const float refractionRatio, uint32_t* seed);
+
+void generateRay(uint32_t i, uint32_t j, __global const camera4_t* camera, uint32_t* seed, float4* rayPosition, float4* rayDirection);
+float sphereHitDistance(const float4 rayPosition, const float4 rayDirection, const float4 positionRadius);
+uint8_t isAABBHit(const float4 rayPosition, const float4 inverseDirection, const float4 aabbMin, const float4 aabbMax, const float maxDistance);
+int16_t closestSphereHit(const float4 rayPosition, const float4 rayDirection, SPHERE_ADDRESS_SPACE const sphere4_t* spheres, const uint16_t numberOfSpheres, __global const bvhNode4_t* nodes, const uint32_t numberOfNodes, float* closestSphereDistance RAY_STATS_PARAMETER);
+void scatterRay(float4* rayPosition, float4* rayDirection, float4* rayColor, SPHERE_ADDRESS_SPACE const sphere4_t* sphere, const float distance, uint32_t* seed);
+float4 skyColor(const float4 rayDirection);
+#ifdef RAY_STATS
+void flushRayStats(const uint64_t* rayStats, __local uint32_t* groupStats, __global uint32_t* stats);
+#endif
+
+// Kernel
+__kernel void raytracing(	__global color_t* restrict image,
+							SPHERE_ADDRESS_SPACE const sphere4_t* restrict spheres,
+							__global const camera4_t* restrict camera,
+							const uint16_t width,
+							const uint16_t height,
+							const uint16_t raysPerPixel,
+							const uint8_t raysDepth,
+							const uint16_t numberOfSpheres,
+							const uint32_t sampleOffset,
+							__global const bvhNode4_t* restrict nodes,
+							const uint32_t numberOfNodes
+							RAY_STATS_KERNEL_PARAMETER)
+{
+	uint i = get_global_id(0);
+	uint j = get_global_id(1);
+
+	// The global range is rounded up to a multiple of the work-group shape
+#ifdef RAY_STATS
+	// (every work-item of the group reaches the barriers of the statistics)
+	RAY_STATS_DECLARE
+	__local uint32_t groupStats[2 * RAY_STATS_COUNTERS];
+	if (i < width && j < height)
+#else
+	if (i >= width || j >= height)
+		return;
+#endif
+	{
+		uint gid = i + j * width;
+
+		// A band launch (global offset on the rows) writes to a band sized image
+		const uint imageIdx = gid - get_global_offset(1) * width;
+
+		float4 pixelColor = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+		uint16_t rayIdx, depthIdx;
+
+		for (rayIdx = 0; rayIdx < raysPerPixel; rayIdx++)
+		{
+			// One random stream per sample, so that a launch can start at any sample index
+			uint32_t seed = sampleSeed(gid, sampleOffset + rayIdx);
+			RAY_STATS_ADD(RAY_STATS_SAMPLES, 1);
+
+			// Ray Initialisation
+			float4 rayPosition, rayDirection;
+			generateRay(i, j, camera, &seed, &rayPosition, &rayDirection);
+			float4 rayColor = (float4)(1.0f, 1.0f, 1.0f, 0.0f);
+
+			// Bounce loop
+			for (depthIdx = 0; depthIdx < raysDepth; depthIdx++)
+			{
+				float closestSphereDistance;
+				int16_t closestSphereIndex = closestSphereHit(rayPosition, rayDirection, spheres, numberOfSpheres, nodes, numberOfNodes, &closestSphereDistance RAY_STATS_ARGUMENT);
+
+				if (closestSphereIndex == -1)
+				{
+					// The ray hit the sky, the path ends
+					pixelColor += rayColor * skyColor(rayDirection);
+					RAY_STATS_ADD(RAY_STATS_SKY_HITS, 1);
+					RAY_STATS_ADD(RAY_STATS_DEPTH + min(depthIdx, (uint16_t)(RAY_STATS_DEPTH_BINS - 1)), 1);
+					break;
+				}
+				scatterRay(&rayPosition, &rayDirection, &rayColor, &spheres[closestSphereIndex], closestSphereDistance, &seed);
+			}
+			if (depthIdx == raysDepth)
+				RAY_STATS_ADD(RAY_STATS_TRUNCATED, 1);
+		}
+
+		// image holds the mean of the sampleOffset samples of the previous launches
+		if (sampleOffset != 0)
+		{
+			const color_t accumulatedColor = image[imageIdx];
+			pixelColor += (float4)(accumulatedColor.r, accumulatedColor.g, accumulatedColor.b, 0.0f) * (float)sampleOffset;
+		}
+		pixelColor *= 1.0f / (sampleOffset + raysPerPixel);
+		image[imageIdx] = (color_t){ pixelColor.x, pixelColor.y, pixelColor.z };
+	}
+#ifdef RAY_STATS
+	flushRayStats(rayStats, groupStats, stats);
+#endif
+}
+
+// Functions
+void generateRay(uint32_t i, uint32_t j, __global const camera4_t* camera, uint32_t* seed, float4* rayPosition, float4* rayDirection)
+{
+    // Pixel position (Ray position in viewport plane)
+    const float u = i + randomFloatInUnitInterval(seed);
+    const float v = j + randomFloatInUnitInterval(seed);
+    const float4 pixelPosition = camera->viewportUpperLeft + camera->step_u * u + camera->step_v * v;
+
+    // Ray Initialisation
+    *rayPosition = camera->lookFrom;
+    if (camera->defocusAngle > 0.0f)
+    {
+        const float4 disk = randomInUnitDisk(seed);
+        *rayPosition += camera->defocus_disk_u * disk.x + camera->defocus_disk_v * disk.y;
+    }
+    *rayDirection = pixelPosition - *rayPosition;
+}
+
+// Distance to the sphere along the ray, INFINITY if missed (or closer than the digital noise)
+float sphereHitDistance(const float4 rayPosition, const float4 rayDirection, const float4 positionRadius)
+{
+    float4 originToCenter = rayPosition - positionRadius;
+    originToCenter.w = 0.0f;
+    const float a = dot(rayDirection, rayDirection);
+    const float half_b = dot(originToCenter, rayDirection);
+    const float c = dot(originToCenter, originToCenter) - positionRadius.w * positionRadius.w;
+    const float delta = half_b * half_b - a * c;
+
+    // 1 or 2 solutions => sphere hit
+    if (delta < 0.0f)
+        return INFINITY;
+    const float distance = (-half_b - native_sqrt(delta)) / a;
+
+    // Ignore digital noise
+    return distance <= 0.001f ? INFINITY : distance;
+}
+
+// Slab test on the 3 axes at once
+uint8_t isAABBHit(const float4 rayPosition, const float4 inverseDirection, const float4 aabbMin, const float4 aabbMax, const float maxDistance)
+{
+    const float4 t1 = (aabbMin - rayPosition) * inverseDirection;
+    const float4 t2 = (aabbMax - rayPosition) * inverseDirection;
+    const float4 tMin = fmin(t1, t2);
+    const float4 tMax = fmax(t1, t2);
+    const float tEnter = fmax(fmax(tMin.x, tMin.y), tMin.z);
+    const float tExit = fmin(fmin(tMax.x, tMax.y), tMax.z);
+    return tExit >= fmax(tEnter, 0.001f) && tEnter <= maxDistance;
+}
+
+// Closest sphere along the ray, -1 for the sky: stackless BVH traversal, or all the spheres if there is no BVH
+int16_t closestSphereHit(const float4 rayPosition, const float4 rayDirection, SPHERE_ADDRESS_SPACE const sphere4_t* spheres, const uint16_t numberOfSpheres, __global const bvhNode4_t* nodes, const uint32_t numberOfNodes, float* closestSphereDistance RAY_STATS_PARAMETER)
+{
+    *closestSphereDistance = INFINITY;
+    int16_t closestSphereIndex = -1;
+    RAY_STATS_ADD(RAY_STATS_RAYS, 1);
+
+    if (!numberOfNodes)
+    {
+        RAY_STATS_ADD(RAY_STATS_SPHERE_TESTS, numberOfSpheres);
+        uint16_t k;
+        for (k = 0; k < numberOfSpheres; k++)
+        {
+            const float newDistance = sphereHitDistance(rayPosition, rayDirection, spheres[k].positionRadius);
+            if (newDistance < *closestSphereDistance)
+            {
+                *closestSphereDistance = newDistance;
+                closestSphereIndex = k;
+            }
+        }
+        return closestSphereIndex;
+    }
+
+    const float4 inverseDirection = 1.0f / rayDirection;
+    uint32_t nodeIdx = 0;
+    while (nodeIdx < numberOfNodes)
+    {
+        const float4 aabbMin = nodes[nodeIdx].aabbMin;
+        const float4 aabbMax = nodes[nodeIdx].aabbMax;
+        const uint32_t escapeIdx = as_int(aabbMin.w);
+        RAY_STATS_ADD(RAY_STATS_NODE_TESTS, 1);
+        if (!isAABBHit(rayPosition, inverseDirection, aabbMin, aabbMax, *closestSphereDistance))
+        {
+            // Skip the subtree
+            nodeIdx = escapeIdx;
+            continue;
+        }
+
+        const int k = as_int(aabbMax.w);
+        if (k < 0)
+        {
+            // Inner node: its first child is the next node
+            nodeIdx++;
+            continue;
+        }
+
+        // Leaf (equal distances: the lowest sphere index wins, as in the brute force search)
+        RAY_STATS_ADD(RAY_STATS_SPHERE_TESTS, 1);
+        const float newDistance = sphereHitDistance(rayPosition, rayDirection, spheres[k].positionRadius);
+        if (newDistance < *closestSphereDistance || (newDistance == *closestSphereDistance && newDistance != INFINITY && k < closestSphereIndex))
+        {
+            *closestSphereDistance = newDistance;
+            closestSphereIndex = k;
+        }
+        nodeIdx = escapeIdx;
+    }
+    return closestSphereIndex;
+}
+
+void scatterRay(float4* rayPosition, float4* rayDirection, float4* rayColor, SPHERE_ADDRESS_SPACE const sphere4_t* sphere, const float distance, uint32_t* seed)
+{
+    const float4 positionRadius = sphere->positionRadius;
+    const float4 albedoParameter = sphere->albedoParameter;
+
+    // Ray-sphere hit position & sphere normal on hit position
+    const float4 hitPosition = *rayPosition + *rayDirection * distance;
+    float4 sphereNormal = (hitPosition - positionRadius) * (1.0f / positionRadius.w);
+    sphereNormal.w = 0.0f;
+
+    // Which face hit ?
+    const uint8_t isFrontFace = dot(*rayDirection, sphereNormal) > 0.0f ? 0 : 1;
+
+    // The ray hit a sphere => Update ray position + direction & add color info
+    *rayPosition = hitPosition;
+    switch (sphere->material)
+    {
+        case LAMBERTIAN:
+        {
+            // True Lambertian diffusion
+            const float4 direction = randomUnitVector(seed) * albedoParameter.w + sphereNormal;
+            const float threshold = 1e-8f;
+            *rayDirection = (direction.x < threshold && direction.y < threshold && direction.z < threshold) ? sphereNormal : direction;
+            break;
+        }
+
+        case METAL:
+        {
+            const float4 roughnessVector = randomUnitVector(seed) * albedoParameter.w;
+            *rayDirection = reflect4(*rayDirection, sphereNormal) + roughnessVector;
+            break;
+        }
+
+        case DIELECTRIC:
+        {
+            const float refractionRatio = isFrontFace ? 1.0f / albedoParameter.w : albedoParameter.w;
+            *rayDirection = refract4(normalize(*rayDirection), sphereNormal, refractionRatio, seed);
+            break;
+        }
+
+        default:
+            printf("ERROR::BAD_SPHERE_MATERIAL: %d\n", sphere->material);
+            break;
+    }
+    *rayColor *= albedoParameter;
+}
+
+// Vertical gradient, half precision is enough for a color
+float4 skyColor(const float4 rayDirection)
+{
+    const float skyGradiant = 0.5f * (rayDirection.y * half_rsqrt(dot(rayDirection, rayDirection)) + 1.0f);
+    return (float4)(1.0f - 0.5f * skyGradiant, 1.0f - 0.3f * skyGradiant, 1.0f, 0.0f);
+}
+
+// utils.c
+static uint32_t pcg_hash(uint32_t* seed)
+{
+    uint32_t state = *seed;
+    *seed = *seed * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+uint32_t sampleSeed(uint32_t pixelIndex, uint32_t sampleIndex)
+{
+    // Sample 0 keeps the pixel index as seed, the following samples jump far away in the sequence
+    return pixelIndex + (SAMPLE_SEED_BASE + sampleIndex) * 0x9E3779B9u;
+}
+
+float randomFloatInUnitInterval(uint32_t* seed)
+{
+    return (float)pcg_hash(seed) * (1.0f / 0xffffffffu);
+}
+
+float4 randomInUnitDisk(uint32_t* seed)
+{
+    const float theta = 2.0f * M_PI_F * randomFloatInUnitInterval(seed);
+    const float r = native_sqrt(randomFloatInUnitInterval(seed));
+    return (float4)(r * native_cos(theta), r * native_sin(theta), 0.0f, 0.0f);
+}
+
+// Uniform on the sphere: cos(phi) is drawn directly, sin(phi) follows (no acos)
+float4 randomUnitVector(uint32_t* seed)
+{
+    const float theta = 2.0f * M_PI_F * randomFloatInUnitInterval(seed);
+    const float cosPhi = 1.0f - 2.0f * randomFloatInUnitInterval(seed);
+    const float sinPhi = native_sqrt(fmax(1.0f - cosPhi * cosPhi, 0.0f));
+    return (float4)(native_cos(theta) * sinPhi, native_sin(theta) * sinPhi, cosPhi, 0.0f);
+}
+
+float shlickReflectance(float cos_theta, float refractionRatio)
+{
+    float r0 = (1.0f - refractionRatio) / (1.0f + refractionRatio);
+    r0 *= r0;
+    const float x = 1.0f - cos_theta;
+    const float x2 = x * x;
+    return r0 + (1.0f - r0) * x2 * x2 * x;
+}
+
+float4 reflect4(const float4 v, const float4 n)
+{
+    return v - n * (2.0f * dot(v, n));
+}
+
+float4 refract4(const float4 uv, const float4 n, const float refractionRatio, uint32_t* seed)
+{
+    const float cos_theta = fmin(dot(-uv, n), 1.0f);
+    const float sin_theta = native_sqrt(1.0f - cos_theta * cos_theta);
+
+    if (sin_theta * refractionRatio > 1.0f || shlickReflectance(cos_theta, refractionRatio) > randomFloatInUnitInterval(seed))
+        return reflect4(uv, n);
+
+    // Perpendicular & parallel components
+    const float4 refractPerpendicular = (uv + n * cos_theta) * refractionRatio;
+    const float4 refractParallel = n * -native_sqrt(fabs(1.0f - dot(refractPerpendicular, refractPerpendicular)));
+    return refractPerpendicular + refractParallel;
+}
+
+#ifdef RAY_STATS
+// Same as kernel/raytracing_gpu.cl
+// 64-bit add of count to words (low word, high word) with 32-bit atomics: carry into the high word when the low word wraps
+#define RAY_STATS_ADD_64(words, count)                                      \
+    do                                                                      \
+    {                                                                       \
+        const uint32_t addLow = (uint32_t)(count);                          \
+        uint32_t addHigh = (uint32_t)((count) >> 32);                       \
+        if (addLow && atomic_add(&(words)[0], addLow) > UINT_MAX - addLow)  \
+            addHigh++;                                                      \
+        if (addHigh)                                                        \
+            atomic_add(&(words)[1], addHigh);                               \
+    } while (0)
+
+void flushRayStats(const uint64_t* rayStats, __local uint32_t* groupStats, __global uint32_t* stats)
+{
+    const uint32_t localIdx = get_local_id(0) + get_local_id(1) * get_local_size(0);
+    const uint32_t localSize = get_local_size(0) * get_local_size(1);
+    uint32_t k;
+    for (k = localIdx; k < 2 * RAY_STATS_COUNTERS; k += localSize)
+        groupStats[k] = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (k = 0; k < RAY_STATS_COUNTERS; k++)
+        if (rayStats[k])
+            RAY_STATS_ADD_64(&groupStats[2 * k], rayStats[k]);
+    // Rays of the longest work-item: maximum of the high words, then of the low words under the maximum high word
+    const uint32_t raysHigh = (uint32_t)(rayStats[RAY_STATS_RAYS] >> 32);
+    atomic_max(&groupStats[2 * RAY_STATS_LANE_SLOTS + 1], raysHigh);
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (raysHigh == groupStats[2 * RAY_STATS_LANE_SLOTS + 1])
+        atomic_max(&groupStats[2 * RAY_STATS_LANE_SLOTS], (uint32_t)rayStats[RAY_STATS_RAYS]);
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (k = localIdx; k < RAY_STATS_COUNTERS; k += localSize)
+    {
+        uint64_t count = ((uint64_t)groupStats[2 * k + 1] << 32) | groupStats[2 * k];
+        if (k == RAY_STATS_LANE_SLOTS)
+            count *= localSize;
+        if (count)
+            RAY_STATS_ADD_64(&stats[2 * k], count);
+    }
+}
+#endif
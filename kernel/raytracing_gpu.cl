@@ -1,3 +1,14 @@
+// Sphere memory, set by the host at build time: __global (default) or __constant when the scene fits in it
+#ifndef SPHERE_ADDRESS_SPACE
+#define SPHERE_ADDRESS_SPACE __global
+#endif
+
+// First sample index of the random sequences, set by the host at build time: reference renders draw samples disjoint
+// from the ones of the renders compared to them
+#ifndef SAMPLE_SEED_BASE
+#define SAMPLE_SEED_BASE 0u
+#endif
+
 // Structs
 typedef struct color_t
 {
@@ -36,14 +47,69 @@ typedef struct sphere_t
     enum { LAMBERTIAN, METAL, DIELECTRIC, NUMBER_OF_MATERIAL } material;     
 } sphere_t;
 
+// Flattened BVH node (mirrored by bvhNode_t on the host, see include/bvh.h)
+typedef struct bvhNode_t
+{
+    vec3_t aabbMin;
+    int escapeIndex;
+    vec3_t aabbMax;
+    int sphereIndex;
+} bvhNode_t;
+
+// Wavefront path state (mirrored by wavefrontPath_t on the host)
+typedef struct path_t
+{
+    vec3_t position;
+    vec3_t direction;
+    color_t throughput;
+    uint seed;
+    int sphereIndex;
+    float hitDistance;
+} path_t;
+
+// Image of a batch (mirrored by batchEntry_t on the host, see include/batch_openCL.h)
+typedef struct batchEntry_t
+{
+    uint pixelOffset;
+    uint sphereOffset;
+    ushort width;
+    ushort height;
+    ushort numberOfSpheres;
+    ushort padding;
+} batchEntry_t;
+
 // Types
 typedef uchar 	uint8_t;
 typedef ushort 	uint16_t;
 typedef short 	int16_t;
 typedef uint 	uint32_t;
+typedef ulong 	uint64_t;
+
+// Ray statistics (--stats, program built with -DRAY_STATS, mirrored by rayStatsCounter_t on the host): every work-item
+// counts in private memory, the work-group sums its counts in local memory and one work-item per counter adds the sum to
+// the global counter, all in 64 bits (the persistent kernel flushes once after many pixels; local & global counters are
+// low word, high word pairs added with 32-bit atomics). Without RAY_STATS the counters & their parameters compile out.
+// RAY_STATS_LANE_SLOTS is only counted by the work-group: its size times the rays of its longest work-item (the SIMD
+// lanes held by the bounce loops, alive or not), the lane utilization being RAY_STATS_RAYS / RAY_STATS_LANE_SLOTS.
+#define RAY_STATS_DEPTH_BINS 16
+enum { RAY_STATS_SAMPLES, RAY_STATS_RAYS, RAY_STATS_SPHERE_TESTS, RAY_STATS_NODE_TESTS, RAY_STATS_SKY_HITS, RAY_STATS_TRUNCATED, RAY_STATS_LANE_SLOTS, RAY_STATS_DEPTH, RAY_STATS_COUNTERS = RAY_STATS_DEPTH + RAY_STATS_DEPTH_BINS };
+#ifdef RAY_STATS
+#define RAY_STATS_DECLARE uint64_t rayStats[RAY_STATS_COUNTERS] = { 0 };
+#define RAY_STATS_PARAMETER , uint64_t* rayStats
+#define RAY_STATS_ARGUMENT , rayStats
+#define RAY_STATS_KERNEL_PARAMETER , __global uint32_t* restrict stats
+#define RAY_STATS_ADD(counter, count) (rayStats[counter] += (count))
+#else
+#define RAY_STATS_DECLARE
+#define RAY_STATS_PARAMETER
+#define RAY_STATS_ARGUMENT
+#define RAY_STATS_KERNEL_PARAMETER
+#define RAY_STATS_ADD(counter, count)
+#endif
 
 // Prototypes
 // Utils.h
+uint32_t sampleSeed(uint32_t pixelIndex, uint32_t sampleIndex);
 float randomFloatInUnitInterval(uint32_t* seed);
 float randomFloat(uint32_t* seed, float min, float max);
 vec3_t randomInUnitDisk(uint32_t* seed);
@@ -54,6 +120,19 @@ float shlickReflectance(float cos_theta, float refractionRation);
 
 vec3_t randomDefocusedRayPosition(uint32_t* seed, const vec3_t* center, const vec3_t* defocus_disk_u, const vec3_t* defocus_disk_v);
 
+// Raytracing steps
+void generateRay(uint32_t i, uint32_t j, __global const camera_t* camera, uint32_t* seed, vec3_t* rayPosition, vec3_t* rayDirection);
+float sphereHitDistance(const vec3_t* rayPosition, const vec3_t* rayDirection, const vec3_t center, const float radius);
+uint8_t isAABBHit(const vec3_t* rayPosition, const vec3_t* inverseDirection, __global const bvhNode_t* node, const float maxDistance);
+int16_t closestSphereHit(const vec3_t* rayPosition, const vec3_t* rayDirection, SPHERE_ADDRESS_SPACE const sphere_t* spheres, const uint16_t numberOfSpheres, __global const bvhNode_t* nodes, const uint32_t numberOfNodes, float* closestSphereDistance RAY_STATS_PARAMETER);
+void scatterRay(vec3_t* rayPosition, vec3_t* rayDirection, color_t* rayColor, SPHERE_ADDRESS_SPACE const sphere_t* sphere, const float distance, uint32_t* seed);
+color_t skyColor(const vec3_t* rayDirection);
+color_t tracePixel(uint32_t i, uint32_t j, uint32_t gid, SPHERE_ADDRESS_SPACE const sphere_t* spheres, __global const camera_t* camera, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint16_t numberOfSpheres, __global const bvhNode_t* nodes, const uint32_t numberOfNodes, const uint32_t sampleOffset RAY_STATS_PARAMETER);
+void accumulatePixel(__global color_t* image, uint32_t gid, color_t pixelColor, const uint32_t sampleOffset, const uint16_t raysPerPixel);
+#ifdef RAY_STATS
+void flushRayStats(const uint64_t* rayStats, __local uint32_t* groupStats, __global uint32_t* stats);
+#endif
+
 // vec3_color.h
 float vec3_lengthSquared(const vec3_t* v);
 float vec3_magnitude(const vec3_t* v);
@@ -82,150 +161,726 @@ const color_t BLACK = { 0.0f, 0.0f, 0.0f };
 
 // Kernel
 __kernel void raytracing(	__global color_t* restrict image, 
-						 	__global const sphere_t* restrict spheres, 
+						 	SPHERE_ADDRESS_SPACE const sphere_t* restrict spheres, 
 						 	__global const camera_t* restrict camera, 
 							const uint16_t width, 
 							const uint16_t height, 
 							const uint16_t raysPerPixel, 
 							const uint8_t raysDepth, 
-							const uint16_t numberOfSpheres) 
+							const uint16_t numberOfSpheres,
+							const uint32_t sampleOffset,
+							__global const bvhNode_t* restrict nodes,
+							const uint32_t numberOfNodes
+							RAY_STATS_KERNEL_PARAMETER)
+{
+	uint i = get_global_id(0);
+	uint j = get_global_id(1);
+
+	// The global range is rounded up to a multiple of the work-group shape
+#ifdef RAY_STATS
+	// (every work-item of the group reaches the barriers of the statistics)
+	RAY_STATS_DECLARE
+	__local uint32_t groupStats[2 * RAY_STATS_COUNTERS];
+	if (i < width && j < height)
+#else
+	if (i >= width || j >= height)
+		return;
+#endif
+	{
+		uint gid = i + j * width;
+
+		// A band launch (global offset on the rows) writes to a band sized image
+		const uint imageIdx = gid - get_global_offset(1) * width;
+
+		color_t pixelColor = tracePixel(i, j, gid, spheres, camera, raysPerPixel, raysDepth, numberOfSpheres, nodes, numberOfNodes, sampleOffset RAY_STATS_ARGUMENT);
+		accumulatePixel(image, imageIdx, pixelColor, sampleOffset, raysPerPixel);
+	}
+#ifdef RAY_STATS
+	flushRayStats(rayStats, groupStats, stats);
+#endif
+}
+
+// Batch of small images with their own camera & spheres: one work-item per pixel of all the images, packed one after
+// the other in "images", the image of a pixel is found by a binary search of the pixel offsets of the batch entries
+__kernel void raytracing_batch(	__global color_t* restrict images,
+								SPHERE_ADDRESS_SPACE const sphere_t* restrict spheres,
+								__global const camera_t* restrict cameras,
+								__global const batchEntry_t* restrict entries,
+								const uint32_t numberOfImages,
+								const uint32_t numberOfPixels,
+								const uint16_t raysPerPixel,
+								const uint8_t raysDepth)
+{
+	const uint32_t pixelIdx = get_global_id(0);
+	if (pixelIdx >= numberOfPixels)
+		return;
+
+	// Last image starting at or before the pixel
+	uint32_t first = 0, last = numberOfImages - 1;
+	while (first < last)
+	{
+		const uint32_t middle = (first + last + 1) / 2;
+		if (entries[middle].pixelOffset <= pixelIdx)
+			first = middle;
+		else
+			last = middle - 1;
+	}
+	const batchEntry_t entry = entries[first];
+
+	// Same pixel & seeds as the image rendered on its own (no statistics)
+	RAY_STATS_DECLARE
+	const uint32_t gid = pixelIdx - entry.pixelOffset;
+	color_t pixelColor = tracePixel(gid % entry.width, gid / entry.width, gid, spheres + entry.sphereOffset, &cameras[first], raysPerPixel, raysDepth, entry.numberOfSpheres, 0, 0, 0 RAY_STATS_ARGUMENT);
+	accumulatePixel(images + entry.pixelOffset, gid, pixelColor, 0, raysPerPixel);
+}
+
+#ifdef cl_khr_fp16
+#pragma OPENCL EXTENSION cl_khr_fp16 : enable
+
+// Half precision variant: the framebuffer (3 halves per pixel) & the path throughput are stored in half, the samples
+// of a pixel are summed in float and the intersections stay in float (the radius 1000 ground sphere needs its mantissa)
+__kernel void raytracing_half(	__global half* restrict image,
+								SPHERE_ADDRESS_SPACE const sphere_t* restrict spheres,
+								__global const camera_t* restrict camera,
+								const uint16_t width,
+								const uint16_t height,
+								const uint16_t raysPerPixel,
+								const uint8_t raysDepth,
+								const uint16_t numberOfSpheres,
+								const uint32_t sampleOffset,
+								__global const bvhNode_t* restrict nodes,
+								const uint32_t numberOfNodes
+								RAY_STATS_KERNEL_PARAMETER)
+{
+	uint i = get_global_id(0);
+	uint j = get_global_id(1);
+
+	// The global range is rounded up to a multiple of the work-group shape
+#ifdef RAY_STATS
+	// (every work-item of the group reaches the barriers of the statistics)
+	RAY_STATS_DECLARE
+	__local uint32_t groupStats[2 * RAY_STATS_COUNTERS];
+	if (i < width && j < height)
+#else
+	if (i >= width || j >= height)
+		return;
+#endif
+	{
+		uint gid = i + j * width;
+
+		// A band launch (global offset on the rows) writes to a band sized image
+		const uint imageIdx = gid - get_global_offset(1) * width;
+
+		float3 pixelColor = (float3)(0.0f, 0.0f, 0.0f);
+		uint16_t rayIdx, depthIdx;
+
+		for (rayIdx = 0; rayIdx < raysPerPixel; rayIdx++)
+		{
+			// One random stream per sample, so that a launch can start at any sample index
+			uint32_t seed = sampleSeed(gid, sampleOffset + rayIdx);
+			RAY_STATS_ADD(RAY_STATS_SAMPLES, 1);
+
+			// Ray Initialisation
+			vec3_t rayPosition, rayDirection;
+			generateRay(i, j, camera, &seed, &rayPosition, &rayDirection);
+			half3 rayColor = (half3)((half)1.0f, (half)1.0f, (half)1.0f);
+
+			// Bounce loop
+			for (depthIdx = 0; depthIdx < raysDepth; depthIdx++)
+			{
+				float closestSphereDistance;
+				int16_t closestSphereIndex = closestSphereHit(&rayPosition, &rayDirection, spheres, numberOfSpheres, nodes, numberOfNodes, &closestSphereDistance RAY_STATS_ARGUMENT);
+
+				if (closestSphereIndex == -1)
+				{
+					// The ray hit the sky, the path ends
+					const color_t sky = skyColor(&rayDirection);
+					pixelColor += convert_float3(rayColor * convert_half3((float3)(sky.r, sky.g, sky.b)));
+					RAY_STATS_ADD(RAY_STATS_SKY_HITS, 1);
+					RAY_STATS_ADD(RAY_STATS_DEPTH + min(depthIdx, (uint16_t)(RAY_STATS_DEPTH_BINS - 1)), 1);
+					break;
+				}
+
+				// scatterRay multiplies the color it is given by the albedo of the sphere
+				color_t albedo = { 1.0f, 1.0f, 1.0f };
+				scatterRay(&rayPosition, &rayDirection, &albedo, &spheres[closestSphereIndex], closestSphereDistance, &seed);
+				rayColor *= convert_half3((float3)(albedo.r, albedo.g, albedo.b));
+			}
+			if (depthIdx == raysDepth)
+				RAY_STATS_ADD(RAY_STATS_TRUNCATED, 1);
+		}
+
+		// image holds the mean of the sampleOffset samples of the previous launches
+		if (sampleOffset != 0)
+			pixelColor += vload_half3(imageIdx, image) * (float)sampleOffset;
+		vstore_half3(pixelColor * (1.0f / (sampleOffset + raysPerPixel)), imageIdx, image);
+	}
+#ifdef RAY_STATS
+	flushRayStats(rayStats, groupStats, stats);
+#endif
+}
+#endif
+
+// Persistent threads: about one wave of work-items is launched, each work-item pulls batches of pixels from a global
+// atomic counter until the frame is done, so that lanes whose paths ended early start another pixel instead of idling
+// until the longest path of their group is traced.
+__kernel void raytracing_persistent(	__global color_t* restrict image,
+										SPHERE_ADDRESS_SPACE const sphere_t* restrict spheres,
+										__global const camera_t* restrict camera,
+										const uint16_t width,
+										const uint16_t height,
+										const uint16_t raysPerPixel,
+										const uint8_t raysDepth,
+										const uint16_t numberOfSpheres,
+										const uint32_t sampleOffset,
+										__global uint32_t* restrict workCounter,
+										const uint32_t batchSize,
+										__global const bvhNode_t* restrict nodes,
+										const uint32_t numberOfNodes
+										RAY_STATS_KERNEL_PARAMETER)
 {
-	ulong gid = get_global_id(0);
-	uint i = gid % width;
-	uint j = gid / width;
-	
-	// Rays weight
-	const float inv_raysPerPixel = 1.0f / raysPerPixel;
+	const uint32_t numberOfPixels = width * height;
+	uint32_t batchStart;
+#ifdef RAY_STATS
+	RAY_STATS_DECLARE
+	__local uint32_t groupStats[2 * RAY_STATS_COUNTERS];
+#endif
+
+	while ((batchStart = atomic_add(workCounter, batchSize)) < numberOfPixels)
+	{
+		const uint32_t batchEnd = min(batchStart + batchSize, numberOfPixels);
+		uint32_t gid;
+		for (gid = batchStart; gid < batchEnd; gid++)
+		{
+			color_t pixelColor = tracePixel(gid % width, gid / width, gid, spheres, camera, raysPerPixel, raysDepth, numberOfSpheres, nodes, numberOfNodes, sampleOffset RAY_STATS_ARGUMENT);
+			accumulatePixel(image, gid, pixelColor, sampleOffset, raysPerPixel);
+		}
+	}
+#ifdef RAY_STATS
+	flushRayStats(rayStats, groupStats, stats);
+#endif
+}
+
+// Local memory staging: the work-group copies the spheres chunk by chunk into local memory and every work-item tests its
+// ray against the chunk, so a sphere is read once per work-group from global memory instead of once per work-item.
+// The barriers require every work-item of the group to run the same sweeps: out of image work-items and ended paths
+// keep sweeping, the bounce loop ends when no path of the group is alive.
+__kernel void raytracing_local(	__global color_t* restrict image,
+								SPHERE_ADDRESS_SPACE const sphere_t* restrict spheres,
+								__global const camera_t* restrict camera,
+								const uint16_t width,
+								const uint16_t height,
+								const uint16_t raysPerPixel,
+								const uint8_t raysDepth,
+								const uint16_t numberOfSpheres,
+								const uint32_t sampleOffset,
+								__local sphere_t* localSpheres,
+								const uint16_t chunkSize
+								RAY_STATS_KERNEL_PARAMETER)
+{
+	uint i = get_global_id(0);
+	uint j = get_global_id(1);
+	const uint8_t isInImage = i < width && j < height;
+	uint gid = i + j * width;
+	const uint imageIdx = gid - get_global_offset(1) * width;
+
+	const uint32_t localIdx = get_local_id(0) + get_local_id(1) * get_local_size(0);
+	const uint32_t localSize = get_local_size(0) * get_local_size(1);
+	__local int isGroupAlive;
+#ifdef RAY_STATS
+	__local uint32_t groupStats[2 * RAY_STATS_COUNTERS];
+#endif
 
-	// Pixel initialisation
 	color_t pixelColor = (color_t){ 0.0f, 0.0f, 0.0f };
-	uint32_t seed = gid;
-	uint16_t k, rayIdx, depthIdx;
-    
+	uint16_t rayIdx, depthIdx, chunkStart, k;
+	RAY_STATS_DECLARE
+
 	for (rayIdx = 0; rayIdx < raysPerPixel; rayIdx++)
 	{
-		// Pixel position (Ray position in viewport plane)
-		vec3_t pixelPosition_u = vec3_scalarMul_return(&camera->step_u, i + randomFloatInUnitInterval(&seed));
-		vec3_t pixelPosition_v = vec3_scalarMul_return(&camera->step_v, j + randomFloatInUnitInterval(&seed));
-		vec3_t pixelPosition = camera->viewportUpperLeft;
-		pixelPosition = vec3_add(&pixelPosition, &pixelPosition_u);
-		pixelPosition = vec3_add(&pixelPosition, &pixelPosition_v);
-
-		// Ray Initialisation
-		vec3_t rayPosition = (camera->defocusAngle <= 0.0f) ? camera->lookFrom : randomDefocusedRayPosition(&seed, &camera->lookFrom, &camera->defocus_disk_u, &camera->defocus_disk_v);
-		vec3_t rayDirection = vec3_sub(&pixelPosition, &rayPosition);
+		// Same random stream as tracePixel()
+		uint32_t seed = sampleSeed(gid, sampleOffset + rayIdx);
+		vec3_t rayPosition, rayDirection;
+		if (isInImage)
+		{
+			generateRay(i, j, camera, &seed, &rayPosition, &rayDirection);
+			RAY_STATS_ADD(RAY_STATS_SAMPLES, 1);
+		}
 		color_t rayColor = { 1.0f, 1.0f, 1.0f };
+		uint8_t isAlive = isInImage, isSkyHit = 0;
 
-		// Bounce loop
-		uint8_t isSkyHit = 0;
-		for (depthIdx = 0; depthIdx < raysDepth && !isSkyHit; depthIdx++)
+		for (depthIdx = 0; depthIdx < raysDepth; depthIdx++)
 		{
-			// Iterate through spheres to get the closest one
+			// Group-uniform exit
+			barrier(CLK_LOCAL_MEM_FENCE);
+			if (localIdx == 0)
+				isGroupAlive = 0;
+			barrier(CLK_LOCAL_MEM_FENCE);
+			if (isAlive)
+				isGroupAlive = 1;
+			barrier(CLK_LOCAL_MEM_FENCE);
+			if (!isGroupAlive)
+				break;
+
+			// Closest sphere, chunk by chunk (same order as closestSphereHit(): same sphere on equal distances)
 			float closestSphereDistance = INFINITY;
 			int16_t closestSphereIndex = -1;
-			for (k = 0; k < numberOfSpheres; k++)
-			{   
-				// Maths (line == sphere equation)
-				vec3_t originToCenter = vec3_sub(&rayPosition, &spheres[k].position);
-				float a = vec3_dot(&rayDirection, &rayDirection);
-				float half_b = vec3_dot(&originToCenter, &rayDirection);
-				float c = vec3_dot(&originToCenter, &originToCenter) - spheres[k].radius * spheres[k].radius;
-				float delta = half_b*half_b - a*c;
-
-				// 1 or 2 solutions => sphere hit
-				if (delta >= 0)
-				{
-					float newDistance = (-half_b - sqrt(delta))/ a;
-
-					// Ignore digital noise
-					if (newDistance <=  0.001f)
-						continue;
+			for (chunkStart = 0; chunkStart < numberOfSpheres; chunkStart += chunkSize)
+			{
+				const uint16_t count = min((uint16_t)(numberOfSpheres - chunkStart), chunkSize);
+				barrier(CLK_LOCAL_MEM_FENCE);
+				for (k = localIdx; k < count; k += localSize)
+					localSpheres[k] = spheres[chunkStart + k];
+				barrier(CLK_LOCAL_MEM_FENCE);
 
-					// Update sphere
+				if (!isAlive)
+					continue;
+				for (k = 0; k < count; k++)
+				{
+					float newDistance = sphereHitDistance(&rayPosition, &rayDirection, localSpheres[k].position, localSpheres[k].radius);
 					if (newDistance < closestSphereDistance)
 					{
 						closestSphereDistance = newDistance;
-						closestSphereIndex = k;
+						closestSphereIndex = chunkStart + k;
 					}
 				}
 			}
 
-			// If sphere hit, else sky hit
+			if (!isAlive)
+				continue;
+			RAY_STATS_ADD(RAY_STATS_RAYS, 1);
+			RAY_STATS_ADD(RAY_STATS_SPHERE_TESTS, numberOfSpheres);
 			if (closestSphereIndex != -1)
-			{
-				// Ray-sphere hit position
-				vec3_t hitPosition = vec3_scalarMul_return(&rayDirection, closestSphereDistance);
-				hitPosition = vec3_add(&rayPosition, &hitPosition);
-
-				// Get sphere normal on hit position
-				vec3_t sphereNormal = vec3_sub(&hitPosition, &spheres[closestSphereIndex].position);
-				vec3_scalarMul(&sphereNormal, 1.0f / spheres[closestSphereIndex].radius);   
-
-				// Which face hit ?
-				uint8_t isFrontFace = vec3_dot(&rayDirection, &sphereNormal) > 0 ? 0 : 1;
-
-				// The ray hit a sphere => Update ray position + direction & add color info
-				rayPosition = hitPosition;
-				switch (spheres[closestSphereIndex].material)
-				{
-					case LAMBERTIAN:
-						// Bad hemisphere diffusion  
-						// rayDirection = randomInHemisphere(&seed, &sphereNormal); 
-						
-						// True Lambertian diffusion
-						rayDirection = randomUnitVector(&seed);
-						vec3_scalarMul(&rayDirection, spheres[closestSphereIndex].roughness);
-						rayDirection = vec3_add(&rayDirection, &sphereNormal);      
-						if (vec3_isNearZero(&rayDirection))
-							rayDirection = sphereNormal;
-						break;
-						
-					case METAL:
-					{
-						vec3_t roughnessVector = randomUnitVector(&seed);
-						vec3_scalarMul(&roughnessVector, spheres[closestSphereIndex].fuzziness);
-						rayDirection = vec3_reflect(&rayDirection, &sphereNormal);
-						rayDirection = vec3_add(&rayDirection, &roughnessVector);
-						break;
-					}
-
-					case DIELECTRIC:
-					{
-
-						float refractionRatio = isFrontFace ? 1.0f / spheres[closestSphereIndex].refractionIndex : spheres[closestSphereIndex].refractionIndex;
-						vec3_t uRayDirection = rayDirection;
-						vec3_normalize(&uRayDirection);
-						rayDirection = vec3_refract(&uRayDirection, &sphereNormal, refractionRatio, &seed);
-						break;
-					}
-					
-					default:
-						printf("ERROR::BAD_SPHERE_MATERIAL: %d\n", spheres[closestSphereIndex].material);
-						break;
-				}
-				rayColor = color_mul(&rayColor, &spheres[closestSphereIndex].albedo);
-			}
+				scatterRay(&rayPosition, &rayDirection, &rayColor, &spheres[closestSphereIndex], closestSphereDistance, &seed);
 			else
 			{
-				// The ray hit the sky, the loop must stop
+				// The ray hit the sky, the path ends
+				isAlive = 0;
 				isSkyHit = 1;
-				float skyGradiant = 0.5f * (rayDirection.y / vec3_magnitude(&rayDirection) + 1.0f);
-				const color_t skyColor = (color_t){ (1.0f - skyGradiant)*1.0f + skyGradiant*0.5f, (1.0f - skyGradiant)*1.0f + skyGradiant*0.7f, (1.0f- skyGradiant)*1.0f + skyGradiant*1.0f };
-				rayColor = color_mul(&rayColor, &skyColor);
+				const color_t sky = skyColor(&rayDirection);
+				rayColor = color_mul(&rayColor, &sky);
+				RAY_STATS_ADD(RAY_STATS_SKY_HITS, 1);
+				RAY_STATS_ADD(RAY_STATS_DEPTH + min(depthIdx, (uint16_t)(RAY_STATS_DEPTH_BINS - 1)), 1);
 			}
 		}
 
 		if (isSkyHit)
 			pixelColor = color_add(&pixelColor, &rayColor);
-		else 
-			pixelColor = color_add(&pixelColor, &BLACK);
+		else if (isInImage)
+			RAY_STATS_ADD(RAY_STATS_TRUNCATED, 1);
 	}
-	color_scalarMul(&pixelColor, inv_raysPerPixel);
-	image[i + j * width] = pixelColor;
 
+	if (isInImage)
+		accumulatePixel(image, imageIdx, pixelColor, sampleOffset, raysPerPixel);
+#ifdef RAY_STATS
+	flushRayStats(rayStats, groupStats, stats);
+#endif
+}
+
+// Wavefront kernels
+// One sample of a pool of pixels is traced bounce by bounce: generate -> (extend -> shade per material)* -> accumulate.
+// The paths still alive are compacted into queues through atomic counters, so that every shade launch only sees one
+// material. The host never waits for the counters: extend & shade are launched over the whole pool and their work-items
+// past the length of their queue (queueCounters: one per material, then the two ray queues) return at once.
+__kernel void wavefront_generate(	__global path_t* restrict paths,
+									__global uint32_t* restrict rayQueue,
+									__global color_t* restrict sampleColors,
+									__global const camera_t* restrict camera,
+									const uint16_t width,
+									const uint32_t pixelOffset,
+									const uint32_t pathCount,
+									const uint32_t sampleIndex)
+{
+	uint32_t pathIdx = get_global_id(0);
+	if (pathIdx >= pathCount)
+		return;
+	uint32_t gid = pixelOffset + pathIdx;
+
+	path_t path;
+	path.seed = sampleSeed(gid, sampleIndex);
+	generateRay(gid % width, gid / width, camera, &path.seed, &path.position, &path.direction);
+	path.throughput = (color_t){ 1.0f, 1.0f, 1.0f };
+	path.sphereIndex = -1;
+	path.hitDistance = 0.0f;
+
+	paths[pathIdx] = path;
+	rayQueue[pathIdx] = pathIdx;
+	sampleColors[pathIdx] = BLACK;
+}
+
+__kernel void wavefront_extend(	__global path_t* restrict paths,
+								__global const uint32_t* restrict rayQueue,
+								const uint32_t rayCounterIdx,
+								SPHERE_ADDRESS_SPACE const sphere_t* restrict spheres,
+								const uint16_t numberOfSpheres,
+								__global uint32_t* restrict materialQueues,
+								const uint32_t queueCapacity,
+								__global volatile uint32_t* queueCounters,
+								__global color_t* restrict sampleColors,
+								__global const bvhNode_t* restrict nodes,
+								const uint32_t numberOfNodes)
+{
+	uint32_t queueIdx = get_global_id(0);
+	if (queueIdx >= queueCounters[rayCounterIdx])
+		return;
+	uint32_t pathIdx = rayQueue[queueIdx];
+	vec3_t rayPosition = paths[pathIdx].position;
+	vec3_t rayDirection = paths[pathIdx].direction;
+
+	// (no statistics)
+	RAY_STATS_DECLARE
+	float closestSphereDistance;
+	int16_t closestSphereIndex = closestSphereHit(&rayPosition, &rayDirection, spheres, numberOfSpheres, nodes, numberOfNodes, &closestSphereDistance RAY_STATS_ARGUMENT);
+	if (closestSphereIndex != -1)
+	{
+		// Push the path in the queue of the hit material
+		paths[pathIdx].sphereIndex = closestSphereIndex;
+		paths[pathIdx].hitDistance = closestSphereDistance;
+		uint32_t material = spheres[closestSphereIndex].material;
+		uint32_t slot = atomic_inc(&queueCounters[material]);
+		materialQueues[material * queueCapacity + slot] = pathIdx;
+	}
+	else
+	{
+		// The path ends in the sky
+		const color_t sky = skyColor(&rayDirection);
+		color_t throughput = paths[pathIdx].throughput;
+		sampleColors[pathIdx] = color_mul(&throughput, &sky);
+	}
+}
+
+__kernel void wavefront_shade(	__global path_t* restrict paths,
+								__global const uint32_t* restrict materialQueues,
+								const uint32_t queueCapacity,
+								const uint32_t material,
+								SPHERE_ADDRESS_SPACE const sphere_t* restrict spheres,
+								__global uint32_t* restrict nextRayQueue,
+								__global volatile uint32_t* queueCounters,
+								const uint32_t nextRayCounterIdx)
+{
+	uint32_t queueIdx = get_global_id(0);
+	if (queueIdx >= queueCounters[material])
+		return;
+	uint32_t pathIdx = materialQueues[material * queueCapacity + queueIdx];
+
+	path_t path = paths[pathIdx];
+	scatterRay(&path.position, &path.direction, &path.throughput, &spheres[path.sphereIndex], path.hitDistance, &path.seed);
+	paths[pathIdx] = path;
+
+	nextRayQueue[atomic_inc(&queueCounters[nextRayCounterIdx])] = pathIdx;
+}
+
+__kernel void wavefront_accumulate(	__global color_t* restrict image,
+									__global const color_t* restrict sampleColors,
+									const uint32_t pixelOffset,
+									const uint32_t pathCount,
+									const uint32_t sampleIndex)
+{
+	uint32_t pathIdx = get_global_id(0);
+	if (pathIdx >= pathCount)
+		return;
+
+	// Same running mean as the megakernel
+	color_t sampleColor = sampleColors[pathIdx];
+	if (sampleIndex == 0)
+	{
+		image[pixelOffset + pathIdx] = sampleColor;
+		return;
+	}
+	color_t accumulatedColor = image[pixelOffset + pathIdx];
+	color_scalarMul(&accumulatedColor, sampleIndex);
+	accumulatedColor = color_add(&accumulatedColor, &sampleColor);
+	color_scalarMul(&accumulatedColor, 1.0f / (sampleIndex + 1));
+	image[pixelOffset + pathIdx] = accumulatedColor;
 }
 
 // Functions
+// Raytracing steps (shared by the megakernel and the wavefront kernels)
+void generateRay(uint32_t i, uint32_t j, __global const camera_t* camera, uint32_t* seed, vec3_t* rayPosition, vec3_t* rayDirection)
+{
+    // Pixel position (Ray position in viewport plane)
+    vec3_t pixelPosition_u = vec3_scalarMul_return(&camera->step_u, i + randomFloatInUnitInterval(seed));
+    vec3_t pixelPosition_v = vec3_scalarMul_return(&camera->step_v, j + randomFloatInUnitInterval(seed));
+    vec3_t pixelPosition = camera->viewportUpperLeft;
+    pixelPosition = vec3_add(&pixelPosition, &pixelPosition_u);
+    pixelPosition = vec3_add(&pixelPosition, &pixelPosition_v);
+
+    // Ray Initialisation
+    *rayPosition = (camera->defocusAngle <= 0.0f) ? camera->lookFrom : randomDefocusedRayPosition(seed, &camera->lookFrom, &camera->defocus_disk_u, &camera->defocus_disk_v);
+    *rayDirection = vec3_sub(&pixelPosition, rayPosition);
+}
+
+// Distance to the sphere along the ray, INFINITY if missed (or closer than the digital noise)
+float sphereHitDistance(const vec3_t* rayPosition, const vec3_t* rayDirection, const vec3_t center, const float radius)
+{
+    // Maths (line == sphere equation)
+    vec3_t originToCenter = vec3_sub(rayPosition, &center);
+    float a = vec3_dot(rayDirection, rayDirection);
+    float half_b = vec3_dot(&originToCenter, rayDirection);
+    float c = vec3_dot(&originToCenter, &originToCenter) - radius * radius;
+    float delta = half_b*half_b - a*c;
+
+    // 1 or 2 solutions => sphere hit
+    if (delta < 0)
+        return INFINITY;
+    float distance = (-half_b - sqrt(delta))/ a;
+
+    // Ignore digital noise
+    return distance <= 0.001f ? INFINITY : distance;
+}
+
+// Slab test: does the ray enter the node box before maxDistance (and leave it after the digital noise distance)?
+uint8_t isAABBHit(const vec3_t* rayPosition, const vec3_t* inverseDirection, __global const bvhNode_t* node, const float maxDistance)
+{
+    const float tx1 = (node->aabbMin.x - rayPosition->x) * inverseDirection->x, tx2 = (node->aabbMax.x - rayPosition->x) * inverseDirection->x;
+    const float ty1 = (node->aabbMin.y - rayPosition->y) * inverseDirection->y, ty2 = (node->aabbMax.y - rayPosition->y) * inverseDirection->y;
+    const float tz1 = (node->aabbMin.z - rayPosition->z) * inverseDirection->z, tz2 = (node->aabbMax.z - rayPosition->z) * inverseDirection->z;
+
+    // fmin / fmax drop the NaN of a ray parallel to a slab starting on its plane
+    const float tEnter = fmax(fmax(fmin(tx1, tx2), fmin(ty1, ty2)), fmin(tz1, tz2));
+    const float tExit = fmin(fmin(fmax(tx1, tx2), fmax(ty1, ty2)), fmax(tz1, tz2));
+    return tExit >= fmax(tEnter, 0.001f) && tEnter <= maxDistance;
+}
+
+// Closest sphere along the ray, -1 for the sky: stackless BVH traversal, or all the spheres if there is no BVH.
+// On equal distances the lowest sphere index wins, so both searches return the same sphere.
+int16_t closestSphereHit(const vec3_t* rayPosition, const vec3_t* rayDirection, SPHERE_ADDRESS_SPACE const sphere_t* spheres, const uint16_t numberOfSpheres, __global const bvhNode_t* nodes, const uint32_t numberOfNodes, float* closestSphereDistance RAY_STATS_PARAMETER)
+{
+    *closestSphereDistance = INFINITY;
+    int16_t closestSphereIndex = -1;
+    RAY_STATS_ADD(RAY_STATS_RAYS, 1);
+
+    if (!numberOfNodes)
+    {
+        RAY_STATS_ADD(RAY_STATS_SPHERE_TESTS, numberOfSpheres);
+        uint16_t k;
+        for (k = 0; k < numberOfSpheres; k++)
+        {
+            float newDistance = sphereHitDistance(rayPosition, rayDirection, spheres[k].position, spheres[k].radius);
+
+            // Update sphere
+            if (newDistance < *closestSphereDistance)
+            {
+                *closestSphereDistance = newDistance;
+                closestSphereIndex = k;
+            }
+        }
+        return closestSphereIndex;
+    }
+
+    const vec3_t inverseDirection = { 1.0f / rayDirection->x, 1.0f / rayDirection->y, 1.0f / rayDirection->z };
+    uint32_t nodeIdx = 0;
+    while (nodeIdx < numberOfNodes)
+    {
+        __global const bvhNode_t* node = &nodes[nodeIdx];
+        RAY_STATS_ADD(RAY_STATS_NODE_TESTS, 1);
+        if (!isAABBHit(rayPosition, &inverseDirection, node, *closestSphereDistance))
+        {
+            // Skip the subtree
+            nodeIdx = node->escapeIndex;
+            continue;
+        }
+
+        const int k = node->sphereIndex;
+        if (k < 0)
+        {
+            // Inner node: its first child is the next node
+            nodeIdx++;
+            continue;
+        }
+
+        // Leaf
+        RAY_STATS_ADD(RAY_STATS_SPHERE_TESTS, 1);
+        float newDistance = sphereHitDistance(rayPosition, rayDirection, spheres[k].position, spheres[k].radius);
+        if (newDistance < *closestSphereDistance || (newDistance == *closestSphereDistance && newDistance != INFINITY && k < closestSphereIndex))
+        {
+            *closestSphereDistance = newDistance;
+            closestSphereIndex = k;
+        }
+        nodeIdx = node->escapeIndex;
+    }
+    return closestSphereIndex;
+}
+
+void scatterRay(vec3_t* rayPosition, vec3_t* rayDirection, color_t* rayColor, SPHERE_ADDRESS_SPACE const sphere_t* sphere, const float distance, uint32_t* seed)
+{
+    // Ray-sphere hit position
+    vec3_t hitPosition = vec3_scalarMul_return(rayDirection, distance);
+    hitPosition = vec3_add(rayPosition, &hitPosition);
+
+    // Get sphere normal on hit position
+    const vec3_t center = sphere->position;
+    vec3_t sphereNormal = vec3_sub(&hitPosition, &center);
+    vec3_scalarMul(&sphereNormal, 1.0f / sphere->radius);   
+
+    // Which face hit ?
+    uint8_t isFrontFace = vec3_dot(rayDirection, &sphereNormal) > 0 ? 0 : 1;
+
+    // The ray hit a sphere => Update ray position + direction & add color info
+    *rayPosition = hitPosition;
+    switch (sphere->material)
+    {
+        case LAMBERTIAN:
+            // Bad hemisphere diffusion  
+            // *rayDirection = randomInHemisphere(seed, &sphereNormal); 
+            
+            // True Lambertian diffusion
+            *rayDirection = randomUnitVector(seed);
+            vec3_scalarMul(rayDirection, sphere->roughness);
+            *rayDirection = vec3_add(rayDirection, &sphereNormal);      
+            if (vec3_isNearZero(rayDirection))
+                *rayDirection = sphereNormal;
+            break;
+            
+        case METAL:
+        {
+            vec3_t roughnessVector = randomUnitVector(seed);
+            vec3_scalarMul(&roughnessVector, sphere->fuzziness);
+            *rayDirection = vec3_reflect(rayDirection, &sphereNormal);
+            *rayDirection = vec3_add(rayDirection, &roughnessVector);
+            break;
+        }
+
+        case DIELECTRIC:
+        {
+            float refractionRatio = isFrontFace ? 1.0f / sphere->refractionIndex : sphere->refractionIndex;
+            vec3_t uRayDirection = *rayDirection;
+            vec3_normalize(&uRayDirection);
+            *rayDirection = vec3_refract(&uRayDirection, &sphereNormal, refractionRatio, seed);
+            break;
+        }
+        
+        default:
+            printf("ERROR::BAD_SPHERE_MATERIAL: %d\n", sphere->material);
+            break;
+    }
+    const color_t albedo = sphere->albedo;
+    *rayColor = color_mul(rayColor, &albedo);
+}
+
+color_t skyColor(const vec3_t* rayDirection)
+{
+    float skyGradiant = 0.5f * (rayDirection->y / vec3_magnitude(rayDirection) + 1.0f);
+    return (color_t){ (1.0f - skyGradiant)*1.0f + skyGradiant*0.5f, (1.0f - skyGradiant)*1.0f + skyGradiant*0.7f, (1.0f- skyGradiant)*1.0f + skyGradiant*1.0f };
+}
+
+// Sum of the raysPerPixel samples of pixel (i, j), starting at sample sampleOffset
+color_t tracePixel(uint32_t i, uint32_t j, uint32_t gid, SPHERE_ADDRESS_SPACE const sphere_t* spheres, __global const camera_t* camera, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint16_t numberOfSpheres, __global const bvhNode_t* nodes, const uint32_t numberOfNodes, const uint32_t sampleOffset RAY_STATS_PARAMETER)
+{
+    // Pixel initialisation
+    color_t pixelColor = (color_t){ 0.0f, 0.0f, 0.0f };
+    uint16_t rayIdx, depthIdx;
+
+    for (rayIdx = 0; rayIdx < raysPerPixel; rayIdx++)
+    {
+        // One random stream per sample, so that a launch can start at any sample index
+        uint32_t seed = sampleSeed(gid, sampleOffset + rayIdx);
+        RAY_STATS_ADD(RAY_STATS_SAMPLES, 1);
+
+        // Ray Initialisation
+        vec3_t rayPosition, rayDirection;
+        generateRay(i, j, camera, &seed, &rayPosition, &rayDirection);
+        color_t rayColor = { 1.0f, 1.0f, 1.0f };
+
+        // Bounce loop
+        uint8_t isSkyHit = 0;
+        for (depthIdx = 0; depthIdx < raysDepth && !isSkyHit; depthIdx++)
+        {
+            // Iterate through spheres to get the closest one
+            float closestSphereDistance;
+            int16_t closestSphereIndex = closestSphereHit(&rayPosition, &rayDirection, spheres, numberOfSpheres, nodes, numberOfNodes, &closestSphereDistance RAY_STATS_ARGUMENT);
+
+            // If sphere hit, else sky hit
+            if (closestSphereIndex != -1)
+            {
+                // The ray hit a sphere => Update ray position + direction & add color info
+                scatterRay(&rayPosition, &rayDirection, &rayColor, &spheres[closestSphereIndex], closestSphereDistance, &seed);
+            }
+            else
+            {
+                // The ray hit the sky, the loop must stop
+                isSkyHit = 1;
+                const color_t sky = skyColor(&rayDirection);
+                rayColor = color_mul(&rayColor, &sky);
+                RAY_STATS_ADD(RAY_STATS_SKY_HITS, 1);
+                RAY_STATS_ADD(RAY_STATS_DEPTH + min(depthIdx, (uint16_t)(RAY_STATS_DEPTH_BINS - 1)), 1);
+            }
+        }
+
+        if (isSkyHit)
+            pixelColor = color_add(&pixelColor, &rayColor);
+        else
+        {
+            pixelColor = color_add(&pixelColor, &BLACK);
+            RAY_STATS_ADD(RAY_STATS_TRUNCATED, 1);
+        }
+    }
+    return pixelColor;
+}
+
+// image holds the mean of the sampleOffset samples of the previous launches
+void accumulatePixel(__global color_t* image, uint32_t gid, color_t pixelColor, const uint32_t sampleOffset, const uint16_t raysPerPixel)
+{
+    if (sampleOffset == 0)
+    {
+        color_scalarMul(&pixelColor, 1.0f / raysPerPixel);
+        image[gid] = pixelColor;
+    }
+    else
+    {
+        color_t accumulatedColor = image[gid];
+        color_scalarMul(&accumulatedColor, sampleOffset);
+        accumulatedColor = color_add(&accumulatedColor, &pixelColor);
+        color_scalarMul(&accumulatedColor, 1.0f / (sampleOffset + raysPerPixel));
+        image[gid] = accumulatedColor;
+    }
+}
+
+#ifdef RAY_STATS
+// Called by every work-item of the group: 64-bit sum of the private counts in local memory, then one 64-bit add per
+// counter to the global counters
+// 64-bit add of count to words (low word, high word) with 32-bit atomics: carry into the high word when the low word wraps
+#define RAY_STATS_ADD_64(words, count)                                      \
+    do                                                                      \
+    {                                                                       \
+        const uint32_t addLow = (uint32_t)(count);                          \
+        uint32_t addHigh = (uint32_t)((count) >> 32);                       \
+        if (addLow && atomic_add(&(words)[0], addLow) > UINT_MAX - addLow)  \
+            addHigh++;                                                      \
+        if (addHigh)                                                        \
+            atomic_add(&(words)[1], addHigh);                               \
+    } while (0)
+
+void flushRayStats(const uint64_t* rayStats, __local uint32_t* groupStats, __global uint32_t* stats)
+{
+    const uint32_t localIdx = get_local_id(0) + get_local_id(1) * get_local_size(0);
+    const uint32_t localSize = get_local_size(0) * get_local_size(1);
+    uint32_t k;
+    for (k = localIdx; k < 2 * RAY_STATS_COUNTERS; k += localSize)
+        groupStats[k] = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (k = 0; k < RAY_STATS_COUNTERS; k++)
+        if (rayStats[k])
+            RAY_STATS_ADD_64(&groupStats[2 * k], rayStats[k]);
+    // Rays of the longest work-item: maximum of the high words, then of the low words under the maximum high word
+    const uint32_t raysHigh = (uint32_t)(rayStats[RAY_STATS_RAYS] >> 32);
+    atomic_max(&groupStats[2 * RAY_STATS_LANE_SLOTS + 1], raysHigh);
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (raysHigh == groupStats[2 * RAY_STATS_LANE_SLOTS + 1])
+        atomic_max(&groupStats[2 * RAY_STATS_LANE_SLOTS], (uint32_t)rayStats[RAY_STATS_RAYS]);
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (k = localIdx; k < RAY_STATS_COUNTERS; k += localSize)
+    {
+        uint64_t count = ((uint64_t)groupStats[2 * k + 1] << 32) | groupStats[2 * k];
+        if (k == RAY_STATS_LANE_SLOTS)
+            count *= localSize;
+        if (count)
+            RAY_STATS_ADD_64(&stats[2 * k], count);
+    }
+}
+#endif
+
 // utils.c
 
 // vec3_color.c
@@ -238,6 +893,12 @@ static uint32_t pcg_hash(uint32_t* seed)
 }
 
 
+uint32_t sampleSeed(uint32_t pixelIndex, uint32_t sampleIndex)
+{
+    // Sample 0 keeps the pixel index as seed, the following samples jump far away in the sequence
+    return pixelIndex + (SAMPLE_SEED_BASE + sampleIndex) * 0x9E3779B9u;
+}
+
 float randomFloatInUnitInterval(uint32_t* seed)
 {
     return (float)pcg_hash(seed) * (1.0f / 0xffffffffu);
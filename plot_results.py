@@ -1,4 +1,5 @@
 import csv
+import sys
 import matplotlib.pyplot as plt
 import numpy as np
 from matplotlib.lines import Line2D
@@ -55,7 +56,8 @@ for sqrt_s in LIST_SQRT_SPHERE:
 
 # print(dict_t_convolve)
 
-with open('result.csv', "r") as csv_file:
+# result.csv (hand-collected) by default, or the result_bench.csv of --bench
+with open(sys.argv[1] if len(sys.argv) > 1 else 'result.csv', "r") as csv_file:
     csv_reader = csv.reader(csv_file, delimiter=';')
     rows = []
     line_count = 0
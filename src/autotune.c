@@ -0,0 +1,245 @@
+#include "autotune.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "camera.h"
+#include "sphere.h"
+#include "utils.h"
+
+// Short benchmark scene
+#define AUTOTUNE_WIDTH 640
+#define AUTOTUNE_HEIGHT 360
+#define AUTOTUNE_RAYS_PER_PIXEL 8
+#define AUTOTUNE_RAYS_DEPTH 10
+#define AUTOTUNE_SQRT_NUMBER_OF_SPHERES 11
+#define AUTOTUNE_SEED 42
+#define AUTOTUNE_REPETITIONS 3
+
+#define PROFILE_LINE_LENGTH 512
+
+// Candidate launch configurations
+static const uint16_t LOCAL_SIZES[][2] = { { 64, 1 }, { 32, 2 }, { 16, 4 }, { 8, 8 }, { 4, 16 }, { 32, 4 }, { 16, 8 }, { 8, 16 }, { 32, 8 }, { 16, 16 } };
+// The first one is the default build: the image of the others must stay within VALIDATION_RMSE_TOLERANCE of its image
+static const char* BUILD_OPTIONS[] = { "", "-cl-mad-enable", "-cl-fast-relaxed-math" };
+static const uint16_t SPP_CHUNKS[] = { 1, 2, 4 };   // 0 (single launch) is measured with the shapes
+
+static int compareU64(const void* a, const void* b)
+{
+    const uint64_t x = *(const uint64_t*)a;
+    const uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+uint8_t loadLaunchConfig(const char *deviceName, const char *driverVersion, launchConfig_t *launch)
+{
+    FILE* profileFile = fopen(OPENCL_PROFILE_PATH, "r");
+    if (!profileFile)
+        return 0;
+
+    char line[PROFILE_LINE_LENGTH];
+    uint8_t isFound = 0;
+    while (!isFound && fgets(line, sizeof(line), profileFile))
+    {
+        char name[128], driver[64];
+        launchConfig_t config;
+        config.buildOptions[0] = '\0';
+        int n = sscanf(line, "%127[^;];%63[^;];%hu;%hu;%hu;%127[^\n]", name, driver, &config.localSize[0], &config.localSize[1], &config.sppChunk, config.buildOptions);
+        if (n < 5 || strcmp(name, deviceName) || strcmp(driver, driverVersion))
+            continue;
+        *launch = config;
+        isFound = 1;
+    }
+    fclose(profileFile);
+    return isFound;
+}
+
+void saveLaunchConfig(const char *deviceName, const char *driverVersion, const launchConfig_t *launch)
+{
+    // Keep the profiles of the other devices
+    char* others = calloc(1, 1);
+    size_t othersLength = 0;
+    FILE* profileFile = fopen(OPENCL_PROFILE_PATH, "r");
+    if (profileFile)
+    {
+        char line[PROFILE_LINE_LENGTH];
+        char key[256];
+        snprintf(key, sizeof(key), "%s;%s;", deviceName, driverVersion);
+        while (fgets(line, sizeof(line), profileFile))
+        {
+            if (!strncmp(line, key, strlen(key)))
+                continue;
+            others = realloc(others, othersLength + strlen(line) + 1);
+            strcpy(others + othersLength, line);
+            othersLength += strlen(line);
+        }
+        fclose(profileFile);
+    }
+
+    profileFile = fopen(OPENCL_PROFILE_PATH, "w");
+    if (!profileFile)
+    {
+        printf("ERROR::CANNOT_WRITE_PROFILE: %s\n", OPENCL_PROFILE_PATH);
+        free(others);
+        return;
+    }
+    fputs(others, profileFile);
+    fprintf(profileFile, "%s;%s;%u;%u;%u;%s\n", deviceName, driverVersion, launch->localSize[0], launch->localSize[1], launch->sppChunk, launch->buildOptions);
+    fclose(profileFile);
+    free(others);
+}
+
+// Median time of a full benchmark render with the current launch configuration, UINT64_MAX if the device rejects it
+static uint64_t timeLaunchConfig(openCL_t* openCL, const uint16_t numberOfSpheres)
+{
+    const uint16_t sppChunk = openCL->launch.sppChunk ? openCL->launch.sppChunk : AUTOTUNE_RAYS_PER_PIXEL;
+    uint64_t elapsedTimes[AUTOTUNE_REPETITIONS];
+    uint16_t repIdx;
+    uint32_t sampleOffset;
+
+    // Warm-up (also rejects the shapes the device does not accept)
+    if (enqueueRaytracing_openCL(openCL, AUTOTUNE_WIDTH, AUTOTUNE_HEIGHT, sppChunk, AUTOTUNE_RAYS_DEPTH, numberOfSpheres, 0, NULL) != CL_SUCCESS)
+        return UINT64_MAX;
+    clFinish(openCL->commandQueue);
+
+    for (repIdx = 0; repIdx < AUTOTUNE_REPETITIONS; repIdx++)
+    {
+        struct timeval start, end;
+        gettimeofday(&start, NULL);
+        for (sampleOffset = 0; sampleOffset < AUTOTUNE_RAYS_PER_PIXEL; sampleOffset += sppChunk)
+        {
+            enqueueRaytracing_openCL(openCL, AUTOTUNE_WIDTH, AUTOTUNE_HEIGHT, sppChunk, AUTOTUNE_RAYS_DEPTH, numberOfSpheres, sampleOffset, NULL);
+            clFlush(openCL->commandQueue);
+        }
+        clFinish(openCL->commandQueue);
+        gettimeofday(&end, NULL);
+        elapsedTimes[repIdx] = (end.tv_sec - start.tv_sec) * 1000000ull + (end.tv_usec - start.tv_usec);
+    }
+    qsort(elapsedTimes, AUTOTUNE_REPETITIONS, sizeof(uint64_t), compareU64);
+    return elapsedTimes[AUTOTUNE_REPETITIONS / 2];
+}
+
+// Benchmark image of the current program with the default work-group shape, in one launch
+static cl_int renderAutotuneImage(openCL_t* openCL, const uint16_t numberOfSpheres, const uint16_t localSize[2], color_t* image)
+{
+    const uint16_t sppChunk = openCL->launch.sppChunk;
+    openCL->launch.localSize[0] = localSize[0];
+    openCL->launch.localSize[1] = localSize[1];
+    openCL->launch.sppChunk = 0;
+    cl_int ret = enqueueRaytracing_openCL(openCL, AUTOTUNE_WIDTH, AUTOTUNE_HEIGHT, AUTOTUNE_RAYS_PER_PIXEL, AUTOTUNE_RAYS_DEPTH, numberOfSpheres, 0, NULL);
+    if (ret == CL_SUCCESS)
+        ret = readImage_openCL(openCL, image, AUTOTUNE_WIDTH * AUTOTUNE_HEIGHT);
+    openCL->launch.sppChunk = sppChunk;
+    return ret;
+}
+
+int autotune_openCL(const options_t *options)
+{
+    // Benchmark scene (deterministic)
+    srand(AUTOTUNE_SEED);
+    camera_t camera = initializeCamera(AUTOTUNE_WIDTH, AUTOTUNE_HEIGHT);
+    const uint16_t NUMBER_OF_SPHERES = AUTOTUNE_SQRT_NUMBER_OF_SPHERES * AUTOTUNE_SQRT_NUMBER_OF_SPHERES + 4;
+    sphere_t* spheres = malloc(NUMBER_OF_SPHERES * sizeof(sphere_t));
+    initializeSpheres(spheres, AUTOTUNE_SQRT_NUMBER_OF_SPHERES);
+
+    // From the defaults, not from the current profile
+    options_t autotuneOptions = *options;
+    autotuneOptions.isProfileIgnored = 1;
+    openCL_t openCL;
+    initializeOpenCL(&openCL, &autotuneOptions);
+    uploadScene_openCL(&openCL, spheres, NUMBER_OF_SPHERES, &camera);
+    createImage_openCL(&openCL, NULL, AUTOTUNE_WIDTH, AUTOTUNE_HEIGHT, ZERO_COPY_NONE);
+
+    printf("Autotuning %s (%s): %dx%d, %d rays per pixel, depth %d, %d spheres\n", openCL.deviceName, openCL.driverVersion, AUTOTUNE_WIDTH, AUTOTUNE_HEIGHT, AUTOTUNE_RAYS_PER_PIXEL, AUTOTUNE_RAYS_DEPTH, NUMBER_OF_SPHERES);
+    printf("build_options;local_size;spp_chunk;median_time_us\n");
+
+    // 1. Build options x work-group shapes, all samples in one launch
+    launchConfig_t best = openCL.launch;
+    uint64_t bestTime = UINT64_MAX;
+    uint16_t optionIdx, sizeIdx, chunkIdx;
+    openCL.launch.sppChunk = 0;
+    const uint16_t defaultLocalSize[2] = { openCL.launch.localSize[0], openCL.launch.localSize[1] };
+    color_t* defaultImage = malloc(AUTOTUNE_WIDTH * AUTOTUNE_HEIGHT * sizeof(color_t));
+    color_t* image = malloc(AUTOTUNE_WIDTH * AUTOTUNE_HEIGHT * sizeof(color_t));
+    uint8_t isDefaultImage = 0;
+    for (optionIdx = 0; optionIdx < sizeof(BUILD_OPTIONS) / sizeof(BUILD_OPTIONS[0]); optionIdx++)
+    {
+        if (buildProgram_openCL(&openCL, BUILD_OPTIONS[optionIdx]) != CL_SUCCESS)
+            continue;
+        strcpy(openCL.launch.buildOptions, BUILD_OPTIONS[optionIdx]);
+
+        // Faster but wrong images (e.g. relaxed math) are never saved: every program since validates against them
+        if (optionIdx == 0)
+            isDefaultImage = renderAutotuneImage(&openCL, NUMBER_OF_SPHERES, defaultLocalSize, defaultImage) == CL_SUCCESS;
+        else
+        {
+            float maxError;
+            const float rmse = (isDefaultImage && renderAutotuneImage(&openCL, NUMBER_OF_SPHERES, defaultLocalSize, image) == CL_SUCCESS)
+                ? imageRMSE(image, defaultImage, AUTOTUNE_WIDTH * AUTOTUNE_HEIGHT, &maxError) : INFINITY;
+            if (rmse > VALIDATION_RMSE_TOLERANCE)
+            {
+                printf("WARNING::AUTOTUNE_BUILD_OPTIONS_REJECTED: \"%s\", RMSE %e against the default build (tolerance %e)\n", BUILD_OPTIONS[optionIdx], rmse, VALIDATION_RMSE_TOLERANCE);
+                continue;
+            }
+        }
+
+        size_t maxWorkGroupSize = 0;
+        clGetKernelWorkGroupInfo(openCL.kernel, openCL.deviceID, CL_KERNEL_WORK_GROUP_SIZE, sizeof(maxWorkGroupSize), &maxWorkGroupSize, NULL);
+
+        for (sizeIdx = 0; sizeIdx < sizeof(LOCAL_SIZES) / sizeof(LOCAL_SIZES[0]); sizeIdx++)
+        {
+            if ((size_t)LOCAL_SIZES[sizeIdx][0] * LOCAL_SIZES[sizeIdx][1] > maxWorkGroupSize)
+                continue;
+            openCL.launch.localSize[0] = LOCAL_SIZES[sizeIdx][0];
+            openCL.launch.localSize[1] = LOCAL_SIZES[sizeIdx][1];
+
+            const uint64_t medianTime = timeLaunchConfig(&openCL, NUMBER_OF_SPHERES);
+            if (medianTime == UINT64_MAX)
+                continue;
+            printf("\"%s\";%ux%u;%u;%lu\n", openCL.launch.buildOptions, openCL.launch.localSize[0], openCL.launch.localSize[1], openCL.launch.sppChunk, medianTime);
+
+            if (medianTime < bestTime)
+            {
+                bestTime = medianTime;
+                best = openCL.launch;
+            }
+        }
+    }
+
+    // 2. Samples per launch with the best build options & shape
+    if (bestTime != UINT64_MAX)
+    {
+        buildProgram_openCL(&openCL, best.buildOptions);
+        openCL.launch = best;
+        for (chunkIdx = 0; chunkIdx < sizeof(SPP_CHUNKS) / sizeof(SPP_CHUNKS[0]); chunkIdx++)
+        {
+            openCL.launch.sppChunk = SPP_CHUNKS[chunkIdx];
+            const uint64_t medianTime = timeLaunchConfig(&openCL, NUMBER_OF_SPHERES);
+            printf("\"%s\";%ux%u;%u;%lu\n", openCL.launch.buildOptions, openCL.launch.localSize[0], openCL.launch.localSize[1], openCL.launch.sppChunk, medianTime);
+            if (medianTime < bestTime)
+            {
+                bestTime = medianTime;
+                best = openCL.launch;
+            }
+        }
+    }
+
+    releaseOpenCL(&openCL);
+    free(image);
+    free(defaultImage);
+    free(spheres);
+
+    if (bestTime == UINT64_MAX)
+    {
+        printf("ERROR::AUTOTUNE_NO_VALID_CONFIGURATION\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("Best: \"%s\" %ux%u, %u spp per launch (%lu us)\n", best.buildOptions, best.localSize[0], best.localSize[1], best.sppChunk, bestTime);
+    saveLaunchConfig(openCL.deviceName, openCL.driverVersion, &best);
+    printf("Profile saved to %s\n", OPENCL_PROFILE_PATH);
+
+    return EXIT_SUCCESS;
+}
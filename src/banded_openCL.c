@@ -0,0 +1,271 @@
+#include "banded_openCL.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "stb_image_write.h"
+
+#include "utils.h"
+#include "png_stream.h"
+#include "perf_counters.h"
+#include "memory_tracker.h"
+
+#define CHANNEL_NUM 3
+
+color_t* raytracingBands_openCL(openCL_t *openCL, color_t *image, const char *filename, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t *spheres, const uint16_t numberOfSpheres, const camera_t *camera, const options_t *options)
+{
+    cl_int ret;
+
+    // The float image of the band buffers (the half image is only read back by raytracing_openCL)
+    if (openCL->isHalfImage)
+    {
+        printf("WARNING::BANDS_WITHOUT_HALF_IMAGE: bands are rendered in float\n");
+        openCL->isHalfImage = 0;
+    }
+    uploadScene_openCL(openCL, spheres, numberOfSpheres, camera);
+
+    // The wavefront & persistent kernels walk the whole frame, bands use the megakernel of the program
+    if (options->kernel == KERNEL_WAVEFRONT || options->kernel == KERNEL_PERSISTENT)
+        printf("WARNING::BANDS_MEGAKERNEL_ONLY: rendering the bands with the megakernel\n");
+    if (options->zeroCopy != ZERO_COPY_NONE)
+        printf("WARNING::BANDS_WITHOUT_ZERO_COPY: bands are read back into the host image\n");
+
+    // Bands of whole work-group rows
+    const uint16_t groupRows = openCL->launch.localSize[1];
+    uint16_t bandRows = (height + options->bands - 1) / options->bands;
+    bandRows = (bandRows + groupRows - 1) / groupRows * groupRows;
+    const uint16_t numberOfBands = (height + bandRows - 1) / bandRows;
+    const size_t bandSize = (size_t)width * bandRows * sizeof(color_t);
+
+    cl_mem bandMemObj[BAND_BUFFERS];
+    uint8_t bufferIdx;
+    for (bufferIdx = 0; bufferIdx < BAND_BUFFERS; bufferIdx++)
+    {
+        bandMemObj[bufferIdx] = createBuffer_openCL(openCL->context, CL_MEM_READ_WRITE, bandSize, NULL, &ret);
+        if (ret != CL_SUCCESS)
+        {
+            printf("ERROR::OPENCL_BAND_BUFFER: %d (%lu bytes)\n", ret, bandSize);
+            exit(EXIT_FAILURE);
+        }
+    }
+    color_u8_t* image_u8 = trackedMalloc(width * height * sizeof(color_u8_t));
+    cl_event* readEvents = calloc(numberOfBands, sizeof(cl_event));
+    const uint16_t sppChunk = samplesPerLaunch_openCL(openCL, raysPerPixel, options);
+
+    // Time measure
+    struct timeval start, end;
+    perfPhase_t phase;
+    printf("Trace rays (%u bands of %u rows)!", numberOfBands, bandRows);
+    fflush(stdout);
+    gettimeofday(&start, NULL);
+    startPerfPhase(&phase);
+
+    // Everything is enqueued at once, the events order the two queues: band b renders into buffer b % BAND_BUFFERS once
+    // band b - BAND_BUFFERS has been read back from it, and is read back on the transfer queue once rendered
+    uint16_t bandIdx;
+    for (bandIdx = 0; bandIdx < numberOfBands; bandIdx++)
+    {
+        const uint16_t firstRow = bandIdx * bandRows;
+        const uint16_t rows = (height - firstRow < bandRows) ? height - firstRow : bandRows;
+        cl_mem bandMem = bandMemObj[bandIdx % BAND_BUFFERS];
+
+        cl_event renderEvent = NULL;
+        uint32_t sampleOffset;
+        for (sampleOffset = 0; sampleOffset < raysPerPixel; sampleOffset += sppChunk)
+        {
+            const uint16_t samples = (raysPerPixel - sampleOffset < sppChunk) ? raysPerPixel - sampleOffset : sppChunk;
+            const cl_event* waitEvent = (bandIdx >= BAND_BUFFERS && sampleOffset == 0) ? &readEvents[bandIdx - BAND_BUFFERS] : NULL;
+            if (renderEvent)
+                clReleaseEvent(renderEvent);
+            ret = enqueueRaytracingRows_openCL(openCL, bandMem, width, firstRow, rows, samples, raysDepth, numberOfSpheres, sampleOffset, waitEvent, &renderEvent);
+            if (ret != CL_SUCCESS)
+            {
+                printf("\nERROR::OPENCL_ENQUEUE_KERNEL: %d (band %u, work-group %ux%u)\n", ret, bandIdx, openCL->launch.localSize[0], openCL->launch.localSize[1]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        clFlush(openCL->commandQueue);
+
+        ret = clEnqueueReadBuffer(openCL->transferQueue, bandMem, CL_FALSE, 0, (size_t)width * rows * sizeof(color_t), image + (size_t)firstRow * width, 1, &renderEvent, &readEvents[bandIdx]);
+        clReleaseEvent(renderEvent);
+        if (ret != CL_SUCCESS)
+        {
+            printf("\nERROR::OPENCL_IMAGE_TRANSFERT: %d (band %u)\n", ret, bandIdx);
+            exit(EXIT_FAILURE);
+        }
+        clFlush(openCL->transferQueue);
+    }
+
+    // Gamma & 8 bits conversion of each band as soon as it is on the host, while the next bands render & transfer
+    for (bandIdx = 0; bandIdx < numberOfBands; bandIdx++)
+    {
+        const uint16_t firstRow = bandIdx * bandRows;
+        const uint16_t rows = (height - firstRow < bandRows) ? height - firstRow : bandRows;
+        clWaitForEvents(1, &readEvents[bandIdx]);
+        clReleaseEvent(readEvents[bandIdx]);
+        imageLinearToGammaU8(image + (size_t)firstRow * width, image_u8 + (size_t)firstRow * width, width * rows);
+    }
+
+    // Elapsed time (render, readback & conversion of the last band)
+    gettimeofday(&end, NULL);
+    stopPerfPhase(&phase);
+    printf("\t\t\tDone!\n");
+
+    uint64_t elapsedTime = (end.tv_sec - start.tv_sec) * 1000000ull + (end.tv_usec - start.tv_usec);
+    printf("Raytracing_OpenCL elapsed time: %lu us (work-group %ux%u, %u bands, readback & conversion overlapped)\n", elapsedTime, openCL->launch.localSize[0], openCL->launch.localSize[1], numberOfBands);
+    reportPerfPhase("trace, readback, gamma & quantize OpenCL", &phase, width * height);
+
+    // PNG encoding needs the whole image (stb_image_write has no streaming encoder)
+    gettimeofday(&start, NULL);
+    startPerfPhase(&phase);
+    stbi_write_png(filename, width, height, CHANNEL_NUM, image_u8, width * CHANNEL_NUM);
+    stopPerfPhase(&phase);
+    gettimeofday(&end, NULL);
+    elapsedTime = (end.tv_sec - start.tv_sec) * 1000000ull + (end.tv_usec - start.tv_usec);
+    printf("PNG encoding elapsed time: %lu us\n", elapsedTime);
+    reportPerfPhase("encode", &phase, width * height);
+
+    free(readEvents);
+    trackedFree(image_u8);
+    for (bufferIdx = 0; bufferIdx < BAND_BUFFERS; bufferIdx++)
+        releaseBuffer_openCL(bandMemObj[bufferIdx]);
+    return image;
+}
+
+uint64_t fullFrameMemory(const uint16_t width, const uint16_t height)
+{
+    const uint64_t numberOfPixels = (uint64_t)width * height;
+    return numberOfPixels * (2 * sizeof(color_t) + sizeof(color_u8_t));
+}
+
+uint16_t memoryBudgetBandRows(const uint16_t width, const uint16_t height, const uint64_t memoryBudget)
+{
+    if (fullFrameMemory(width, height) <= memoryBudget)
+        return 0;
+
+    // One 8 bits row (PNG stream) & the band buffers of both sides
+    const uint64_t rowMemory = 2 * BAND_BUFFERS * (uint64_t)width * sizeof(color_t);
+    const uint64_t streamMemory = 1 + (uint64_t)width * sizeof(color_u8_t);
+    if (memoryBudget < streamMemory + rowMemory)
+    {
+        printf("WARNING::MEM_BUDGET_TOO_SMALL: %lu bytes for one row per band\n", streamMemory + rowMemory);
+        return 1;
+    }
+    const uint64_t bandRows = (memoryBudget - streamMemory) / rowMemory;
+    return bandRows < height ? bandRows : height;
+}
+
+void raytracingStreamed_openCL(openCL_t *openCL, const char *filename, const uint16_t width, const uint16_t height, const uint16_t bandRows, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t *spheres, const uint16_t numberOfSpheres, const camera_t *camera, const options_t *options)
+{
+    cl_int ret;
+
+    if (openCL->isHalfImage)
+    {
+        printf("WARNING::BANDS_WITHOUT_HALF_IMAGE: bands are rendered in float\n");
+        openCL->isHalfImage = 0;
+    }
+    uploadScene_openCL(openCL, spheres, numberOfSpheres, camera);
+    if (options->kernel == KERNEL_WAVEFRONT || options->kernel == KERNEL_PERSISTENT)
+        printf("WARNING::BANDS_MEGAKERNEL_ONLY: rendering the bands with the megakernel\n");
+
+    // Bands of whole work-group rows, within the budget rows when possible
+    const uint16_t groupRows = openCL->launch.localSize[1];
+    const uint16_t rows = (bandRows > groupRows) ? bandRows / groupRows * groupRows : groupRows;
+    if (rows > bandRows)
+        printf("WARNING::MEM_BUDGET_BELOW_GROUP_ROWS: %u rows per band allowed, %u rows of one work-group used\n", bandRows, rows);
+    const uint16_t numberOfBands = (height + rows - 1) / rows;
+    const size_t bandSize = (size_t)width * rows * sizeof(color_t);
+
+    cl_mem bandMemObj[BAND_BUFFERS];
+    color_t* hostBands[BAND_BUFFERS];
+    uint8_t bufferIdx;
+    for (bufferIdx = 0; bufferIdx < BAND_BUFFERS; bufferIdx++)
+    {
+        bandMemObj[bufferIdx] = createBuffer_openCL(openCL->context, CL_MEM_READ_WRITE, bandSize, NULL, &ret);
+        if (ret != CL_SUCCESS)
+        {
+            printf("ERROR::OPENCL_BAND_BUFFER: %d (%lu bytes)\n", ret, bandSize);
+            exit(EXIT_FAILURE);
+        }
+        hostBands[bufferIdx] = trackedMalloc(bandSize);
+    }
+    cl_event* readEvents = calloc(numberOfBands, sizeof(cl_event));
+    const uint16_t sppChunk = samplesPerLaunch_openCL(openCL, raysPerPixel, options);
+    pngStream_t stream;
+    openPngStream(&stream, filename, width, height);
+
+    struct timeval start, end;
+    perfPhase_t phase;
+    printf("Trace rays (%u streamed bands of %u rows)!", numberOfBands, rows);
+    fflush(stdout);
+    gettimeofday(&start, NULL);
+    startPerfPhase(&phase);
+
+    // Band order k (top band first): band k renders into buffer k % BAND_BUFFERS once band k - BAND_BUFFERS has been read
+    // back from it, and is read back into host buffer k % BAND_BUFFERS, already streamed out while band k - 1 rendered
+    uint16_t orderIdx;
+    for (orderIdx = 0; orderIdx <= numberOfBands; orderIdx++)
+    {
+        if (orderIdx < numberOfBands)
+        {
+            const uint16_t firstRow = (numberOfBands - 1 - orderIdx) * rows;
+            const uint16_t bandRowsLeft = (height - firstRow < rows) ? height - firstRow : rows;
+            cl_mem bandMem = bandMemObj[orderIdx % BAND_BUFFERS];
+
+            cl_event renderEvent = NULL;
+            uint32_t sampleOffset;
+            for (sampleOffset = 0; sampleOffset < raysPerPixel; sampleOffset += sppChunk)
+            {
+                const uint16_t samples = (raysPerPixel - sampleOffset < sppChunk) ? raysPerPixel - sampleOffset : sppChunk;
+                const cl_event* waitEvent = (orderIdx >= BAND_BUFFERS && sampleOffset == 0) ? &readEvents[orderIdx - BAND_BUFFERS] : NULL;
+                if (renderEvent)
+                    clReleaseEvent(renderEvent);
+                ret = enqueueRaytracingRows_openCL(openCL, bandMem, width, firstRow, bandRowsLeft, samples, raysDepth, numberOfSpheres, sampleOffset, waitEvent, &renderEvent);
+                if (ret != CL_SUCCESS)
+                {
+                    printf("\nERROR::OPENCL_ENQUEUE_KERNEL: %d (band %u, work-group %ux%u)\n", ret, orderIdx, openCL->launch.localSize[0], openCL->launch.localSize[1]);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            clFlush(openCL->commandQueue);
+
+            ret = clEnqueueReadBuffer(openCL->transferQueue, bandMem, CL_FALSE, 0, (size_t)width * bandRowsLeft * sizeof(color_t), hostBands[orderIdx % BAND_BUFFERS], 1, &renderEvent, &readEvents[orderIdx]);
+            clReleaseEvent(renderEvent);
+            if (ret != CL_SUCCESS)
+            {
+                printf("\nERROR::OPENCL_IMAGE_TRANSFERT: %d (band %u)\n", ret, orderIdx);
+                exit(EXIT_FAILURE);
+            }
+            clFlush(openCL->transferQueue);
+        }
+
+        // Previous band: gamma, 8 bits & PNG rows while this one renders
+        if (orderIdx > 0)
+        {
+            const uint16_t previousIdx = orderIdx - 1;
+            const uint16_t firstRow = (numberOfBands - 1 - previousIdx) * rows;
+            clWaitForEvents(1, &readEvents[previousIdx]);
+            writePngStreamRows(&stream, hostBands[previousIdx % BAND_BUFFERS], (height - firstRow < rows) ? height - firstRow : rows);
+        }
+    }
+    closePngStream(&stream);
+
+    gettimeofday(&end, NULL);
+    stopPerfPhase(&phase);
+    printf("\t\t\tDone!\n");
+
+    const uint64_t elapsedTime = (end.tv_sec - start.tv_sec) * 1000000ull + (end.tv_usec - start.tv_usec);
+    printf("Raytracing_OpenCL elapsed time: %lu us (work-group %ux%u, %u bands streamed to %s)\n", elapsedTime, openCL->launch.localSize[0], openCL->launch.localSize[1], numberOfBands, filename);
+    reportPerfPhase("trace, readback & stream OpenCL", &phase, width * height);
+
+    // Kept until the end: the renders BAND_BUFFERS bands later wait for them
+    for (orderIdx = 0; orderIdx < numberOfBands; orderIdx++)
+        clReleaseEvent(readEvents[orderIdx]);
+    free(readEvents);
+    for (bufferIdx = 0; bufferIdx < BAND_BUFFERS; bufferIdx++)
+    {
+        releaseBuffer_openCL(bandMemObj[bufferIdx]);
+        trackedFree(hostBands[bufferIdx]);
+    }
+}
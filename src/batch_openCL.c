@@ -0,0 +1,185 @@
+#include "batch_openCL.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "utils.h"
+
+// --thumbnails: cameras on a circle around the scene, at the distance of the default camera
+#define THUMBNAIL_CAMERA_DISTANCE 13.3f
+#define THUMBNAIL_CAMERA_HEIGHT 2.0f
+
+void raytracingBatch_openCL(openCL_t *openCL, batchImage_t *images, const uint32_t numberOfImages, const uint16_t raysPerPixel, const uint8_t raysDepth)
+{
+    cl_int ret;
+    if (!openCL->batchKernel)
+    {
+        printf("ERROR::OPENCL_NO_BATCH_KERNEL: only kernel/raytracing_gpu.cl has a batch kernel\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // The packed spheres of all the images stay in __global memory
+    if (openCL->sphereMemory == SPHERE_MEMORY_CONSTANT)
+    {
+        openCL->sphereMemory = SPHERE_MEMORY_GLOBAL;
+        if (buildProgram_openCL(openCL, openCL->launch.buildOptions) != CL_SUCCESS)
+            exit(EXIT_FAILURE);
+    }
+
+    // Offset table, packed cameras & spheres
+    batchEntry_t* entries = malloc(numberOfImages * sizeof(batchEntry_t));
+    camera_t* cameras = malloc(numberOfImages * sizeof(camera_t));
+    uint32_t numberOfPixels = 0, numberOfSpheres = 0;
+    uint32_t imageIdx;
+    for (imageIdx = 0; imageIdx < numberOfImages; imageIdx++)
+    {
+        const batchImage_t* image = &images[imageIdx];
+        entries[imageIdx] = (batchEntry_t){ numberOfPixels, numberOfSpheres, image->width, image->height, image->numberOfSpheres, 0 };
+        cameras[imageIdx] = *image->camera;
+        numberOfPixels += image->width * image->height;
+        numberOfSpheres += image->numberOfSpheres;
+    }
+    sphere_t* spheres = malloc(numberOfSpheres * sizeof(sphere_t));
+    for (imageIdx = 0; imageIdx < numberOfImages; imageIdx++)
+        memcpy(spheres + entries[imageIdx].sphereOffset, images[imageIdx].spheres, images[imageIdx].numberOfSpheres * sizeof(sphere_t));
+
+    // Memory buffers for each array (in-order queue: the writes are done before the launch)
+    cl_int bufferRet[4];
+    cl_mem entryMemObj = createBuffer_openCL(openCL->context, CL_MEM_READ_ONLY, numberOfImages * sizeof(batchEntry_t), NULL, &bufferRet[0]);
+    cl_mem cameraMemObj = createBuffer_openCL(openCL->context, CL_MEM_READ_ONLY, numberOfImages * sizeof(camera_t), NULL, &bufferRet[1]);
+    cl_mem sphereMemObj = createBuffer_openCL(openCL->context, CL_MEM_READ_ONLY, numberOfSpheres * sizeof(sphere_t), NULL, &bufferRet[2]);
+    cl_mem imageMemObj = createBuffer_openCL(openCL->context, CL_MEM_WRITE_ONLY, numberOfPixels * sizeof(color_t), NULL, &bufferRet[3]);
+    // First failed allocation
+    uint8_t bufferIdx;
+    ret = CL_SUCCESS;
+    for (bufferIdx = 0; bufferIdx < sizeof(bufferRet) / sizeof(bufferRet[0]) && ret == CL_SUCCESS; bufferIdx++)
+        ret = bufferRet[bufferIdx];
+    if (ret != CL_SUCCESS)
+    {
+        printf("ERROR::OPENCL_BATCH_BUFFERS: %d (%u images, %u pixels)\n", ret, numberOfImages, numberOfPixels);
+        exit(EXIT_FAILURE);
+    }
+    clEnqueueWriteBuffer(openCL->commandQueue, entryMemObj, CL_FALSE, 0, numberOfImages * sizeof(batchEntry_t), entries, 0, NULL, NULL);
+    clEnqueueWriteBuffer(openCL->commandQueue, cameraMemObj, CL_FALSE, 0, numberOfImages * sizeof(camera_t), cameras, 0, NULL, NULL);
+    clEnqueueWriteBuffer(openCL->commandQueue, sphereMemObj, CL_FALSE, 0, numberOfSpheres * sizeof(sphere_t), spheres, 0, NULL, NULL);
+
+    // Set arguments for kernel
+    cl_kernel kernel = openCL->batchKernel;
+    clSetKernelArg(kernel, 0, sizeof(cl_mem), (void *)&imageMemObj);
+    clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *)&sphereMemObj);
+    clSetKernelArg(kernel, 2, sizeof(cl_mem), (void *)&cameraMemObj);
+    clSetKernelArg(kernel, 3, sizeof(cl_mem), (void *)&entryMemObj);
+    clSetKernelArg(kernel, 4, sizeof(numberOfImages), (void *)&numberOfImages);
+    clSetKernelArg(kernel, 5, sizeof(numberOfPixels), (void *)&numberOfPixels);
+    clSetKernelArg(kernel, 6, sizeof(raysPerPixel), (void *)&raysPerPixel);
+    clSetKernelArg(kernel, 7, sizeof(raysDepth), (void *)&raysDepth);
+
+    // Execute the kernel: one work-item per pixel of the batch (1D work-groups of the tuned size)
+    size_t localItemSize = openCL->launch.localSize[0] * openCL->launch.localSize[1];
+    size_t globalItemSize = (numberOfPixels + localItemSize - 1) / localItemSize * localItemSize;
+    ret = clEnqueueNDRangeKernel(openCL->commandQueue, kernel, 1, NULL, &globalItemSize, &localItemSize, 0, NULL, NULL);
+    if (ret != CL_SUCCESS)
+    {
+        printf("ERROR::OPENCL_ENQUEUE_KERNEL: %d (batch of %u images)\n", ret, numberOfImages);
+        exit(EXIT_FAILURE);
+    }
+
+    // Read every image back to its own output
+    for (imageIdx = 0; imageIdx < numberOfImages; imageIdx++)
+        clEnqueueReadBuffer(openCL->commandQueue, imageMemObj, CL_FALSE, entries[imageIdx].pixelOffset * sizeof(color_t),
+                            images[imageIdx].width * images[imageIdx].height * sizeof(color_t), images[imageIdx].image, 0, NULL, NULL);
+    ret = clFinish(openCL->commandQueue);
+    if (ret != CL_SUCCESS)
+    {
+        printf("ERROR::OPENCL_IMAGE_TRANSFERT: %d (batch of %u images)\n", ret, numberOfImages);
+        exit(EXIT_FAILURE);
+    }
+
+    releaseBuffer_openCL(entryMemObj);
+    releaseBuffer_openCL(cameraMemObj);
+    releaseBuffer_openCL(sphereMemObj);
+    releaseBuffer_openCL(imageMemObj);
+    free(entries);
+    free(cameras);
+    free(spheres);
+}
+
+int thumbnails_openCL(const uint32_t numberOfImages, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint8_t sqrtNumberOfSpheres, const options_t *options)
+{
+    // Scenes & cameras
+    srand(options->seed);
+    const uint16_t NUMBER_OF_SPHERES = sqrtNumberOfSpheres * sqrtNumberOfSpheres + 4;
+    sphere_t* spheres = malloc(numberOfImages * NUMBER_OF_SPHERES * sizeof(sphere_t));
+    camera_t* cameras = malloc(numberOfImages * sizeof(camera_t));
+    uint32_t imageIdx;
+    for (imageIdx = 0; imageIdx < numberOfImages; imageIdx++)
+    {
+        const float angle = 2.0f * M_PI * imageIdx / numberOfImages;
+        initializeSpheres(spheres + imageIdx * NUMBER_OF_SPHERES, sqrtNumberOfSpheres);
+        cameras[imageIdx] = initializeCameraFrom(width, height, (vec3_t){ THUMBNAIL_CAMERA_DISTANCE * cosf(angle), THUMBNAIL_CAMERA_HEIGHT, THUMBNAIL_CAMERA_DISTANCE * sinf(angle) });
+    }
+
+    // Outputs of one batch: image k is rendered to slot k % THUMBNAILS_PER_BATCH by both methods, so that the slots hold
+    // the same images at the end
+    const uint32_t imagesPerBatch = numberOfImages < THUMBNAILS_PER_BATCH ? numberOfImages : THUMBNAILS_PER_BATCH;
+    const uint32_t imageSize = width * height;
+    color_t* imagesPerCall = malloc(imagesPerBatch * imageSize * sizeof(color_t));
+    color_t* imagesBatched = malloc(imagesPerBatch * imageSize * sizeof(color_t));
+    batchImage_t* batch = malloc(numberOfImages * sizeof(batchImage_t));
+    for (imageIdx = 0; imageIdx < numberOfImages; imageIdx++)
+        batch[imageIdx] = (batchImage_t){ imagesBatched + (imageIdx % imagesPerBatch) * imageSize, width, height, &cameras[imageIdx], spheres + imageIdx * NUMBER_OF_SPHERES, NUMBER_OF_SPHERES };
+
+    openCL_t openCL;
+    initializeOpenCL(&openCL, options);
+    if (openCL.isHalfImage)
+    {
+        printf("WARNING::THUMBNAILS_WITHOUT_HALF_IMAGE: thumbnails are rendered in float\n");
+        openCL.isHalfImage = 0;
+    }
+    printf("Thumbnails: %u images %ux%u, %u rays per pixel, depth %u, %u spheres each\n", numberOfImages, width, height, raysPerPixel, raysDepth, NUMBER_OF_SPHERES);
+
+    // 1. One call per image: output & scene setup, launch, blocking readback (the steps of raytracing_openCL)
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    for (imageIdx = 0; imageIdx < numberOfImages; imageIdx++)
+    {
+        createImage_openCL(&openCL, NULL, width, height, ZERO_COPY_NONE);
+        uploadScene_openCL(&openCL, spheres + imageIdx * NUMBER_OF_SPHERES, NUMBER_OF_SPHERES, &cameras[imageIdx]);
+        if (enqueueRaytracing_openCL(&openCL, width, height, raysPerPixel, raysDepth, NUMBER_OF_SPHERES, 0, NULL) != CL_SUCCESS)
+        {
+            printf("ERROR::OPENCL_ENQUEUE_KERNEL (image %u)\n", imageIdx);
+            exit(EXIT_FAILURE);
+        }
+        clEnqueueReadBuffer(openCL.commandQueue, openCL.imageMemObj, CL_TRUE, 0, imageSize * sizeof(color_t), imagesPerCall + (imageIdx % imagesPerBatch) * imageSize, 0, NULL, NULL);
+    }
+    gettimeofday(&end, NULL);
+    const uint64_t perCallTime = (end.tv_sec - start.tv_sec) * 1000000ull + (end.tv_usec - start.tv_usec);
+    printf("One call per image: %lu us, %f images/s\n", perCallTime, numberOfImages * 1e6 / perCallTime);
+
+    // 2. Batches of THUMBNAILS_PER_BATCH images per NDRange
+    gettimeofday(&start, NULL);
+    for (imageIdx = 0; imageIdx < numberOfImages; imageIdx += imagesPerBatch)
+    {
+        const uint32_t images = (numberOfImages - imageIdx < imagesPerBatch) ? numberOfImages - imageIdx : imagesPerBatch;
+        raytracingBatch_openCL(&openCL, batch + imageIdx, images, raysPerPixel, raysDepth);
+    }
+    gettimeofday(&end, NULL);
+    const uint64_t batchedTime = (end.tv_sec - start.tv_sec) * 1000000ull + (end.tv_usec - start.tv_usec);
+    printf("Batched (%u images per launch): %lu us, %f images/s, speed-up %.2fx\n", imagesPerBatch, batchedTime, numberOfImages * 1e6 / batchedTime, (double)perCallTime / batchedTime);
+
+    // Same pixels & seeds: only the closest hit search (BVH, sphere memory) may differ
+    float maxError;
+    const float rmse = imageRMSE(imagesBatched, imagesPerCall, imagesPerBatch * imageSize, &maxError);
+    printf("Batched vs. one call per image: RMSE %e, max error %e\n", rmse, maxError);
+
+    releaseOpenCL(&openCL);
+    free(batch);
+    free(imagesBatched);
+    free(imagesPerCall);
+    free(cameras);
+    free(spheres);
+    return EXIT_SUCCESS;
+}
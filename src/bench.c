@@ -0,0 +1,310 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "raytracing_openCL.h"
+#include "wavefront_openCL.h"
+#include "raytracing.h"
+#include "camera.h"
+#include "sphere.h"
+#include "utils.h"
+#include "perf_counters.h"
+
+// Parameter grid of timing.sh (16:9 images)
+static const uint8_t SQRT_NUMBERS_OF_SPHERES[] = { 2, 6, 11 };
+static const uint16_t RAYS_PER_PIXEL[] = { 1, 10, 50, 100 };
+static const uint8_t RAYS_DEPTHS[] = { 5, 15, 50 };
+static const uint16_t WIDTHS[] = { 256, 640, 848, 1280, 1920, 2560, 3840, 7680 };
+
+#define GRID_SIZE(grid) (sizeof(grid) / sizeof(grid[0]))
+
+typedef struct benchTimes_t
+{
+    uint64_t low;       // BENCH_LOW_PERCENTILE (us)
+    uint64_t median;
+    uint64_t high;      // BENCH_HIGH_PERCENTILE
+} benchTimes_t;
+
+static int compareU64(const void* a, const void* b)
+{
+    const uint64_t x = *(const uint64_t*)a;
+    const uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static benchTimes_t percentiles(uint64_t* times, const uint16_t numberOfTimes)
+{
+    qsort(times, numberOfTimes, sizeof(uint64_t), compareU64);
+    benchTimes_t result;
+    result.low = times[(numberOfTimes - 1) * BENCH_LOW_PERCENTILE / 100];
+    result.median = times[(numberOfTimes - 1) / 2];
+    result.high = times[((numberOfTimes - 1) * BENCH_HIGH_PERCENTILE + 99) / 100];
+    return result;
+}
+
+// All the launches of one OpenCL render, without the readback
+static cl_int renderOpenCL(openCL_t* openCL, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint16_t numberOfSpheres, const uint16_t sppChunk, const options_t* options)
+{
+    cl_int ret = CL_SUCCESS;
+    uint32_t sampleOffset;
+    for (sampleOffset = 0; sampleOffset < raysPerPixel && ret == CL_SUCCESS; sampleOffset += sppChunk)
+    {
+        const uint16_t samples = (raysPerPixel - sampleOffset < sppChunk) ? raysPerPixel - sampleOffset : sppChunk;
+        if (options->kernel == KERNEL_WAVEFRONT)
+            ret = enqueueWavefront_openCL(openCL, width, height, samples, raysDepth, numberOfSpheres, sampleOffset, NULL);
+        else if (options->kernel == KERNEL_PERSISTENT)
+            ret = enqueuePersistent_openCL(openCL, width, height, samples, raysDepth, numberOfSpheres, sampleOffset, options->batchSize, NULL);
+        else
+            ret = enqueueRaytracing_openCL(openCL, width, height, samples, raysDepth, numberOfSpheres, sampleOffset, NULL);
+        clFlush(openCL->commandQueue);
+    }
+    clFinish(openCL->commandQueue);
+    return ret;
+}
+
+static void writeCpuRayCounters(FILE* file, const uint8_t sqrtNumberOfSpheres, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint32_t numberOfPixels, const char* thread, const cpuRayCounters_t* counters)
+{
+    uint8_t k;
+    fprintf(file, "%u;%u;%u;%u;%s;%lu;%lu;%lu;%lu;%lu", sqrtNumberOfSpheres, raysPerPixel, raysDepth, numberOfPixels, thread,
+            counters->samples, counters->rays, counters->sphereTests, counters->skyHits, counters->truncated);
+    for (k = 0; k < NUMBER_OF_MATERIAL; k++)
+        fprintf(file, ";%lu", counters->materialHits[k]);
+    for (k = 0; k < CPU_RAY_STATS_DEPTH_BINS; k++)
+        fprintf(file, ";%lu", counters->depth[k]);
+    fprintf(file, "\n");
+}
+
+static void writeSamples(FILE* file, const uint8_t sqrtNumberOfSpheres, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint32_t numberOfPixels, const char* phase, const uint64_t* times, const uint16_t numberOfTimes)
+{
+    uint16_t runIdx;
+    for (runIdx = 0; runIdx < numberOfTimes; runIdx++)
+        fprintf(file, "%u;%u;%u;%u;%s;%u;%lu\n", sqrtNumberOfSpheres, raysPerPixel, raysDepth, numberOfPixels, phase, runIdx, times[runIdx]);
+}
+
+// Closest hit searches per camera ray of the scene & depth (untimed renders of BENCH_RAYS_WIDTH): counted by the
+// megakernel built with -DRAY_STATS (1 without device counters), and by the CPU counters (other random streams)
+static void raysPerSample(openCL_t* statsOpenCL, cpuRayStats_t* cpuStats, color_t* image, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const options_t* statsOptions, double* openCLRays, double* cpuRays)
+{
+    const uint16_t width = BENCH_RAYS_WIDTH;
+    const uint16_t height = BENCH_RAYS_WIDTH * 9 / 16;
+    const camera_t camera = initializeCamera(width, height);
+
+    *openCLRays = 1.0;
+    if (statsOpenCL->isRayStats)
+    {
+        uploadScene_openCL(statsOpenCL, spheres, numberOfSpheres, &camera);
+        createImage_openCL(statsOpenCL, NULL, width, height, ZERO_COPY_NONE);
+        resetRayStats_openCL(statsOpenCL);
+        renderOpenCL(statsOpenCL, width, height, BENCH_RAYS_SPP, raysDepth, numberOfSpheres, samplesPerLaunch_openCL(statsOpenCL, BENCH_RAYS_SPP, statsOptions), statsOptions);
+
+        uint64_t counters[RAY_STATS_COUNTERS];
+        readRayStats_openCL(statsOpenCL, counters);
+        if (counters[RAY_STATS_SAMPLES])
+            *openCLRays = (double)counters[RAY_STATS_RAYS] / counters[RAY_STATS_SAMPLES];
+    }
+
+    resetCpuRayStats(cpuStats);
+    raytracing(image, width, height, BENCH_RAYS_SPP, raysDepth, spheres, numberOfSpheres, &camera, cpuStats);
+    *cpuRays = cpuStats->total.samples ? (double)cpuStats->total.rays / cpuStats->total.samples : 1.0;
+}
+
+int bench(const options_t *options)
+{
+    const uint32_t seed = options->isSeedSet ? options->seed : BENCH_SEED;
+    const uint16_t numberOfRuns = options->warmups + options->repetitions;
+
+    // One OpenCL program for the whole grid, plus a counting one for the rays per sample (its renders are not timed)
+    openCL_t openCL;
+    initializeOpenCL(&openCL, options);
+    options_t statsOptions = *options;
+    statsOptions.kernel = KERNEL_MEGAKERNEL;
+    statsOptions.isRayStats = 1;
+    openCL_t statsOpenCL;
+    initializeOpenCL(&statsOpenCL, &statsOptions);
+
+    FILE* resultFile = fopen(BENCH_RESULT_PATH, "w");
+    if (!resultFile)
+    {
+        printf("ERROR::CANNOT_WRITE_BENCH_RESULT: %s\n", BENCH_RESULT_PATH);
+        return EXIT_FAILURE;
+    }
+    fprintf(resultFile, "sqrt_spheres;rays_per_pixel;rays_depth;resolution;time_opencl;cpp_opencl;time_data_transfert;cpp_data_transfert;time_cpu;cpp_cpu;"
+                        "time_opencl_p%u;time_opencl_p%u;time_data_transfert_p%u;time_data_transfert_p%u;time_cpu_p%u;time_cpu_p%u;"
+                        "rays_per_sample;mrays_per_s_opencl;msamples_per_s_opencl;mrays_per_s_cpu;msamples_per_s_cpu;rays_per_sample_cpu\n",
+            BENCH_LOW_PERCENTILE, BENCH_HIGH_PERCENTILE, BENCH_LOW_PERCENTILE, BENCH_HIGH_PERCENTILE, BENCH_LOW_PERCENTILE, BENCH_HIGH_PERCENTILE);
+
+    FILE* samplesFile = fopen(BENCH_SAMPLES_PATH, "w");
+    if (!samplesFile)
+    {
+        printf("ERROR::CANNOT_WRITE_BENCH_RESULT: %s\n", BENCH_SAMPLES_PATH);
+        fclose(resultFile);
+        return EXIT_FAILURE;
+    }
+    fprintf(samplesFile, "sqrt_spheres;rays_per_pixel;rays_depth;resolution;phase;run;time\n");
+
+    FILE* cpuStatsFile = NULL;
+    cpuRayStats_t* cpuRayStats = NULL;
+    if (options->isRayStats)
+    {
+        cpuStatsFile = fopen(BENCH_CPU_STATS_PATH, "w");
+        if (!cpuStatsFile)
+        {
+            printf("ERROR::CANNOT_WRITE_BENCH_RESULT: %s\n", BENCH_CPU_STATS_PATH);
+            fclose(samplesFile);
+            fclose(resultFile);
+            return EXIT_FAILURE;
+        }
+        fprintf(cpuStatsFile, "sqrt_spheres;rays_per_pixel;rays_depth;resolution;thread;samples;rays;sphere_tests;sky_hits;truncated;lambertian_hits;metal_hits;dielectric_hits");
+        uint8_t k;
+        for (k = 0; k < CPU_RAY_STATS_DEPTH_BINS; k++)
+            fprintf(cpuStatsFile, ";depth_%u%s", k, k == CPU_RAY_STATS_DEPTH_BINS - 1 ? "_plus" : "");
+        fprintf(cpuStatsFile, "\n");
+        cpuRayStats = malloc(sizeof(cpuRayStats_t));
+    }
+
+    printf("Bench %s (%s): %u warm-up & %u timed runs per point, seed %u, results in %s, %s%s%s\n", openCL.deviceName, openCL.driverVersion, options->warmups, options->repetitions, seed, BENCH_RESULT_PATH, BENCH_SAMPLES_PATH,
+           cpuStatsFile ? " & " : "", cpuStatsFile ? BENCH_CPU_STATS_PATH : "");
+
+    // Largest image of the grid, shared by the readbacks & the CPU renders
+    const uint16_t maxWidth = WIDTHS[GRID_SIZE(WIDTHS) - 1];
+    color_t* image = malloc((size_t)maxWidth * (maxWidth * 9 / 16) * sizeof(color_t));
+    uint64_t* openCLTimes = malloc(numberOfRuns * sizeof(uint64_t));
+    uint64_t* transferTimes = malloc(numberOfRuns * sizeof(uint64_t));
+    uint64_t* cpuTimes = malloc(numberOfRuns * sizeof(uint64_t));
+    uint64_t* openCLCycles = malloc(numberOfRuns * sizeof(uint64_t));
+    uint64_t* transferCycles = malloc(numberOfRuns * sizeof(uint64_t));
+    uint64_t* cpuCycles = malloc(numberOfRuns * sizeof(uint64_t));
+    cpuRayStats_t* cpuCountStats = malloc(sizeof(cpuRayStats_t));
+
+    uint16_t sphereIdx, rppIdx, depthIdx, widthIdx, runIdx;
+    for (sphereIdx = 0; sphereIdx < GRID_SIZE(SQRT_NUMBERS_OF_SPHERES); sphereIdx++)
+    {
+        // Same scene whatever the order of the grid
+        const uint8_t sqrtNumberOfSpheres = SQRT_NUMBERS_OF_SPHERES[sphereIdx];
+        const uint16_t numberOfSpheres = sqrtNumberOfSpheres * sqrtNumberOfSpheres + 4;
+        sphere_t* spheres = malloc(numberOfSpheres * sizeof(sphere_t));
+        srand(seed);
+        initializeSpheres(spheres, sqrtNumberOfSpheres);
+
+        // Rays per sample of each depth, counted by the first point of the depth (0: not counted yet)
+        double openCLRaysPerSample[GRID_SIZE(RAYS_DEPTHS)] = { 0.0 };
+        double cpuRaysPerSample[GRID_SIZE(RAYS_DEPTHS)] = { 0.0 };
+
+        for (rppIdx = 0; rppIdx < GRID_SIZE(RAYS_PER_PIXEL); rppIdx++)
+            for (depthIdx = 0; depthIdx < GRID_SIZE(RAYS_DEPTHS); depthIdx++)
+                for (widthIdx = 0; widthIdx < GRID_SIZE(WIDTHS); widthIdx++)
+                {
+                    const uint16_t raysPerPixel = RAYS_PER_PIXEL[rppIdx];
+                    const uint8_t raysDepth = RAYS_DEPTHS[depthIdx];
+                    const uint16_t width = WIDTHS[widthIdx];
+                    const uint16_t height = width * 9 / 16;
+                    const uint32_t numberOfPixels = width * height;
+                    const camera_t camera = initializeCamera(width, height);
+
+                    // OpenCL: render, then blocking readback
+                    uploadScene_openCL(&openCL, spheres, numberOfSpheres, &camera);
+                    createImage_openCL(&openCL, NULL, width, height, ZERO_COPY_NONE);
+                    const uint16_t sppChunk = samplesPerLaunch_openCL(&openCL, raysPerPixel, options);
+                    for (runIdx = 0; runIdx < numberOfRuns; runIdx++)
+                    {
+                        perfPhase_t render, transfer;
+                        startPerfPhase(&render);
+                        cl_int ret = renderOpenCL(&openCL, width, height, raysPerPixel, raysDepth, numberOfSpheres, sppChunk, options);
+                        stopPerfPhase(&render);
+                        startPerfPhase(&transfer);
+                        if (ret == CL_SUCCESS)
+                            ret = clEnqueueReadBuffer(openCL.commandQueue, openCL.imageMemObj, CL_TRUE, 0, openCL.imageSize, image, 0, NULL, NULL);
+                        stopPerfPhase(&transfer);
+                        if (ret != CL_SUCCESS)
+                        {
+                            printf("ERROR::OPENCL_BENCH: %d (%ux%u, %u spp, depth %u)\n", ret, width, height, raysPerPixel, raysDepth);
+                            exit(EXIT_FAILURE);
+                        }
+                        if (runIdx < options->warmups)
+                            continue;
+                        openCLTimes[runIdx - options->warmups] = render.time;
+                        transferTimes[runIdx - options->warmups] = transfer.time;
+                        openCLCycles[runIdx - options->warmups] = render.counts[PERF_CYCLES];
+                        transferCycles[runIdx - options->warmups] = transfer.counts[PERF_CYCLES];
+                    }
+
+                    // CPU, counted on its first render with --stats
+                    if (cpuRayStats)
+                        resetCpuRayStats(cpuRayStats);
+                    for (runIdx = 0; runIdx < numberOfRuns; runIdx++)
+                    {
+                        perfPhase_t render;
+                        startPerfPhase(&render);
+                        raytracing(image, width, height, raysPerPixel, raysDepth, spheres, numberOfSpheres, &camera, runIdx == 0 ? cpuRayStats : NULL);
+                        stopPerfPhase(&render);
+                        if (runIdx < options->warmups)
+                            continue;
+                        cpuTimes[runIdx - options->warmups] = render.time;
+                        cpuCycles[runIdx - options->warmups] = render.counts[PERF_CYCLES];
+                    }
+
+                    // Run order, before the percentiles sort the times
+                    writeSamples(samplesFile, sqrtNumberOfSpheres, raysPerPixel, raysDepth, numberOfPixels, "opencl", openCLTimes, options->repetitions);
+                    writeSamples(samplesFile, sqrtNumberOfSpheres, raysPerPixel, raysDepth, numberOfPixels, "data_transfert", transferTimes, options->repetitions);
+                    writeSamples(samplesFile, sqrtNumberOfSpheres, raysPerPixel, raysDepth, numberOfPixels, "cpu", cpuTimes, options->repetitions);
+                    fflush(samplesFile);
+
+                    const benchTimes_t openCLTime = percentiles(openCLTimes, options->repetitions);
+                    const benchTimes_t transferTime = percentiles(transferTimes, options->repetitions);
+                    const benchTimes_t cpuTime = percentiles(cpuTimes, options->repetitions);
+
+                    // Measured cycles per pixel (median run), NaN without hardware counters
+                    const double cyclesPerPixel[3] = {
+                        isPerfEventAvailable(PERF_CYCLES) ? (double)percentiles(openCLCycles, options->repetitions).median / numberOfPixels : NAN,
+                        isPerfEventAvailable(PERF_CYCLES) ? (double)percentiles(transferCycles, options->repetitions).median / numberOfPixels : NAN,
+                        isPerfEventAvailable(PERF_CYCLES) ? (double)percentiles(cpuCycles, options->repetitions).median / numberOfPixels : NAN };
+                    if (!openCLRaysPerSample[depthIdx])
+                        raysPerSample(&statsOpenCL, cpuCountStats, image, raysDepth, spheres, numberOfSpheres, &statsOptions, &openCLRaysPerSample[depthIdx], &cpuRaysPerSample[depthIdx]);
+                    const double rays = openCLRaysPerSample[depthIdx];
+                    const double cpuRays = cpuRaysPerSample[depthIdx];
+
+                    // Samples & rays per us: millions per second
+                    const double samples = (double)numberOfPixels * raysPerPixel;
+                    fprintf(resultFile, "%u;%u;%u;%u;%lu;%f;%lu;%f;%lu;%f;%lu;%lu;%lu;%lu;%lu;%lu;%f;%f;%f;%f;%f;%f\n",
+                            sqrtNumberOfSpheres, raysPerPixel, raysDepth, numberOfPixels,
+                            openCLTime.median, cyclesPerPixel[0], transferTime.median, cyclesPerPixel[1], cpuTime.median, cyclesPerPixel[2],
+                            openCLTime.low, openCLTime.high, transferTime.low, transferTime.high, cpuTime.low, cpuTime.high,
+                            rays, samples * rays / openCLTime.median, samples / openCLTime.median, samples * cpuRays / cpuTime.median, samples / cpuTime.median, cpuRays);
+                    fflush(resultFile);
+                    if (cpuRayStats)
+                    {
+                        uint16_t thread;
+                        for (thread = 0; thread < cpuRayStats->numberOfThreads; thread++)
+                        {
+                            char threadName[8];
+                            snprintf(threadName, sizeof(threadName), "%u", thread);
+                            writeCpuRayCounters(cpuStatsFile, sqrtNumberOfSpheres, raysPerPixel, raysDepth, numberOfPixels, threadName, &cpuRayStats->threads[thread]);
+                        }
+                        writeCpuRayCounters(cpuStatsFile, sqrtNumberOfSpheres, raysPerPixel, raysDepth, numberOfPixels, "all", &cpuRayStats->total);
+                        fflush(cpuStatsFile);
+                    }
+                    printf("%u spheres, %u spp, depth %u, %ux%u: OpenCL %lu us (%.1f Mrays/s), transfer %lu us, CPU %lu us (%.1f Mrays/s)\n",
+                           numberOfSpheres, raysPerPixel, raysDepth, width, height, openCLTime.median, samples * rays / openCLTime.median,
+                           transferTime.median, cpuTime.median, samples * cpuRays / cpuTime.median);
+                }
+        free(spheres);
+    }
+
+    fclose(resultFile);
+    fclose(samplesFile);
+    if (cpuStatsFile)
+        fclose(cpuStatsFile);
+    free(cpuRayStats);
+    free(image);
+    free(openCLTimes);
+    free(transferTimes);
+    free(cpuTimes);
+    free(openCLCycles);
+    free(transferCycles);
+    free(cpuCycles);
+    free(cpuCountStats);
+    releaseOpenCL(&statsOpenCL);
+    releaseOpenCL(&openCL);
+    return EXIT_SUCCESS;
+}
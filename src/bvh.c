@@ -0,0 +1,87 @@
+#include "bvh.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+// Box padding: the slab test must never reject a ray the sphere test would accept (rounding errors)
+#define BVH_AABB_EPSILON 1e-4f
+
+static void sphereAABB(const sphere_t* sphere, vec3_t* aabbMin, vec3_t* aabbMax)
+{
+    const float r = sphere->radius * (1.0f + BVH_AABB_EPSILON) + BVH_AABB_EPSILON;
+    *aabbMin = (vec3_t){ sphere->position.x - r, sphere->position.y - r, sphere->position.z - r };
+    *aabbMax = (vec3_t){ sphere->position.x + r, sphere->position.y + r, sphere->position.z + r };
+}
+
+static float axisValue(const vec3_t* v, const uint8_t axis)
+{
+    return axis == 0 ? v->x : (axis == 1 ? v->y : v->z);
+}
+
+// qsort has no context argument: spheres & axis of the current sort
+static const sphere_t* sortedSpheres;
+static uint8_t sortAxis;
+
+static int compareSpheres(const void* a, const void* b)
+{
+    const float keyA = axisValue(&sortedSpheres[*(const uint16_t*)a].position, sortAxis);
+    const float keyB = axisValue(&sortedSpheres[*(const uint16_t*)b].position, sortAxis);
+    return (keyA > keyB) - (keyA < keyB);
+}
+
+// Builds the subtree of the spheres indices[0..count) at nodes[nodeIndex], returns the node after the subtree
+static uint32_t buildNode(bvhNode_t* nodes, uint32_t nodeIndex, uint16_t* indices, const uint16_t count, const sphere_t* spheres)
+{
+    bvhNode_t* node = &nodes[nodeIndex];
+    uint16_t k;
+
+    // Bounds of the spheres & of their centers
+    vec3_t centerMin = spheres[indices[0]].position, centerMax = spheres[indices[0]].position;
+    sphereAABB(&spheres[indices[0]], &node->aabbMin, &node->aabbMax);
+    for (k = 1; k < count; k++)
+    {
+        vec3_t aabbMin, aabbMax;
+        const vec3_t* center = &spheres[indices[k]].position;
+        sphereAABB(&spheres[indices[k]], &aabbMin, &aabbMax);
+        node->aabbMin = (vec3_t){ fminf(node->aabbMin.x, aabbMin.x), fminf(node->aabbMin.y, aabbMin.y), fminf(node->aabbMin.z, aabbMin.z) };
+        node->aabbMax = (vec3_t){ fmaxf(node->aabbMax.x, aabbMax.x), fmaxf(node->aabbMax.y, aabbMax.y), fmaxf(node->aabbMax.z, aabbMax.z) };
+        centerMin = (vec3_t){ fminf(centerMin.x, center->x), fminf(centerMin.y, center->y), fminf(centerMin.z, center->z) };
+        centerMax = (vec3_t){ fmaxf(centerMax.x, center->x), fmaxf(centerMax.y, center->y), fmaxf(centerMax.z, center->z) };
+    }
+
+    if (count == 1)
+    {
+        node->sphereIndex = indices[0];
+        node->escapeIndex = nodeIndex + 1;
+        return nodeIndex + 1;
+    }
+
+    // Median split along the largest extent of the centers
+    const vec3_t extent = vec3_sub(&centerMax, &centerMin);
+    const uint8_t axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+    sortedSpheres = spheres;
+    sortAxis = axis;
+    qsort(indices, count, sizeof(uint16_t), compareSpheres);
+
+    const uint16_t half = count / 2;
+    node->sphereIndex = -1;
+    uint32_t nextIndex = buildNode(nodes, nodeIndex + 1, indices, half, spheres);
+    nextIndex = buildNode(nodes, nextIndex, indices + half, count - half, spheres);
+    node->escapeIndex = nextIndex;
+    return nextIndex;
+}
+
+uint32_t buildBVH(bvhNode_t *nodes, const sphere_t *spheres, const uint16_t numberOfSpheres)
+{
+    if (!numberOfSpheres)
+        return 0;
+
+    uint16_t* indices = malloc(numberOfSpheres * sizeof(uint16_t));
+    uint16_t k;
+    for (k = 0; k < numberOfSpheres; k++)
+        indices[k] = k;
+
+    const uint32_t numberOfNodes = buildNode(nodes, 0, indices, numberOfSpheres, spheres);
+    free(indices);
+    return numberOfNodes;
+}
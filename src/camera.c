@@ -3,11 +3,16 @@
 #include "utils.h"
 
 camera_t initializeCamera(const uint16_t WITDH, const uint16_t HEIGHT)
+{
+    return initializeCameraFrom(WITDH, HEIGHT, (vec3_t){ 13.0f, 2.0f, 3.0f });
+}
+
+camera_t initializeCameraFrom(const uint16_t WITDH, const uint16_t HEIGHT, const vec3_t lookFrom)
 {
     camera_t camera;
 
     // Position & target
-    camera.lookFrom = (vec3_t){ 13.0f, 2.0f, 3.0f };
+    camera.lookFrom = lookFrom;
     camera.lookAt = (vec3_t){ 0.0f, 0.0f, 0.0f };
     camera.up = (vec3_t){ 0.0f, 1.0f, 0.0f };
     
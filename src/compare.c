@@ -0,0 +1,258 @@
+#include "compare.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+
+#define PHASE_NAME_SIZE 16
+
+// One timed run of result_samples.csv
+typedef struct benchSample_t
+{
+    uint8_t sqrtNumberOfSpheres;
+    uint16_t raysPerPixel;
+    uint8_t raysDepth;
+    uint32_t numberOfPixels;
+    char phase[PHASE_NAME_SIZE];
+    uint64_t time;              // us
+} benchSample_t;
+
+// Grid point & phase
+static int compareKeys(const benchSample_t* a, const benchSample_t* b)
+{
+    if (a->sqrtNumberOfSpheres != b->sqrtNumberOfSpheres)
+        return (a->sqrtNumberOfSpheres > b->sqrtNumberOfSpheres) - (a->sqrtNumberOfSpheres < b->sqrtNumberOfSpheres);
+    if (a->raysPerPixel != b->raysPerPixel)
+        return (a->raysPerPixel > b->raysPerPixel) - (a->raysPerPixel < b->raysPerPixel);
+    if (a->raysDepth != b->raysDepth)
+        return (a->raysDepth > b->raysDepth) - (a->raysDepth < b->raysDepth);
+    if (a->numberOfPixels != b->numberOfPixels)
+        return (a->numberOfPixels > b->numberOfPixels) - (a->numberOfPixels < b->numberOfPixels);
+    return strcmp(a->phase, b->phase);
+}
+
+// Grid point & phase, then time: each point & phase is a run of increasing times
+static int compareSamples(const void* a, const void* b)
+{
+    const benchSample_t* x = a;
+    const benchSample_t* y = b;
+    const int keys = compareKeys(x, y);
+    return keys ? keys : (x->time > y->time) - (x->time < y->time);
+}
+
+// Sorted samples of the file, NULL if it cannot be read
+static benchSample_t* loadSamples(const char* path, uint32_t* numberOfSamples)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+        return NULL;
+
+    uint32_t capacity = 1024;
+    benchSample_t* samples = malloc(capacity * sizeof(benchSample_t));
+    char line[256];
+    *numberOfSamples = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        unsigned int sqrtNumberOfSpheres, raysPerPixel, raysDepth, numberOfPixels, run;
+        unsigned long time;
+        char phase[PHASE_NAME_SIZE];
+        // Header & malformed lines skipped
+        if (sscanf(line, "%u;%u;%u;%u;%15[^;];%u;%lu", &sqrtNumberOfSpheres, &raysPerPixel, &raysDepth, &numberOfPixels, phase, &run, &time) != 7)
+            continue;
+
+        if (*numberOfSamples == capacity)
+        {
+            capacity *= 2;
+            samples = realloc(samples, capacity * sizeof(benchSample_t));
+        }
+        benchSample_t* sample = &samples[(*numberOfSamples)++];
+        sample->sqrtNumberOfSpheres = sqrtNumberOfSpheres;
+        sample->raysPerPixel = raysPerPixel;
+        sample->raysDepth = raysDepth;
+        sample->numberOfPixels = numberOfPixels;
+        strcpy(sample->phase, phase);
+        sample->time = time;
+    }
+    fclose(file);
+
+    qsort(samples, *numberOfSamples, sizeof(benchSample_t), compareSamples);
+    return samples;
+}
+
+// End of the point & phase starting at first
+static uint32_t groupEnd(const benchSample_t* samples, const uint32_t first, const uint32_t numberOfSamples)
+{
+    uint32_t last = first + 1;
+    while (last < numberOfSamples && !compareKeys(&samples[first], &samples[last]))
+        last++;
+    return last;
+}
+
+// Two sided p-value of the Mann-Whitney U test of two runs sorted by time: normal approximation, tie & continuity corrected
+static double mannWhitney(const benchSample_t* x, const uint32_t n1, const benchSample_t* y, const uint32_t n2)
+{
+    double ySumOfRanks = 0.0, tieSum = 0.0;
+    uint32_t i = 0, j = 0, rank = 0;
+    while (i < n1 || j < n2)
+    {
+        // Every time equal to the smallest one left, in both runs: average rank
+        const uint64_t time = (j == n2 || (i < n1 && x[i].time < y[j].time)) ? x[i].time : y[j].time;
+        uint32_t xTies = 0, yTies = 0;
+        while (i < n1 && x[i].time == time)
+            i++, xTies++;
+        while (j < n2 && y[j].time == time)
+            j++, yTies++;
+        const uint32_t ties = xTies + yTies;
+        ySumOfRanks += yTies * (rank + (ties + 1) / 2.0);
+        tieSum += (double)ties * ties * ties - ties;
+        rank += ties;
+    }
+
+    const double n = n1 + n2;
+    const double u = ySumOfRanks - n2 * (n2 + 1) / 2.0;
+    const double mean = n1 * (double)n2 / 2.0;
+    const double variance = n1 * (double)n2 / 12.0 * ((n + 1.0) - tieSum / (n * (n - 1.0)));
+    if (variance <= 0.0)
+        return 1.0;
+    const double z = fmax(fabs(u - mean) - 0.5, 0.0) / sqrt(variance);
+    return erfc(z / sqrt(2.0));
+}
+
+// Baseline & current samples of each point & phase: verdict on stdout & in COMPARE_RESULT_PATH, returns the exit status
+static int compareSamplesFiles(const char* baselinePath, const char* samplesPath, const uint8_t threshold)
+{
+    uint32_t numberOfBaselineSamples, numberOfSamples;
+    benchSample_t* baseline = loadSamples(baselinePath, &numberOfBaselineSamples);
+    benchSample_t* samples = loadSamples(samplesPath, &numberOfSamples);
+    if (!baseline || !samples)
+    {
+        printf("ERROR::CANNOT_READ_BENCH_SAMPLES: %s\n", baseline ? samplesPath : baselinePath);
+        free(baseline);
+        free(samples);
+        return EXIT_FAILURE;
+    }
+    FILE* resultFile = fopen(COMPARE_RESULT_PATH, "w");
+    if (!resultFile)
+    {
+        printf("ERROR::CANNOT_WRITE_COMPARE_RESULT: %s\n", COMPARE_RESULT_PATH);
+        free(baseline);
+        free(samples);
+        return EXIT_FAILURE;
+    }
+    fprintf(resultFile, "sqrt_spheres;rays_per_pixel;rays_depth;resolution;phase;baseline_time;time;change;p_value;verdict\n");
+
+    uint32_t regressions = 0, improvements = 0, unchanged = 0, skipped = 0;
+    uint32_t i = 0, j = 0;
+    while (i < numberOfBaselineSamples || j < numberOfSamples)
+    {
+        const int keys = (i == numberOfBaselineSamples) ? 1 : (j == numberOfSamples) ? -1 : compareKeys(&baseline[i], &samples[j]);
+        const benchSample_t* point = keys <= 0 ? &baseline[i] : &samples[j];
+        const uint32_t baselineEnd = keys <= 0 ? groupEnd(baseline, i, numberOfBaselineSamples) : i;
+        const uint32_t samplesEnd = keys >= 0 ? groupEnd(samples, j, numberOfSamples) : j;
+        const uint32_t n1 = baselineEnd - i;
+        const uint32_t n2 = samplesEnd - j;
+
+        // Grid changed, or too few runs for the test
+        if (n1 < COMPARE_MIN_SAMPLES || n2 < COMPARE_MIN_SAMPLES)
+        {
+            printf("WARNING::COMPARE_POINT_SKIPPED: %u spheres, %u spp, depth %u, %u pixels, %s: %u baseline & %u current runs\n",
+                   point->sqrtNumberOfSpheres * point->sqrtNumberOfSpheres + 4, point->raysPerPixel, point->raysDepth, point->numberOfPixels, point->phase, n1, n2);
+            skipped++;
+            i = baselineEnd;
+            j = samplesEnd;
+            continue;
+        }
+
+        // Medians (nearest rank, as --bench), change of the current one
+        const uint64_t baselineTime = baseline[i + (n1 - 1) / 2].time;
+        const uint64_t time = samples[j + (n2 - 1) / 2].time;
+        const double change = baselineTime ? 100.0 * ((double)time - baselineTime) / baselineTime : 0.0;
+        const double pValue = mannWhitney(&baseline[i], n1, &samples[j], n2);
+
+        const char* verdict = "unchanged";
+        if (pValue < COMPARE_SIGNIFICANCE && change > threshold)
+        {
+            verdict = "regression";
+            regressions++;
+        }
+        else if (pValue < COMPARE_SIGNIFICANCE && change < -(double)threshold)
+        {
+            verdict = "improvement";
+            improvements++;
+        }
+        else
+            unchanged++;
+
+        if (strcmp(verdict, "unchanged"))
+            printf("%-11s %u spheres, %u spp, depth %u, %u pixels, %s: %lu -> %lu us (%+.1f%%), p %.4f\n", verdict,
+                   point->sqrtNumberOfSpheres * point->sqrtNumberOfSpheres + 4, point->raysPerPixel, point->raysDepth, point->numberOfPixels, point->phase,
+                   baselineTime, time, change, pValue);
+        fprintf(resultFile, "%u;%u;%u;%u;%s;%lu;%lu;%f;%f;%s\n", point->sqrtNumberOfSpheres, point->raysPerPixel, point->raysDepth, point->numberOfPixels, point->phase,
+                baselineTime, time, change, pValue, verdict);
+        i = baselineEnd;
+        j = samplesEnd;
+    }
+
+    printf("Compare against %s (threshold %u%%, p < %.2f): %u regressions, %u improvements, %u unchanged, %u skipped, results in %s\n",
+           baselinePath, threshold, COMPARE_SIGNIFICANCE, regressions, improvements, unchanged, skipped, COMPARE_RESULT_PATH);
+    fclose(resultFile);
+    free(baseline);
+    free(samples);
+    if (regressions)
+        return COMPARE_EXIT_REGRESSION;
+    return improvements ? COMPARE_EXIT_IMPROVEMENT : EXIT_SUCCESS;
+}
+
+// First comparison: the samples become the baseline
+static int saveBaseline(const char* samplesPath, const char* baselinePath)
+{
+    FILE* samplesFile = fopen(samplesPath, "rb");
+    FILE* baselineFile = fopen(baselinePath, "wb");
+    if (!samplesFile || !baselineFile)
+    {
+        printf("ERROR::CANNOT_WRITE_BASELINE: %s\n", baselinePath);
+        if (samplesFile)
+            fclose(samplesFile);
+        if (baselineFile)
+            fclose(baselineFile);
+        return EXIT_FAILURE;
+    }
+
+    char buffer[4096];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), samplesFile)))
+        fwrite(buffer, 1, size, baselineFile);
+    fclose(samplesFile);
+    fclose(baselineFile);
+    printf("Compare: no baseline, %s saved as %s\n", samplesPath, baselinePath);
+    return EXIT_SUCCESS;
+}
+
+int compare(const options_t *options)
+{
+    const char* baselinePath = options->baselinePath ? options->baselinePath : COMPARE_DEFAULT_BASELINE_PATH;
+    // The bench rewrites its samples file before the comparison
+    struct stat baselineStat, samplesStat;
+    if (!strcmp(baselinePath, BENCH_SAMPLES_PATH) || (!stat(baselinePath, &baselineStat) && !stat(BENCH_SAMPLES_PATH, &samplesStat)
+        && baselineStat.st_dev == samplesStat.st_dev && baselineStat.st_ino == samplesStat.st_ino))
+    {
+        printf("ERROR::COMPARE_BASELINE_IS_BENCH_OUTPUT: %s is written by the bench, keep the baseline under another name\n", baselinePath);
+        return EXIT_FAILURE;
+    }
+    FILE* baselineFile = fopen(baselinePath, "r");
+    const uint8_t isBaseline = baselineFile != NULL;
+    if (baselineFile)
+        fclose(baselineFile);
+
+    const int result = bench(options);
+    if (result != EXIT_SUCCESS)
+        return result;
+
+    if (!isBaseline)
+        return saveBaseline(BENCH_SAMPLES_PATH, baselinePath);
+    return compareSamplesFiles(baselinePath, BENCH_SAMPLES_PATH, options->regressionThreshold);
+}
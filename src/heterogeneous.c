@@ -0,0 +1,103 @@
+#include "heterogeneous.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+
+#include "raytracing.h"
+#include "tile_queue.h"
+#include "timeline.h"
+
+// Workers of the tile queue
+typedef enum side_t
+{
+    SIDE_DEVICE,
+    SIDE_CPU
+} side_t;
+
+void raytracingHeterogeneous(openCL_t *openCL, color_t *image, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t *spheres, const uint16_t numberOfSpheres, const camera_t *camera, const options_t *options, heterogeneousStats_t *stats)
+{
+    cl_int ret;
+
+    // The float image of the tile buffer (the half image is only read back by raytracing_openCL)
+    if (openCL->isHalfImage)
+    {
+        printf("WARNING::HETERO_WITHOUT_HALF_IMAGE: device tiles are rendered in float\n");
+        openCL->isHalfImage = 0;
+    }
+    uploadScene_openCL(openCL, spheres, numberOfSpheres, camera);
+
+    // Tiles use the megakernel of the program
+    if (options->kernel == KERNEL_WAVEFRONT || options->kernel == KERNEL_PERSISTENT)
+        printf("WARNING::HETERO_MEGAKERNEL_ONLY: rendering the device tiles with the megakernel\n");
+
+    // Device tiles are rendered at the start of this buffer then read back into the image (a tile is at most the frame)
+    cl_mem tileMemObj = createBuffer_openCL(openCL->context, CL_MEM_READ_WRITE, (size_t)width * height * sizeof(color_t), NULL, &ret);
+    if (ret != CL_SUCCESS)
+    {
+        printf("ERROR::OPENCL_TILE_BUFFER: %d\n", ret);
+        exit(EXIT_FAILURE);
+    }
+    const uint16_t sppChunk = samplesPerLaunch_openCL(openCL, raysPerPixel, options);
+    const uint16_t cpuThreads = omp_get_max_threads();
+
+    tileQueue_t queue;
+    initializeTileQueue(&queue, height, 2);
+    stats->deviceRows = stats->deviceTiles = stats->cpuRows = stats->cpuTiles = 0;
+
+    printf("Trace rays (OpenCL + %u CPU threads)!", cpuThreads);
+    fflush(stdout);
+    const double start = omp_get_wtime();
+
+    // One thread drives the device, the other one runs the (nested) OpenMP render of the CPU tiles
+    omp_set_max_active_levels(2);
+    #pragma omp parallel sections num_threads(2)
+    {
+        #pragma omp section
+        {
+            uint16_t firstRow, rows;
+            while ((firstRow = pullTile(&queue, SIDE_DEVICE, openCL->launch.localSize[1], &rows)) < height)
+            {
+                const double tileStart = omp_get_wtime();
+                const uint64_t tileBegin = timelineNow();
+                const cl_int tileRet = renderRows_openCL(openCL, tileMemObj, image, width, firstRow, rows, raysPerPixel, raysDepth, numberOfSpheres, sppChunk);
+                if (tileRet != CL_SUCCESS)
+                {
+                    printf("\nERROR::OPENCL_TILE: %d (rows %u-%u)\n", tileRet, firstRow, firstRow + rows);
+                    exit(EXIT_FAILURE);
+                }
+
+                // Launch & readback included: the device is charged for its whole tile latency
+                recordTimelineSpan("device tile", tileBegin, timelineNow(), firstRow);
+                reportTile(&queue, SIDE_DEVICE, rows, omp_get_wtime() - tileStart);
+                stats->deviceRows += rows;
+                stats->deviceTiles++;
+            }
+        }
+
+        #pragma omp section
+        {
+            uint16_t firstRow, rows;
+            while ((firstRow = pullTile(&queue, SIDE_CPU, cpuThreads, &rows)) < height)
+            {
+                const double tileStart = omp_get_wtime();
+                const uint64_t tileBegin = timelineNow();
+                raytracingRows(image, width, firstRow, rows, raysPerPixel, raysDepth, spheres, numberOfSpheres, camera, 0, NULL);
+                recordTimelineSpan("CPU tile", tileBegin, timelineNow(), firstRow);
+                reportTile(&queue, SIDE_CPU, rows, omp_get_wtime() - tileStart);
+                stats->cpuRows += rows;
+                stats->cpuTiles++;
+            }
+        }
+    }
+
+    // Elapsed time
+    stats->elapsedTime = (omp_get_wtime() - start) * 1e6;
+    printf("\tDone!\n");
+
+    printf("Heterogeneous elapsed time: %lu us\n", stats->elapsedTime);
+    printf("Heterogeneous work: OpenCL %u rows (%.1f%%) in %u tiles, CPU %u rows (%.1f%%) in %u tiles\n",
+           stats->deviceRows, 100.0 * stats->deviceRows / height, stats->deviceTiles, stats->cpuRows, 100.0 * stats->cpuRows / height, stats->cpuTiles);
+
+    releaseBuffer_openCL(tileMemObj);
+}
@@ -3,6 +3,8 @@
 #include <stdint.h>
 #include <time.h>
 #include <math.h>
+#include <string.h>
+#include <sys/time.h>
 
 #include "stb_image_write.h"
 
@@ -11,23 +13,89 @@
 #include "camera.h"
 #include "sphere.h"
 #include "raytracing.h"
+#include "options.h"
 
 #include "raytracing_openCL.h"
+#include "banded_openCL.h"
+#include "heterogeneous.h"
+#include "multi_device_openCL.h"
+#include "batch_openCL.h"
+#include "autotune.h"
+#include "bench.h"
+#include "scaling.h"
+#include "quality.h"
+#include "microbench.h"
+#include "compare.h"
+#include "perf_counters.h"
+#include "timeline.h"
+#include "memory_tracker.h"
 
 
 
-#define CHANNEL_NUM 3
+// Commands run instead of the render (--autotune, --bench, ..., --thumbnails), on the scene of the arguments or without
+// them (isScene: 0) on the defaults of the command. Their timeline is written once they are done
+static int runCommand(const options_t* options, const uint8_t isScene, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint8_t sqrtNumberOfSpheres)
+{
+    int result;
+    switch (options->mode)
+    {
+        case MODE_AUTOTUNE:
+            result = autotune_openCL(options);
+            break;
+
+        case MODE_BENCH:
+            result = bench(options);
+            break;
 
-void renderImage(color_t* image, const char* filename, const uint16_t width, const uint16_t height);
+        case MODE_SCALING:
+            result = isScene ? scaling(width, height, raysPerPixel, raysDepth, sqrtNumberOfSpheres, options)
+                             : scaling(SCALING_WIDTH, SCALING_HEIGHT, SCALING_RAYS_PER_PIXEL, SCALING_RAYS_DEPTH, SCALING_SQRT_NUMBER_OF_SPHERES, options);
+            break;
 
+        case MODE_QUALITY:
+            result = isScene ? quality(width, height, raysPerPixel, raysDepth, sqrtNumberOfSpheres, options)
+                             : quality(QUALITY_WIDTH, QUALITY_HEIGHT, QUALITY_REFERENCE_SPP, QUALITY_REFERENCE_DEPTH, QUALITY_SQRT_NUMBER_OF_SPHERES, options);
+            break;
 
+        case MODE_MICROBENCH:
+            result = microbench(options);
+            break;
+
+        case MODE_COMPARE:
+            result = compare(options);
+            break;
+
+        default:
+            // --thumbnails of the scene
+            result = thumbnails_openCL(options->thumbnails, width, height, raysPerPixel, raysDepth, sqrtNumberOfSpheres, options);
+            break;
+    }
+    writeTimeline();
+    return result;
+}
 
 int main(int argc, char* argv[])
 {
+    // Hardware counters first: only the threads created afterwards are counted
+    initializePerfCounters();
+
+    options_t options;
+    initializeOptions(&options);
+
+    // Commands without scene arguments (e.g. --autotune)
+    if (argc >= 2 && !strncmp(argv[1], "--", 2))
+    {
+        parseOptions(&options, argc, argv, 1);
+        if (options.timelinePath)
+            initializeTimeline(options.timelinePath);
+        if (options.mode != MODE_RENDER)
+            return runCommand(&options, 0, 0, 0, 0, 0, 0);
+    }
+
     // Arguments verification
-    if (argc != 6)
+    if (argc < 6)
     {
-        printf("ERROR::BAD_ARGUMENTS -> PATH WIDTH HEIGHT RAYS_PER_PIXEL RAYS_DEPTH SQRT_NUMBER_OF_SPHERES\n");
+        printf("ERROR::BAD_ARGUMENTS -> PATH WIDTH HEIGHT RAYS_PER_PIXEL RAYS_DEPTH SQRT_NUMBER_OF_SPHERES [OPTIONS]\n");
         return EXIT_FAILURE;
     }
 
@@ -42,15 +110,69 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
+    parseOptions(&options, argc, argv, 6);
+    if (options.timelinePath)
+        initializeTimeline(options.timelinePath);
+    if (options.mode != MODE_RENDER || options.thumbnails)
+        return runCommand(&options, 1, WIDTH, HEIGHT, RAYS_PER_PIXEL, RAYS_DEPTH, SQRT_NUMBER_OF_SPHERES);
+
 
     // ****************** Hello image ****************** //
     // Configuration
     stbi_flip_vertically_on_write(1);
-    srand(time(NULL));
+    srand(options.seed);
+
+    // Whole run, for its peak memory
+    perfPhase_t runPhase;
+    startPerfPhase(&runPhase);
+
+    // --mem-budget: frames whose buffers exceed it are rendered in bands streamed to the PNG files, without frame buffers
+    const uint16_t streamedBandRows = options.memoryBudget ? memoryBudgetBandRows(WIDTH, HEIGHT, options.memoryBudget * 1048576ull) : 0;
+    if (streamedBandRows)
+    {
+        printf("Memory budget %u MiB: the full frame needs %.1f MiB, rendering streamed bands of %u rows\n", options.memoryBudget, fullFrameMemory(WIDTH, HEIGHT) / 1048576.0, streamedBandRows);
+        if (options.isMultiDevice || options.isValidated || options.isHeterogeneous || options.bands)
+            printf("WARNING::MEM_BUDGET_FULL_FRAME_OPTIONS: --multi-device, --validate, --hetero & --bands need the full frame, ignored\n");
+        options.isMultiDevice = 0;
+        options.isValidated = 0;
+        options.isHeterogeneous = 0;
+        options.bands = 0;
+    }
+
+    // --time-budget: progressive passes until the deadline instead of RAYS_PER_PIXEL samples (full frame accumulation)
+    if (options.timeBudget && streamedBandRows)
+    {
+        printf("WARNING::TIME_BUDGET_STREAMED: the streamed bands have no accumulation frame, --time-budget ignored\n");
+        options.timeBudget = 0;
+    }
+    const uint64_t timeBudget = options.timeBudget * 1000ull;
+    if (timeBudget)
+    {
+        printf("Time budget %u ms per render: progressive passes, rays per pixel argument ignored\n", options.timeBudget);
+        if (options.isMultiDevice || options.isValidated || options.isHeterogeneous || options.bands)
+            printf("WARNING::TIME_BUDGET_FIXED_SAMPLES_OPTIONS: --multi-device, --validate, --hetero & --bands render a fixed number of samples, ignored\n");
+        options.isMultiDevice = 0;
+        options.isValidated = 0;
+        options.isHeterogeneous = 0;
+        options.bands = 0;
+    }
+    uint32_t samplesPerPixel = RAYS_PER_PIXEL;
 
-    // Pixels allocation
+    // Scene setup phase: image, camera & spheres
+    perfPhase_t phase;
+    startPerfPhase(&phase);
+
+    // Pixels allocation (none for the streamed bands)
     printf("Allocating image pixels.");
-    color_t* image_f = malloc(WIDTH * HEIGHT * sizeof(color_t));
+    color_t* image_f = NULL;
+    if (options.zeroCopy == ZERO_COPY_USE_HOST_PTR && !streamedBandRows)
+    {
+        // The OpenCL buffer is created on top of this allocation
+        const size_t imageSize = WIDTH * HEIGHT * sizeof(color_t);
+        image_f = trackedAlignedAlloc(ZERO_COPY_ALIGNMENT, (imageSize + ZERO_COPY_ALIGNMENT - 1) / ZERO_COPY_ALIGNMENT * ZERO_COPY_ALIGNMENT);
+    }
+    else if (!streamedBandRows)
+        image_f = trackedMalloc(WIDTH * HEIGHT * sizeof(color_t));
     printf("\tDone!\n");
 
     // Camera
@@ -64,54 +186,117 @@ int main(int argc, char* argv[])
     sphere_t* spheres = malloc(NUMBER_OF_SPHERES  * sizeof(sphere_t));
     initializeSpheres(spheres, SQRT_NUMBER_OF_SPHERES);
     printf("\t\tDone!\n");
+    stopPerfPhase(&phase);
+    reportPerfPhase("scene setup", &phase, WIDTH * HEIGHT);
 
     // **************** Open CL **************** //
-    raytracing_openCL(image_f, WIDTH, HEIGHT, RAYS_PER_PIXEL, RAYS_DEPTH, spheres, NUMBER_OF_SPHERES, &camera);
-    // Render images
-    renderImage(image_f, "OpenCL.png", WIDTH, HEIGHT);
+    // End-to-end latency: render, readback, conversion & encoding of OpenCL.png (validation excluded)
+    struct timeval start, end;
+    openCL_t openCL;
+    multiDevice_t multiDevice;
+    if (options.isMultiDevice)
+        initializeMultiDevice_openCL(&multiDevice, &options);
+    else
+        initializeOpenCL(&openCL, &options);
+    gettimeofday(&start, NULL);
+    color_t* image_openCL = NULL;
+    if (streamedBandRows)
+        raytracingStreamed_openCL(&openCL, "OpenCL.png", WIDTH, HEIGHT, streamedBandRows, RAYS_PER_PIXEL, RAYS_DEPTH, spheres, NUMBER_OF_SPHERES, &camera, &options);
+    else if (timeBudget)
+    {
+        samplesPerPixel = raytracingBudget_openCL(&openCL, image_f, WIDTH, HEIGHT, RAYS_DEPTH, spheres, NUMBER_OF_SPHERES, &camera, timeBudget, &options);
+        image_openCL = image_f;
+    }
+    else
+        image_openCL = options.isMultiDevice
+            ? raytracingMultiDevice_openCL(&multiDevice, image_f, WIDTH, HEIGHT, RAYS_PER_PIXEL, RAYS_DEPTH, spheres, NUMBER_OF_SPHERES, &camera, &options)
+            : options.bands
+            ? raytracingBands_openCL(&openCL, image_f, "OpenCL.png", WIDTH, HEIGHT, RAYS_PER_PIXEL, RAYS_DEPTH, spheres, NUMBER_OF_SPHERES, &camera, &options)
+            : raytracing_openCL(&openCL, image_f, WIDTH, HEIGHT, RAYS_PER_PIXEL, RAYS_DEPTH, spheres, NUMBER_OF_SPHERES, &camera, &options);
+    gettimeofday(&end, NULL);
+    uint64_t latency = (end.tv_sec - start.tv_sec) * 1000000ull + (end.tv_usec - start.tv_usec);
+    const uint64_t openCLTime = latency;
+    if (timeBudget)
+        printf("OpenCL time budget %u ms: %u samples per pixel, rendered & read back in %lu us (%+.1f%% of the budget)\n", options.timeBudget, samplesPerPixel, openCLTime, 100.0 * ((double)openCLTime - timeBudget) / timeBudget);
+    if (timeBudget && openCLTime > timeBudget && samplesPerPixel == 1)
+        printf("WARNING::TIME_BUDGET_EXCEEDED: one sample per pixel takes longer than the budget on OpenCL\n");
+    // Compare with the reference kernel (before the gamma correction of renderImage)
+    const uint8_t isValid = !options.isValidated || validate_openCL(image_openCL, WIDTH, HEIGHT, RAYS_PER_PIXEL, RAYS_DEPTH, spheres, NUMBER_OF_SPHERES, &camera, &options);
+    // Render images (directly from the mapped device buffer in zero-copy mode), already written by the banded & streamed flows
+    if (!streamedBandRows && (options.isMultiDevice || !options.bands))
+    {
+        gettimeofday(&start, NULL);
+        renderImage(image_openCL, "OpenCL.png", WIDTH, HEIGHT);
+        gettimeofday(&end, NULL);
+        latency += (end.tv_sec - start.tv_sec) * 1000000ull + (end.tv_usec - start.tv_usec);
+    }
+    printf("OpenCL end-to-end latency: %lu us (%s)\n", latency, options.isMultiDevice ? "multi-device" : options.bands ? "banded" : streamedBandRows ? "streamed" : "serial");
+    if (options.isMultiDevice)
+        releaseMultiDevice_openCL(&multiDevice);
+    else
+    {
+        unmapImage_openCL(&openCL);
+        releaseOpenCL(&openCL);
+    }
 
     // **************** CPU **************** //
     // Time measure
-    struct timeval start, end;
     printf("Trace rays!");
     fflush(stdout);
     gettimeofday(&start, NULL);
+    startPerfPhase(&phase);
+    const uint64_t timelineStart = timelineNow();
 
-    // Render image
-    raytracing(image_f, WIDTH, HEIGHT, RAYS_PER_PIXEL, RAYS_DEPTH, spheres, NUMBER_OF_SPHERES, &camera);
+    // Render image (per thread ray counters with --stats)
+    cpuRayStats_t cpuRayStats;
+    resetCpuRayStats(&cpuRayStats);
+    if (streamedBandRows)
+        raytracingStreamed("CPU.png", WIDTH, HEIGHT, streamedBandRows, RAYS_PER_PIXEL, RAYS_DEPTH, spheres, NUMBER_OF_SPHERES, &camera, options.isRayStats ? &cpuRayStats : NULL);
+    else if (timeBudget)
+        samplesPerPixel = raytracingBudget(image_f, WIDTH, HEIGHT, RAYS_DEPTH, spheres, NUMBER_OF_SPHERES, &camera, timeBudget, options.isRayStats ? &cpuRayStats : NULL);
+    else
+        raytracing(image_f, WIDTH, HEIGHT, RAYS_PER_PIXEL, RAYS_DEPTH, spheres, NUMBER_OF_SPHERES, &camera, options.isRayStats ? &cpuRayStats : NULL);
 
     // Elapsed time
     gettimeofday(&end, NULL);
+    stopPerfPhase(&phase);
+    recordTimelineSpan("trace CPU", timelineStart, timelineNow(), 0);
     printf("\t\t\tDone!\n");
     
     uint64_t elapsedTime = (end.tv_sec - start.tv_sec) * 1000000ull + (end.tv_usec - start.tv_usec);
     printf("Raytracing elapsed time: %lu us\n", elapsedTime);
-    printf("Cycles per pixel: %f\n", elapsedTime * 2.8e3f / (WIDTH * HEIGHT));
+    if (timeBudget)
+        printf("CPU time budget %u ms: %u samples per pixel in %lu us (%+.1f%% of the budget)\n", options.timeBudget, samplesPerPixel, elapsedTime, 100.0 * ((double)elapsedTime - timeBudget) / timeBudget);
+    if (timeBudget && elapsedTime > timeBudget && samplesPerPixel == 1)
+        printf("WARNING::TIME_BUDGET_EXCEEDED: one sample per pixel takes longer than the budget on the CPU\n");
+    reportPerfPhase(streamedBandRows ? "trace & stream CPU" : "trace CPU", &phase, WIDTH * HEIGHT);
+    if (options.isRayStats)
+        reportCpuRayStats(&cpuRayStats);
     
-    // Render images
-    renderImage(image_f, "CPU.png", WIDTH, HEIGHT);
+    // Render images, already written by the streamed flow
+    if (!streamedBandRows)
+        renderImage(image_f, "CPU.png", WIDTH, HEIGHT);
+
+    // **************** OpenCL + CPU **************** //
+    if (options.isHeterogeneous)
+    {
+        heterogeneousStats_t stats;
+        initializeOpenCL(&openCL, &options);
+        raytracingHeterogeneous(&openCL, image_f, WIDTH, HEIGHT, RAYS_PER_PIXEL, RAYS_DEPTH, spheres, NUMBER_OF_SPHERES, &camera, &options, &stats);
+        releaseOpenCL(&openCL);
+        printf("Heterogeneous speed-up: %.2fx vs. OpenCL alone, %.2fx vs. CPU alone\n", (double)openCLTime / stats.elapsedTime, (double)elapsedTime / stats.elapsedTime);
+        renderImage(image_f, "Hetero.png", WIDTH, HEIGHT);
+    }
 
     // Free spheres memory
     free(spheres);
-    free(image_f);
+    trackedFree(image_f);
+    stopPerfPhase(&runPhase);
+    reportPerfPhase("whole run", &runPhase, WIDTH * HEIGHT);
+    releasePerfCounters();
+    writeTimeline();
     
     // Release float image
 
-    return EXIT_SUCCESS;
-}
-
-void renderImage(color_t *image, const char* filename, const uint16_t width, const uint16_t height)
-{
-    // Linear space to Gamma space tranformation
-    imageLinearToGamma(image, width * height);
-
-    // Output image allocation & copy
-    color_u8_t* image_u8 = malloc(width * height * sizeof(color_u8_t));
-    imageFloatToU8(image, image_u8, width * height);
-
-    // Save image
-    stbi_write_png(filename, width, height, CHANNEL_NUM, image_u8, width * CHANNEL_NUM);
-
-    // Destroy image
-    free(image_u8);
+    return isValid ? EXIT_SUCCESS : EXIT_FAILURE;
 }
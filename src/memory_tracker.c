@@ -0,0 +1,63 @@
+#include "memory_tracker.h"
+
+#include <stdlib.h>
+#include <malloc.h>
+
+static size_t memoryUse[MEMORY_SPACES];
+static size_t memoryPeak[MEMORY_SPACES];   // Since the start of the innermost phase
+
+void trackMemory(const memorySpace_t space, const int64_t bytes)
+{
+    const size_t use = __atomic_add_fetch(&memoryUse[space], (size_t)bytes, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&memoryPeak[space], __ATOMIC_RELAXED);
+    while (use > peak && !__atomic_compare_exchange_n(&memoryPeak[space], &peak, use, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+size_t memoryInUse(const memorySpace_t space)
+{
+    return __atomic_load_n(&memoryUse[space], __ATOMIC_RELAXED);
+}
+
+// Usable size of the block: what the allocator really holds, the same value at the release
+void* trackedMalloc(size_t size)
+{
+    void* pointer = malloc(size);
+    if (pointer)
+        trackMemory(MEMORY_HOST, malloc_usable_size(pointer));
+    return pointer;
+}
+
+void* trackedAlignedAlloc(size_t alignment, size_t size)
+{
+    void* pointer = aligned_alloc(alignment, size);
+    if (pointer)
+        trackMemory(MEMORY_HOST, malloc_usable_size(pointer));
+    return pointer;
+}
+
+void trackedFree(void* pointer)
+{
+    if (pointer)
+        trackMemory(MEMORY_HOST, -(int64_t)malloc_usable_size(pointer));
+    free(pointer);
+}
+
+void startMemoryPhase(memoryPhase_t *phase)
+{
+    uint8_t space;
+    for (space = 0; space < MEMORY_SPACES; space++)
+        phase->outerPeak[space] = __atomic_exchange_n(&memoryPeak[space], memoryInUse(space), __ATOMIC_RELAXED);
+}
+
+void stopMemoryPhase(memoryPhase_t *phase)
+{
+    uint8_t space;
+    for (space = 0; space < MEMORY_SPACES; space++)
+    {
+        phase->peak[space] = __atomic_load_n(&memoryPeak[space], __ATOMIC_RELAXED);
+        // The enclosing phase keeps the highest of both
+        if (phase->outerPeak[space] > phase->peak[space])
+            __atomic_store_n(&memoryPeak[space], phase->outerPeak[space], __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,221 @@
+#include "microbench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "raytracing.h"
+#include "sphere.h"
+#include "utils.h"
+#include "bench.h"
+#include "perf_counters.h"
+
+// Inputs of the primitives, cycled through by the timed loops
+typedef struct microbenchInputs_t
+{
+    vec3_t directions[MICROBENCH_INPUTS];       // Unit vectors
+    vec3_t normals[MICROBENCH_INPUTS];          // Unit normals against the directions
+    float refractionRatios[MICROBENCH_INPUTS];  // Front & back faces of the dielectric spheres
+    float cosines[MICROBENCH_INPUTS];
+    vec3_t rayPositions[MICROBENCH_INPUTS];     // Camera rays toward the scene
+    vec3_t rayDirections[MICROBENCH_INPUTS];
+    sphere_t* spheres;
+    uint16_t numberOfSpheres;
+} microbenchInputs_t;
+
+// MICROBENCH_OPS calls (or about as many), numberOfOps: calls made. Returns a sum of the results, kept by the caller
+typedef float (*microbenchFunction_t)(const microbenchInputs_t* inputs, uint32_t* numberOfOps);
+
+// Written with the sums, so that the timed calls are not optimized out
+static volatile float microbenchSink;
+
+static float benchPcgHash(const microbenchInputs_t* inputs, uint32_t* numberOfOps)
+{
+    uint32_t seed = MICROBENCH_SEED, hash = 0, i;
+    for (i = 0; i < MICROBENCH_OPS; i++)
+        hash ^= pcg_hash(&seed);
+    *numberOfOps = MICROBENCH_OPS;
+    return (float)hash;
+}
+
+static float benchRandomFloat(const microbenchInputs_t* inputs, uint32_t* numberOfOps)
+{
+    uint32_t seed = MICROBENCH_SEED, i;
+    float sum = 0.0f;
+    for (i = 0; i < MICROBENCH_OPS; i++)
+        sum += randomFloatInUnitInterval(&seed);
+    *numberOfOps = MICROBENCH_OPS;
+    return sum;
+}
+
+static float benchRandomUnitVector(const microbenchInputs_t* inputs, uint32_t* numberOfOps)
+{
+    uint32_t seed = MICROBENCH_SEED, i;
+    float sum = 0.0f;
+    for (i = 0; i < MICROBENCH_OPS; i++)
+    {
+        const vec3_t v = randomUnitVector(&seed);
+        sum += v.x + v.y + v.z;
+    }
+    *numberOfOps = MICROBENCH_OPS;
+    return sum;
+}
+
+static float benchRandomInUnitDisk(const microbenchInputs_t* inputs, uint32_t* numberOfOps)
+{
+    uint32_t seed = MICROBENCH_SEED, i;
+    float sum = 0.0f;
+    for (i = 0; i < MICROBENCH_OPS; i++)
+    {
+        const vec3_t v = randomInUnitDisk(&seed);
+        sum += v.x + v.y;
+    }
+    *numberOfOps = MICROBENCH_OPS;
+    return sum;
+}
+
+static float benchRefract(const microbenchInputs_t* inputs, uint32_t* numberOfOps)
+{
+    uint32_t seed = MICROBENCH_SEED, i;
+    float sum = 0.0f;
+    for (i = 0; i < MICROBENCH_OPS; i++)
+    {
+        const uint32_t inputIdx = i % MICROBENCH_INPUTS;
+        const vec3_t v = vec3_refract(&inputs->directions[inputIdx], &inputs->normals[inputIdx], inputs->refractionRatios[inputIdx], &seed);
+        sum += v.x + v.y + v.z;
+    }
+    *numberOfOps = MICROBENCH_OPS;
+    return sum;
+}
+
+static float benchShlick(const microbenchInputs_t* inputs, uint32_t* numberOfOps)
+{
+    uint32_t i;
+    float sum = 0.0f;
+    for (i = 0; i < MICROBENCH_OPS; i++)
+    {
+        const uint32_t inputIdx = i % MICROBENCH_INPUTS;
+        sum += shlickReflectance(inputs->cosines[inputIdx], inputs->refractionRatios[inputIdx]);
+    }
+    *numberOfOps = MICROBENCH_OPS;
+    return sum;
+}
+
+// One op: one ray against one sphere, in the closest hit search loop of the bounce loop
+static float benchRaySphere(const microbenchInputs_t* inputs, uint32_t* numberOfOps)
+{
+    const uint32_t numberOfRays = MICROBENCH_OPS / inputs->numberOfSpheres;
+    uint32_t rayIdx;
+    uint16_t k;
+    float sum = 0.0f;
+    for (rayIdx = 0; rayIdx < numberOfRays; rayIdx++)
+    {
+        const uint32_t inputIdx = rayIdx % MICROBENCH_INPUTS;
+        float closestSphereDistance = INFINITY;
+        for (k = 0; k < inputs->numberOfSpheres; k++)
+        {
+            const float newDistance = raySphereDistance(&inputs->rayPositions[inputIdx], &inputs->rayDirections[inputIdx], &inputs->spheres[k]);
+            if (newDistance < closestSphereDistance)
+                closestSphereDistance = newDistance;
+        }
+        if (closestSphereDistance < INFINITY)
+            sum += closestSphereDistance;
+    }
+    *numberOfOps = numberOfRays * inputs->numberOfSpheres;
+    return sum;
+}
+
+static void initializeInputs(microbenchInputs_t* inputs)
+{
+    uint32_t seed = MICROBENCH_SEED, i;
+    const vec3_t lookFrom = { 13.0f, 2.0f, 3.0f };
+    for (i = 0; i < MICROBENCH_INPUTS; i++)
+    {
+        inputs->directions[i] = randomUnitVector(&seed);
+        inputs->normals[i] = randomUnitVector(&seed);
+        if (vec3_dot(&inputs->directions[i], &inputs->normals[i]) > 0.0f)
+            vec3_opposite(&inputs->normals[i]);
+        inputs->refractionRatios[i] = (pcg_hash(&seed) & 1) ? 1.0f / 1.5f : 1.5f;
+        inputs->cosines[i] = randomFloatInUnitInterval(&seed);
+
+        // From the camera of the renders, toward the spheres around the origin
+        const vec3_t target = { randomFloat(&seed, -4.0f, 4.0f), randomFloat(&seed, -0.5f, 1.5f), randomFloat(&seed, -2.5f, 2.5f) };
+        inputs->rayPositions[i] = lookFrom;
+        inputs->rayDirections[i] = vec3_sub(&target, &lookFrom);
+    }
+
+    inputs->numberOfSpheres = MICROBENCH_SQRT_NUMBER_OF_SPHERES * MICROBENCH_SQRT_NUMBER_OF_SPHERES + 4;
+    inputs->spheres = malloc(inputs->numberOfSpheres * sizeof(sphere_t));
+    srand(MICROBENCH_SEED);
+    initializeSpheres(inputs->spheres, MICROBENCH_SQRT_NUMBER_OF_SPHERES);
+}
+
+static int compareU64(const void* a, const void* b)
+{
+    const uint64_t x = *(const uint64_t*)a;
+    const uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void runMicrobench(FILE* resultFile, const char* name, microbenchFunction_t function, const microbenchInputs_t* inputs, const options_t* options, uint64_t* times, uint64_t* cycles)
+{
+    uint32_t numberOfOps = 0;
+    uint16_t runIdx;
+    for (runIdx = 0; runIdx < options->warmups + options->repetitions; runIdx++)
+    {
+        perfPhase_t phase;
+        startPerfPhase(&phase);
+        microbenchSink = function(inputs, &numberOfOps);
+        stopPerfPhase(&phase);
+        if (runIdx < options->warmups)
+            continue;
+        times[runIdx - options->warmups] = phase.time;
+        cycles[runIdx - options->warmups] = phase.counts[PERF_CYCLES];
+    }
+
+    // Medians & percentiles (nearest rank) of the timed runs
+    const uint16_t numberOfRuns = options->repetitions;
+    qsort(times, numberOfRuns, sizeof(uint64_t), compareU64);
+    qsort(cycles, numberOfRuns, sizeof(uint64_t), compareU64);
+    const double nsPerOp = 1e3 * times[(numberOfRuns - 1) / 2] / numberOfOps;
+    const double lowNsPerOp = 1e3 * times[(numberOfRuns - 1) * BENCH_LOW_PERCENTILE / 100] / numberOfOps;
+    const double highNsPerOp = 1e3 * times[((numberOfRuns - 1) * BENCH_HIGH_PERCENTILE + 99) / 100] / numberOfOps;
+    const uint64_t medianCycles = cycles[(numberOfRuns - 1) / 2];
+    const double opsPerCycle = (isPerfEventAvailable(PERF_CYCLES) && medianCycles) ? (double)numberOfOps / medianCycles : NAN;
+
+    printf("%-28s %9.3f ns/op (p%u %.3f, p%u %.3f), %6.3f ops/cycle\n", name, nsPerOp, BENCH_LOW_PERCENTILE, lowNsPerOp, BENCH_HIGH_PERCENTILE, highNsPerOp, opsPerCycle);
+    fprintf(resultFile, "%s;%u;%f;%f;%f;%f\n", name, numberOfOps, nsPerOp, lowNsPerOp, highNsPerOp, opsPerCycle);
+    fflush(resultFile);
+}
+
+int microbench(const options_t *options)
+{
+    FILE* resultFile = fopen(MICROBENCH_RESULT_PATH, "w");
+    if (!resultFile)
+    {
+        printf("ERROR::CANNOT_WRITE_MICROBENCH_RESULT: %s\n", MICROBENCH_RESULT_PATH);
+        return EXIT_FAILURE;
+    }
+    fprintf(resultFile, "primitive;ops;ns_per_op;ns_per_op_p%u;ns_per_op_p%u;ops_per_cycle\n", BENCH_LOW_PERCENTILE, BENCH_HIGH_PERCENTILE);
+
+    microbenchInputs_t* inputs = malloc(sizeof(microbenchInputs_t));
+    initializeInputs(inputs);
+    uint64_t* times = malloc(options->repetitions * sizeof(uint64_t));
+    uint64_t* cycles = malloc(options->repetitions * sizeof(uint64_t));
+
+    printf("Microbench: %u ops per run, %u warm-up & %u timed runs, seed %u, results in %s\n", MICROBENCH_OPS, options->warmups, options->repetitions, MICROBENCH_SEED, MICROBENCH_RESULT_PATH);
+    runMicrobench(resultFile, "pcg_hash", benchPcgHash, inputs, options, times, cycles);
+    runMicrobench(resultFile, "randomFloatInUnitInterval", benchRandomFloat, inputs, options, times, cycles);
+    runMicrobench(resultFile, "randomUnitVector", benchRandomUnitVector, inputs, options, times, cycles);
+    runMicrobench(resultFile, "randomInUnitDisk", benchRandomInUnitDisk, inputs, options, times, cycles);
+    runMicrobench(resultFile, "vec3_refract", benchRefract, inputs, options, times, cycles);
+    runMicrobench(resultFile, "shlickReflectance", benchShlick, inputs, options, times, cycles);
+    runMicrobench(resultFile, "raySphereDistance", benchRaySphere, inputs, options, times, cycles);
+
+    fclose(resultFile);
+    free(cycles);
+    free(times);
+    free(inputs->spheres);
+    free(inputs);
+    return EXIT_SUCCESS;
+}
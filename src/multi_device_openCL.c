@@ -0,0 +1,158 @@
+#include "multi_device_openCL.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+
+#include "perf_counters.h"
+#include "timeline.h"
+
+void initializeMultiDevice_openCL(multiDevice_t *multiDevice, const options_t *options)
+{
+    cl_platform_id platforms[MULTI_DEVICE_MAX_PLATFORMS];
+    cl_uint numberOfPlatforms;
+    cl_int ret = clGetPlatformIDs(MULTI_DEVICE_MAX_PLATFORMS, platforms, &numberOfPlatforms);
+    if (ret != CL_SUCCESS || !numberOfPlatforms)
+    {
+        printf("ERROR::OPENCL_NO_PLATFORM: %d\n", ret);
+        exit(EXIT_FAILURE);
+    }
+    if (numberOfPlatforms > MULTI_DEVICE_MAX_PLATFORMS)
+        numberOfPlatforms = MULTI_DEVICE_MAX_PLATFORMS;
+
+    // Every device able to build & run the kernels
+    multiDevice->numberOfDevices = 0;
+    cl_uint platformIdx, deviceIdx;
+    for (platformIdx = 0; platformIdx < numberOfPlatforms; platformIdx++)
+    {
+        cl_device_id deviceIDs[MULTI_DEVICE_MAX_DEVICES];
+        cl_uint numberOfDevices;
+        if (clGetDeviceIDs(platforms[platformIdx], CL_DEVICE_TYPE_ALL, MULTI_DEVICE_MAX_DEVICES, deviceIDs, &numberOfDevices) != CL_SUCCESS)
+            continue;
+        if (numberOfDevices > MULTI_DEVICE_MAX_DEVICES)
+            numberOfDevices = MULTI_DEVICE_MAX_DEVICES;
+
+        for (deviceIdx = 0; deviceIdx < numberOfDevices; deviceIdx++)
+        {
+            cl_bool isAvailable = CL_FALSE, isCompilerAvailable = CL_FALSE;
+            clGetDeviceInfo(deviceIDs[deviceIdx], CL_DEVICE_AVAILABLE, sizeof(isAvailable), &isAvailable, NULL);
+            clGetDeviceInfo(deviceIDs[deviceIdx], CL_DEVICE_COMPILER_AVAILABLE, sizeof(isCompilerAvailable), &isCompilerAvailable, NULL);
+            if (!isAvailable || !isCompilerAvailable)
+                continue;
+            if (multiDevice->numberOfDevices == MULTI_DEVICE_MAX_DEVICES)
+            {
+                printf("WARNING::TOO_MANY_OPENCL_DEVICES: only the first %u devices are used\n", MULTI_DEVICE_MAX_DEVICES);
+                return;
+            }
+
+            openCL_t* openCL = &multiDevice->devices[multiDevice->numberOfDevices];
+            if (initializeOpenCLDevice(openCL, platforms[platformIdx], deviceIDs[deviceIdx], options) != CL_SUCCESS)
+            {
+                printf("WARNING::OPENCL_DEVICE_SKIPPED: %s, the kernels do not build\n", openCL->deviceName);
+                continue;
+            }
+            openCL->timelineDevice = multiDevice->numberOfDevices;
+            nameTimelineDevice(openCL->timelineDevice, openCL->deviceName);
+            printf("Device %u: %s (%s), %u compute units\n", multiDevice->numberOfDevices, openCL->deviceName, openCL->driverVersion, openCL->computeUnits);
+            multiDevice->numberOfDevices++;
+        }
+    }
+
+    if (!multiDevice->numberOfDevices)
+    {
+        printf("ERROR::OPENCL_NO_DEVICE: no available device on %u platforms\n", numberOfPlatforms);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void releaseMultiDevice_openCL(multiDevice_t *multiDevice)
+{
+    uint8_t deviceIdx;
+    for (deviceIdx = 0; deviceIdx < multiDevice->numberOfDevices; deviceIdx++)
+        releaseOpenCL(&multiDevice->devices[deviceIdx]);
+    multiDevice->numberOfDevices = 0;
+}
+
+color_t* raytracingMultiDevice_openCL(multiDevice_t *multiDevice, color_t *image, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t *spheres, const uint16_t numberOfSpheres, const camera_t *camera, const options_t *options)
+{
+    const uint8_t numberOfDevices = multiDevice->numberOfDevices;
+    if (options->kernel == KERNEL_WAVEFRONT || options->kernel == KERNEL_PERSISTENT)
+        printf("WARNING::MULTI_DEVICE_MEGAKERNEL_ONLY: rendering the device tiles with the megakernel\n");
+
+    // Scene & tile buffer (a tile is at most the frame) of every device
+    cl_mem tileMemObjs[MULTI_DEVICE_MAX_DEVICES];
+    uint16_t sppChunks[MULTI_DEVICE_MAX_DEVICES];
+    uint32_t deviceRows[MULTI_DEVICE_MAX_DEVICES] = { 0 };
+    uint32_t deviceTiles[MULTI_DEVICE_MAX_DEVICES] = { 0 };
+    double deviceTime[MULTI_DEVICE_MAX_DEVICES] = { 0.0 };
+    uint8_t deviceIdx;
+    for (deviceIdx = 0; deviceIdx < numberOfDevices; deviceIdx++)
+    {
+        openCL_t* openCL = &multiDevice->devices[deviceIdx];
+        if (openCL->isHalfImage)
+        {
+            printf("WARNING::MULTI_DEVICE_WITHOUT_HALF_IMAGE: device tiles are rendered in float\n");
+            openCL->isHalfImage = 0;
+        }
+        uploadScene_openCL(openCL, spheres, numberOfSpheres, camera);
+
+        cl_int ret;
+        tileMemObjs[deviceIdx] = createBuffer_openCL(openCL->context, CL_MEM_READ_WRITE, (size_t)width * height * sizeof(color_t), NULL, &ret);
+        if (ret != CL_SUCCESS)
+        {
+            printf("ERROR::OPENCL_TILE_BUFFER: %d (device %u)\n", ret, deviceIdx);
+            exit(EXIT_FAILURE);
+        }
+        sppChunks[deviceIdx] = samplesPerLaunch_openCL(openCL, raysPerPixel, options);
+    }
+
+    tileQueue_t queue;
+    initializeTileQueue(&queue, height, numberOfDevices);
+
+    // Time measure
+    printf("Trace rays (%u devices)!", numberOfDevices);
+    fflush(stdout);
+    const double start = omp_get_wtime();
+    perfPhase_t phase;
+    startPerfPhase(&phase);
+
+    // One host thread per device
+    #pragma omp parallel num_threads(numberOfDevices)
+    {
+        const uint8_t device = omp_get_thread_num();
+        openCL_t* openCL = &multiDevice->devices[device];
+        uint16_t firstRow, rows;
+        while ((firstRow = pullTile(&queue, device, openCL->launch.localSize[1], &rows)) < height)
+        {
+            const double tileStart = omp_get_wtime();
+            const uint64_t tileBegin = timelineNow();
+            const cl_int ret = renderRows_openCL(openCL, tileMemObjs[device], image, width, firstRow, rows, raysPerPixel, raysDepth, numberOfSpheres, sppChunks[device]);
+            if (ret != CL_SUCCESS)
+            {
+                printf("\nERROR::OPENCL_TILE: %d (device %u, rows %u-%u)\n", ret, device, firstRow, firstRow + rows);
+                exit(EXIT_FAILURE);
+            }
+            const double tileTime = omp_get_wtime() - tileStart;
+            recordTimelineSpan("device tile", tileBegin, timelineNow(), firstRow);
+            reportTile(&queue, device, rows, tileTime);
+            deviceRows[device] += rows;
+            deviceTiles[device]++;
+            deviceTime[device] += tileTime;
+        }
+    }
+
+    // Elapsed time
+    const uint64_t elapsedTime = (omp_get_wtime() - start) * 1e6;
+    stopPerfPhase(&phase);
+    printf("\t\t\tDone!\n");
+
+    printf("Raytracing_OpenCL elapsed time: %lu us (%u devices)\n", elapsedTime, numberOfDevices);
+    reportPerfPhase("trace OpenCL", &phase, width * height);
+    for (deviceIdx = 0; deviceIdx < numberOfDevices; deviceIdx++)
+    {
+        printf("Device %u: %u rows (%.1f%%) in %u tiles, %f rows/s\n", deviceIdx, deviceRows[deviceIdx], 100.0 * deviceRows[deviceIdx] / height,
+               deviceTiles[deviceIdx], deviceTime[deviceIdx] > 0.0 ? deviceRows[deviceIdx] / deviceTime[deviceIdx] : 0.0);
+        releaseBuffer_openCL(tileMemObjs[deviceIdx]);
+    }
+    return image;
+}
@@ -0,0 +1,214 @@
+#include "options.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "timeline.h"
+#include "compare.h"
+
+void initializeOptions(options_t *options)
+{
+    options->mode = MODE_RENDER;
+    options->zeroCopy = ZERO_COPY_NONE;
+    options->kernel = KERNEL_MEGAKERNEL;
+    options->accel = ACCEL_AUTO;
+    options->sphereMemory = SPHERE_MEMORY_AUTO;
+    options->localSize[0] = 0;
+    options->localSize[1] = 0;
+    options->isProfileIgnored = 0;
+    options->sampleSeedBase = 0;
+    options->launches = 0;
+    options->readbackInterval = 0;
+    options->seed = time(NULL);
+    options->isSeedSet = 0;
+    options->isValidated = 0;
+    options->batchSize = 1;
+    options->bands = 0;
+    options->isHeterogeneous = 0;
+    options->isMultiDevice = 0;
+    options->memoryBudget = 0;
+    options->isRayStats = 0;
+    options->timelinePath = NULL;
+    options->warmups = 1;
+    options->repetitions = 5;
+    options->pinning = PINNING_NONE;
+    options->timeBudget = 0;
+    options->baselinePath = NULL;
+    options->regressionThreshold = COMPARE_DEFAULT_THRESHOLD;
+    options->thumbnails = 0;
+}
+
+void parseOptions(options_t *options, const int argc, char *argv[], const int firstOption)
+{
+    int i;
+    for (i = firstOption; i < argc; i++)
+    {
+        const char* option = argv[i];
+
+        if (!strcmp(option, "--autotune"))
+            options->mode = MODE_AUTOTUNE;
+        else if (!strcmp(option, "--bench"))
+            options->mode = MODE_BENCH;
+        else if (!strcmp(option, "--scaling"))
+            options->mode = MODE_SCALING;
+        else if (!strcmp(option, "--quality"))
+            options->mode = MODE_QUALITY;
+        else if (!strcmp(option, "--microbench"))
+            options->mode = MODE_MICROBENCH;
+        else if (!strcmp(option, "--compare"))
+            options->mode = MODE_COMPARE;
+        else if (!strncmp(option, "--compare=", 10))
+        {
+            options->mode = MODE_COMPARE;
+            options->baselinePath = option + 10;
+        }
+        else if (!strncmp(option, "--threshold=", 12))
+        {
+            char* end;
+            const long threshold = strtol(option + 12, &end, 10);
+            if (end == option + 12 || *end || threshold < 0 || threshold > UINT8_MAX)
+            {
+                printf("ERROR::BAD_OPTION_VALUE: %s -> Must be INTEGER in [0, %u]\n", option, UINT8_MAX);
+                exit(EXIT_FAILURE);
+            }
+            options->regressionThreshold = threshold;
+        }
+        else if (!strcmp(option, "--pin=none"))
+            options->pinning = PINNING_NONE;
+        else if (!strcmp(option, "--pin=close"))
+            options->pinning = PINNING_CLOSE;
+        else if (!strcmp(option, "--pin=spread"))
+            options->pinning = PINNING_SPREAD;
+        else if (!strcmp(option, "--zero-copy") || !strcmp(option, "--zero-copy=alloc"))
+            options->zeroCopy = ZERO_COPY_ALLOC_HOST_PTR;
+        else if (!strcmp(option, "--zero-copy=use"))
+            options->zeroCopy = ZERO_COPY_USE_HOST_PTR;
+        else if (!strcmp(option, "--kernel=megakernel"))
+            options->kernel = KERNEL_MEGAKERNEL;
+        else if (!strcmp(option, "--kernel=wavefront"))
+            options->kernel = KERNEL_WAVEFRONT;
+        else if (!strcmp(option, "--kernel=persistent"))
+            options->kernel = KERNEL_PERSISTENT;
+        else if (!strcmp(option, "--kernel=float4"))
+            options->kernel = KERNEL_FLOAT4;
+        else if (!strcmp(option, "--kernel=half"))
+            options->kernel = KERNEL_HALF;
+        else if (!strcmp(option, "--hetero"))
+            options->isHeterogeneous = 1;
+        else if (!strcmp(option, "--multi-device"))
+            options->isMultiDevice = 1;
+        else if (!strcmp(option, "--stats"))
+            options->isRayStats = 1;
+        else if (!strcmp(option, "--timeline"))
+            options->timelinePath = TIMELINE_DEFAULT_PATH;
+        else if (!strncmp(option, "--timeline=", 11))
+            options->timelinePath = option + 11;
+        else if (!strcmp(option, "--validate"))
+            options->isValidated = 1;
+        else if (!strcmp(option, "--accel=auto"))
+            options->accel = ACCEL_AUTO;
+        else if (!strcmp(option, "--accel=none"))
+            options->accel = ACCEL_NONE;
+        else if (!strcmp(option, "--accel=bvh"))
+            options->accel = ACCEL_BVH;
+        else if (!strcmp(option, "--sphere-memory=auto"))
+            options->sphereMemory = SPHERE_MEMORY_AUTO;
+        else if (!strcmp(option, "--sphere-memory=global"))
+            options->sphereMemory = SPHERE_MEMORY_GLOBAL;
+        else if (!strcmp(option, "--sphere-memory=constant"))
+            options->sphereMemory = SPHERE_MEMORY_CONSTANT;
+        else if (!strcmp(option, "--sphere-memory=local"))
+            options->sphereMemory = SPHERE_MEMORY_LOCAL;
+        else if (!strncmp(option, "--seed=", 7))
+        {
+            options->seed = strtoul(option + 7, NULL, 10);
+            options->isSeedSet = 1;
+        }
+        else if (!strncmp(option, "--time-budget=", 14))
+        {
+            options->timeBudget = atoi(option + 14);
+            if (!options->timeBudget)
+            {
+                printf("ERROR::BAD_OPTION_VALUE: %s -> Must be Non-Zero INTEGER\n", option);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strncmp(option, "--mem-budget=", 13))
+        {
+            options->memoryBudget = atoi(option + 13);
+            if (!options->memoryBudget)
+            {
+                printf("ERROR::BAD_OPTION_VALUE: %s -> Must be Non-Zero INTEGER\n", option);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strncmp(option, "--warmup=", 9))
+            options->warmups = atoi(option + 9);
+        else if (!strncmp(option, "--reps=", 7))
+        {
+            options->repetitions = atoi(option + 7);
+            if (!options->repetitions)
+            {
+                printf("ERROR::BAD_OPTION_VALUE: %s -> Must be Non-Zero INTEGER\n", option);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strncmp(option, "--batch=", 8))
+        {
+            options->batchSize = atoi(option + 8);
+            if (!options->batchSize)
+            {
+                printf("ERROR::BAD_OPTION_VALUE: %s -> Must be Non-Zero INTEGER\n", option);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strncmp(option, "--bands=", 8))
+        {
+            options->bands = atoi(option + 8);
+            if (!options->bands)
+            {
+                printf("ERROR::BAD_OPTION_VALUE: %s -> Must be Non-Zero INTEGER\n", option);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strncmp(option, "--thumbnails=", 13))
+        {
+            options->thumbnails = atoi(option + 13);
+            if (!options->thumbnails)
+            {
+                printf("ERROR::BAD_OPTION_VALUE: %s -> Must be Non-Zero INTEGER\n", option);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strncmp(option, "--local-size=", 13))
+        {
+            unsigned int x, y;
+            if (sscanf(option + 13, "%ux%u", &x, &y) != 2 || !x || !y)
+            {
+                printf("ERROR::BAD_OPTION_VALUE: %s -> Must be WxH (e.g. 8x8, 16x4)\n", option);
+                exit(EXIT_FAILURE);
+            }
+            options->localSize[0] = x;
+            options->localSize[1] = y;
+        }
+        else if (!strncmp(option, "--progressive=", 14))
+        {
+            options->launches = atoi(option + 14);
+            if (!options->launches)
+            {
+                printf("ERROR::BAD_OPTION_VALUE: %s -> Must be Non-Zero INTEGER\n", option);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strncmp(option, "--readback-every=", 17))
+            options->readbackInterval = atoi(option + 17);
+        else
+        {
+            printf("ERROR::BAD_OPTION: %s\n", option);
+            printf("Options: --autotune --bench --scaling --pin=none|close|spread --quality --time-budget=MS --microbench --compare[=BASELINE] --threshold=PERCENT --warmup=RUNS --reps=RUNS --zero-copy[=alloc|use] --kernel=megakernel|wavefront|persistent|float4|half --validate --hetero --multi-device --stats --timeline[=PATH] --batch=PIXELS --bands=BANDS --mem-budget=MiB --thumbnails=IMAGES --accel=auto|none|bvh --sphere-memory=auto|global|constant|local --seed=SEED --local-size=WxH --progressive=LAUNCHES --readback-every=LAUNCHES\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#include "packed_scene.h"
+
+#include <string.h>
+
+static cl_float4 packVec3(const vec3_t* v, const float w)
+{
+    cl_float4 packed;
+    packed.s[0] = v->x;
+    packed.s[1] = v->y;
+    packed.s[2] = v->z;
+    packed.s[3] = w;
+    return packed;
+}
+
+void packSpheres(sphere4_t *packedSpheres, const sphere_t *spheres, const uint16_t numberOfSpheres)
+{
+    uint16_t k;
+    for (k = 0; k < numberOfSpheres; k++)
+    {
+        const vec3_t albedo = { spheres[k].albedo.r, spheres[k].albedo.g, spheres[k].albedo.b };
+        memset(&packedSpheres[k], 0, sizeof(sphere4_t));
+        packedSpheres[k].positionRadius = packVec3(&spheres[k].position, spheres[k].radius);
+        packedSpheres[k].albedoParameter = packVec3(&albedo, spheres[k].roughness);
+        packedSpheres[k].material = spheres[k].material;
+    }
+}
+
+camera4_t packCamera(const camera_t *camera)
+{
+    camera4_t packedCamera;
+    memset(&packedCamera, 0, sizeof(packedCamera));
+    packedCamera.lookFrom = packVec3(&camera->lookFrom, 0.0f);
+    packedCamera.viewportUpperLeft = packVec3(&camera->viewportUpperLeft, 0.0f);
+    packedCamera.step_u = packVec3(&camera->step_u, 0.0f);
+    packedCamera.step_v = packVec3(&camera->step_v, 0.0f);
+    packedCamera.defocus_disk_u = packVec3(&camera->defocus_disk_u, 0.0f);
+    packedCamera.defocus_disk_v = packVec3(&camera->defocus_disk_v, 0.0f);
+    packedCamera.defocusAngle = camera->defocusAngle;
+    return packedCamera;
+}
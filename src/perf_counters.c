@@ -0,0 +1,109 @@
+#include "perf_counters.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "utils.h"
+
+static const uint64_t PERF_CONFIGS[PERF_NUMBER_OF_EVENTS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+static const char* PERF_NAMES[PERF_NUMBER_OF_EVENTS] = { "cycles", "instructions", "cache misses", "branch misses" };
+
+// -1: event not available (no PMU in containers & VMs, perf_event_paranoid, ...)
+static int perfFds[PERF_NUMBER_OF_EVENTS] = { -1, -1, -1, -1 };
+
+void initializePerfCounters(void)
+{
+    uint8_t event;
+    for (event = 0; event < PERF_NUMBER_OF_EVENTS; event++)
+    {
+        // Not grouped: inherited counters cannot be read as a group. User space only (allowed up to perf_event_paranoid 2)
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_CONFIGS[event];
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        perfFds[event] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (perfFds[event] < 0)
+            printf("WARNING::PERF_COUNTER_UNAVAILABLE: %s (%s)%s\n", PERF_NAMES[event], strerror(errno),
+                   event == PERF_CYCLES ? ", time per pixel reported instead of cycles" : "");
+    }
+}
+
+void releasePerfCounters(void)
+{
+    uint8_t event;
+    for (event = 0; event < PERF_NUMBER_OF_EVENTS; event++)
+    {
+        if (perfFds[event] >= 0)
+            close(perfFds[event]);
+        perfFds[event] = -1;
+    }
+}
+
+uint8_t isPerfEventAvailable(const perfEvent_t event)
+{
+    return perfFds[event] >= 0;
+}
+
+// Count scaled by the share of time the event was on the PMU (multiplexing when there are more events than counters)
+static uint64_t readPerfEvent(const perfEvent_t event)
+{
+    uint64_t values[3];     // Value, time enabled, time running
+    if (perfFds[event] < 0 || read(perfFds[event], values, sizeof(values)) != sizeof(values))
+        return 0;
+    if (values[2] && values[2] < values[1])
+        return (uint64_t)((double)values[0] * values[1] / values[2]);
+    return values[0];
+}
+
+void startPerfPhase(perfPhase_t *phase)
+{
+    startMemoryPhase(&phase->memory);
+    uint8_t event;
+    for (event = 0; event < PERF_NUMBER_OF_EVENTS; event++)
+        phase->counts[event] = readPerfEvent(event);
+    phase->time = monotonicTime();
+}
+
+void stopPerfPhase(perfPhase_t *phase)
+{
+    phase->time = monotonicTime() - phase->time;
+    uint8_t event;
+    for (event = 0; event < PERF_NUMBER_OF_EVENTS; event++)
+        phase->counts[event] = readPerfEvent(event) - phase->counts[event];
+    stopMemoryPhase(&phase->memory);
+}
+
+static void reportMemoryPhase(const char* name, const perfPhase_t* phase)
+{
+    printf("Peak memory: host %.1f MiB, device %.1f MiB [%s]\n", phase->memory.peak[MEMORY_HOST] / 1048576.0, phase->memory.peak[MEMORY_DEVICE] / 1048576.0, name);
+}
+
+void reportPerfPhase(const char *name, const perfPhase_t *phase, const uint32_t numberOfPixels)
+{
+    if (!isPerfEventAvailable(PERF_CYCLES))
+    {
+        printf("Cycles per pixel: n/a, %f ns per pixel [%s]\n", phase->time * 1e3 / numberOfPixels, name);
+        reportMemoryPhase(name, phase);
+        return;
+    }
+
+    const uint64_t cycles = phase->counts[PERF_CYCLES];
+    printf("Cycles per pixel: %f [%s: %lu cycles", (double)cycles / numberOfPixels, name, cycles);
+    if (isPerfEventAvailable(PERF_INSTRUCTIONS))
+        printf(", %lu instructions, IPC %.2f", phase->counts[PERF_INSTRUCTIONS], cycles ? (double)phase->counts[PERF_INSTRUCTIONS] / cycles : 0.0);
+    if (isPerfEventAvailable(PERF_CACHE_MISSES))
+        printf(", %lu cache misses", phase->counts[PERF_CACHE_MISSES]);
+    if (isPerfEventAvailable(PERF_BRANCH_MISSES))
+        printf(", %lu branch misses", phase->counts[PERF_BRANCH_MISSES]);
+    printf("]\n");
+    reportMemoryPhase(name, phase);
+}
@@ -0,0 +1,139 @@
+#include "png_stream.h"
+
+#include <stdlib.h>
+
+#include "utils.h"
+#include "memory_tracker.h"
+
+// Largest stored deflate block
+#define STORED_BLOCK_SIZE 65535
+#define ADLER_MODULO 65521
+
+static uint32_t crcTable[256];
+
+static void initializeCrcTable(void)
+{
+    uint32_t n, k;
+    for (n = 0; n < 256; n++)
+    {
+        uint32_t c = n;
+        for (k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crcTable[n] = c;
+    }
+}
+
+static void writeBytes(pngStream_t* stream, const uint8_t* bytes, const size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i++)
+        stream->crc = crcTable[(stream->crc ^ bytes[i]) & 0xFF] ^ (stream->crc >> 8);
+    fwrite(bytes, 1, size, stream->file);
+}
+
+static void writeU32(pngStream_t* stream, const uint32_t value)
+{
+    const uint8_t bytes[4] = { value >> 24, value >> 16, value >> 8, value };
+    writeBytes(stream, bytes, 4);
+}
+
+// Length & type, then the data through writeBytes(), then endChunk()
+static void beginChunk(pngStream_t* stream, const uint32_t length, const char* type)
+{
+    writeU32(stream, length);
+    stream->crc = 0xFFFFFFFFu;
+    writeBytes(stream, (const uint8_t*)type, 4);
+}
+
+static void endChunk(pngStream_t* stream)
+{
+    writeU32(stream, stream->crc ^ 0xFFFFFFFFu);
+}
+
+// Stored blocks of one row
+static uint32_t rowBlocks(const pngStream_t* stream)
+{
+    return (1 + 3u * stream->width + STORED_BLOCK_SIZE - 1) / STORED_BLOCK_SIZE;
+}
+
+void openPngStream(pngStream_t *stream, const char *filename, const uint16_t width, const uint16_t height)
+{
+    stream->file = fopen(filename, "wb");
+    if (!stream->file)
+    {
+        printf("ERROR::CANNOT_WRITE_IMAGE: %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    if (!crcTable[1])
+        initializeCrcTable();
+    stream->width = width;
+    stream->rowsLeft = height;
+    stream->adler = 1;
+    stream->row = trackedMalloc(1 + 3u * width);
+    stream->row[0] = 0;    // Filter: none
+
+    static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    fwrite(SIGNATURE, 1, sizeof(SIGNATURE), stream->file);
+
+    // 8 bits RGB, deflate, no interlace
+    const uint8_t header[5] = { 8, 2, 0, 0, 0 };
+    beginChunk(stream, 13, "IHDR");
+    writeU32(stream, width);
+    writeU32(stream, height);
+    writeBytes(stream, header, sizeof(header));
+    endChunk(stream);
+
+    // zlib header: deflate, 32 KiB window, no preset dictionary (check bits: 0x7801 % 31 == 0)
+    const uint8_t zlibHeader[2] = { 0x78, 0x01 };
+    beginChunk(stream, sizeof(zlibHeader), "IDAT");
+    writeBytes(stream, zlibHeader, sizeof(zlibHeader));
+    endChunk(stream);
+}
+
+void writePngStreamRows(pngStream_t *stream, const color_t *rows, const uint16_t numberOfRows)
+{
+    const uint32_t rowSize = 1 + 3u * stream->width;
+    beginChunk(stream, numberOfRows * (rowSize + 5 * rowBlocks(stream)), "IDAT");
+
+    uint16_t rowIdx;
+    for (rowIdx = numberOfRows; rowIdx-- > 0;)
+    {
+        imageLinearToGammaU8(rows + (size_t)rowIdx * stream->width, (color_u8_t*)(stream->row + 1), stream->width);
+
+        uint32_t i, a = stream->adler & 0xFFFF, b = stream->adler >> 16;
+        for (i = 0; i < rowSize; i++)
+        {
+            a = (a + stream->row[i]) % ADLER_MODULO;
+            b = (b + a) % ADLER_MODULO;
+        }
+        stream->adler = (b << 16) | a;
+
+        // Stored blocks: final flag, little endian length & its complement
+        stream->rowsLeft--;
+        uint32_t offset;
+        for (offset = 0; offset < rowSize; offset += STORED_BLOCK_SIZE)
+        {
+            const uint16_t size = (rowSize - offset < STORED_BLOCK_SIZE) ? rowSize - offset : STORED_BLOCK_SIZE;
+            const uint8_t isFinal = !stream->rowsLeft && offset + size == rowSize;
+            const uint8_t blockHeader[5] = { isFinal, size & 0xFF, size >> 8, ~size & 0xFF, (~size >> 8) & 0xFF };
+            writeBytes(stream, blockHeader, sizeof(blockHeader));
+            writeBytes(stream, stream->row + offset, size);
+        }
+    }
+    endChunk(stream);
+}
+
+void closePngStream(pngStream_t *stream)
+{
+    if (stream->rowsLeft)
+        printf("WARNING::PNG_STREAM_INCOMPLETE: %u rows missing\n", stream->rowsLeft);
+
+    beginChunk(stream, 4, "IDAT");
+    writeU32(stream, stream->adler);
+    endChunk(stream);
+    beginChunk(stream, 0, "IEND");
+    endChunk(stream);
+
+    fclose(stream->file);
+    trackedFree(stream->row);
+}
@@ -0,0 +1,151 @@
+#include "quality.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "raytracing_openCL.h"
+#include "raytracing.h"
+#include "camera.h"
+#include "sphere.h"
+#include "utils.h"
+#include "bench.h"
+
+typedef struct qualityCandidate_t
+{
+    const char* name;
+    uint8_t isCPU;
+    kernelVariant_t kernel;
+    uint8_t raysDepth;      // 0: depth of the reference
+} qualityCandidate_t;
+
+// CPU vs. OpenCL kernels, full vs. short paths (the bias of the depth limit against the samples it saves)
+static const qualityCandidate_t CANDIDATES[] = {
+    { "CPU", 1, KERNEL_MEGAKERNEL, 0 },
+    { "CPU depth 5", 1, KERNEL_MEGAKERNEL, 5 },
+    { "OpenCL megakernel", 0, KERNEL_MEGAKERNEL, 0 },
+    { "OpenCL megakernel depth 5", 0, KERNEL_MEGAKERNEL, 5 },
+    { "OpenCL persistent", 0, KERNEL_PERSISTENT, 0 },
+    { "OpenCL float4", 0, KERNEL_FLOAT4, 0 },
+    { "OpenCL half", 0, KERNEL_HALF, 0 }
+};
+static const char* KERNEL_NAMES[] = { "megakernel", "wavefront", "persistent", "float4", "half" };
+
+#define NUMBER_OF_CANDIDATES (sizeof(CANDIDATES) / sizeof(CANDIDATES[0]))
+
+// Reference of the scene from its cache file, else rendered & saved
+static void referenceImage(color_t* reference, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const uint8_t sqrtNumberOfSpheres, const uint32_t seed, const camera_t* camera, const options_t* options)
+{
+    const size_t numberOfPixels = (size_t)width * height;
+    // Keyed on the kernel & its build (default options, first sample): a reference of another build is never reused
+    char path[192];
+    snprintf(path, sizeof(path), "quality_reference_megakernel_default_build_base_%u_%ux%u_%u_spheres_%u_spp_%u_depth_seed_%u.bin",
+             QUALITY_REFERENCE_SAMPLE_BASE, width, height, sqrtNumberOfSpheres, raysPerPixel, raysDepth, seed);
+
+    FILE* file = fopen(path, "rb");
+    if (file)
+    {
+        const size_t readPixels = fread(reference, sizeof(color_t), numberOfPixels, file);
+        fclose(file);
+        if (readPixels == numberOfPixels)
+        {
+            printf("Quality reference: %s\n", path);
+            return;
+        }
+        printf("WARNING::BAD_QUALITY_REFERENCE: %s, rendered again\n", path);
+    }
+
+    // Brute force megakernel, launches short enough for the device watchdogs
+    options_t referenceOptions = *options;
+    referenceOptions.kernel = KERNEL_MEGAKERNEL;
+    referenceOptions.zeroCopy = ZERO_COPY_NONE;
+    referenceOptions.launches = (raysPerPixel + QUALITY_REFERENCE_LAUNCH_SPP - 1) / QUALITY_REFERENCE_LAUNCH_SPP;
+    referenceOptions.readbackInterval = 0;
+    referenceOptions.isRayStats = 0;
+    referenceOptions.isProfileIgnored = 1;
+    referenceOptions.sampleSeedBase = QUALITY_REFERENCE_SAMPLE_BASE;
+
+    printf("Quality reference: %u spp, depth %u\n", raysPerPixel, raysDepth);
+    openCL_t openCL;
+    initializeOpenCL(&openCL, &referenceOptions);
+    raytracing_openCL(&openCL, reference, width, height, raysPerPixel, raysDepth, spheres, numberOfSpheres, camera, &referenceOptions);
+    releaseOpenCL(&openCL);
+
+    file = fopen(path, "wb");
+    if (!file || fwrite(reference, sizeof(color_t), numberOfPixels, file) != numberOfPixels)
+        printf("WARNING::CANNOT_WRITE_QUALITY_REFERENCE: %s\n", path);
+    if (file)
+        fclose(file);
+}
+
+int quality(const uint16_t width, const uint16_t height, const uint16_t referenceRaysPerPixel, const uint8_t referenceRaysDepth, const uint8_t sqrtNumberOfSpheres, const options_t *options)
+{
+    const uint32_t seed = options->isSeedSet ? options->seed : BENCH_SEED;
+    const uint32_t maxBudget = options->timeBudget ? options->timeBudget : QUALITY_TIME_BUDGET;
+    const uint32_t numberOfPixels = (uint32_t)width * height;
+    const uint16_t numberOfSpheres = sqrtNumberOfSpheres * sqrtNumberOfSpheres + 4;
+    sphere_t* spheres = malloc(numberOfSpheres * sizeof(sphere_t));
+    srand(seed);
+    initializeSpheres(spheres, sqrtNumberOfSpheres);
+    const camera_t camera = initializeCamera(width, height);
+
+    color_t* reference = malloc(numberOfPixels * sizeof(color_t));
+    color_t* image = malloc(numberOfPixels * sizeof(color_t));
+    referenceImage(reference, width, height, referenceRaysPerPixel, referenceRaysDepth, spheres, numberOfSpheres, sqrtNumberOfSpheres, seed, &camera, options);
+
+    FILE* resultFile = fopen(QUALITY_RESULT_PATH, "w");
+    if (!resultFile)
+    {
+        printf("ERROR::CANNOT_WRITE_QUALITY_RESULT: %s\n", QUALITY_RESULT_PATH);
+        free(image);
+        free(reference);
+        free(spheres);
+        return EXIT_FAILURE;
+    }
+    fprintf(resultFile, "candidate;device;kernel;rays_depth;budget_ms;spp;time;rmse;psnr;relmse\n");
+    printf("Quality %ux%u, %u spheres: budgets up to %u ms, results in %s\n", width, height, numberOfSpheres, maxBudget, QUALITY_RESULT_PATH);
+
+    uint8_t candidateIdx, budgetIdx;
+    for (candidateIdx = 0; candidateIdx < NUMBER_OF_CANDIDATES; candidateIdx++)
+    {
+        const qualityCandidate_t* candidate = &CANDIDATES[candidateIdx];
+        const uint8_t raysDepth = candidate->raysDepth ? candidate->raysDepth : referenceRaysDepth;
+        options_t candidateOptions = *options;
+        candidateOptions.kernel = candidate->kernel;
+        candidateOptions.isRayStats = 0;
+        openCL_t openCL;
+        if (!candidate->isCPU)
+            initializeOpenCL(&openCL, &candidateOptions);
+
+        for (budgetIdx = 0; budgetIdx < QUALITY_BUDGET_STEPS; budgetIdx++)
+        {
+            // Shortest budget first
+            const uint32_t budget = maxBudget >> (QUALITY_BUDGET_STEPS - 1 - budgetIdx);
+            const uint64_t start = monotonicTime();
+            const uint32_t samples = candidate->isCPU
+                ? raytracingBudget(image, width, height, raysDepth, spheres, numberOfSpheres, &camera, budget * 1000ull, NULL)
+                : raytracingBudget_openCL(&openCL, image, width, height, raysDepth, spheres, numberOfSpheres, &camera, budget * 1000ull, &candidateOptions);
+            const uint64_t elapsedTime = monotonicTime() - start;
+
+            // PSNR of the linear image, peak 1
+            float maxError;
+            const float rmse = imageRMSE(image, reference, numberOfPixels, &maxError);
+            const double psnr = rmse > 0.0f ? -20.0 * log10(rmse) : INFINITY;
+            const float relativeMSE = imageRelativeMSE(image, reference, numberOfPixels);
+
+            printf("%-26s %5u ms: %6u spp in %8lu us, RMSE %e, PSNR %6.2f dB, relMSE %e\n", candidate->name, budget, samples, elapsedTime, rmse, psnr, relativeMSE);
+            fprintf(resultFile, "%s;%s;%s;%u;%u;%u;%lu;%e;%f;%e\n", candidate->name, candidate->isCPU ? "cpu" : "opencl", candidate->isCPU ? "-" : KERNEL_NAMES[candidate->kernel],
+                    raysDepth, budget, samples, elapsedTime, rmse, psnr, relativeMSE);
+            fflush(resultFile);
+        }
+
+        if (!candidate->isCPU)
+            releaseOpenCL(&openCL);
+    }
+
+    fclose(resultFile);
+    free(image);
+    free(reference);
+    free(spheres);
+    return EXIT_SUCCESS;
+}
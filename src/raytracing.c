@@ -3,146 +3,315 @@
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <omp.h>
 
 #include "utils.h"
+#include "timeline.h"
+#include "png_stream.h"
+#include "memory_tracker.h"
 
-void raytracing(color_t* image, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera)
+void raytracing(color_t* image, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, cpuRayStats_t* stats)
+{
+    raytracingRows(image, width, 0, height, raysPerPixel, raysDepth, spheres, numberOfSpheres, camera, 0, stats);
+}
+
+// Row j of the image (its pixels in row). Always inlined with a constant counters argument, so that the NULL (not counted)
+// copy has no trace of the counters
+static inline __attribute__((always_inline)) void traceRow(color_t* row, const uint16_t width, const uint16_t j, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint32_t sampleOffset, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, cpuRayCounters_t* counters)
 {
     // Rays weight
-    const float inv_raysPerPixel = 1.0f / raysPerPixel;
-    
-    uint16_t i, j, k, rayIdx, depthIdx;
-    #pragma omp parallel for schedule(dynamic) private(i, k, rayIdx, depthIdx)
-    for (j = 0; j < height; j++)
+    const float inv_numberOfSamples = 1.0f / (sampleOffset + raysPerPixel);
+
+    uint16_t i, k, rayIdx, depthIdx;
+    for (i = 0; i < width; i++)
     {
-        for (i = 0; i < width; i++)
+        // Pixel initialisation (other random streams for the next passes of a progressive render)
+        color_t pixelColor = (color_t){ 0.0f, 0.0f, 0.0f };
+        uint32_t seed = (i  + width * j) ^ (sampleOffset * 0x9E3779B9u);
+
+        for (rayIdx = 0; rayIdx < raysPerPixel; rayIdx++)
         {
-            // Pixel initialisation
-            color_t pixelColor = (color_t){ 0.0f, 0.0f, 0.0f };
-            uint32_t seed = i  + width * j;
+            // Pixel position (Ray position in viewport plane)
+            vec3_t pixelPosition_u = vec3_scalarMul_return(&camera->step_u, i + randomFloatInUnitInterval(&seed));
+            vec3_t pixelPosition_v = vec3_scalarMul_return(&camera->step_v, j + randomFloatInUnitInterval(&seed));
+            vec3_t pixelPosition = camera->viewportUpperLeft;
+            pixelPosition = vec3_add(&pixelPosition, &pixelPosition_u);
+            pixelPosition = vec3_add(&pixelPosition, &pixelPosition_v);
 
-            for (rayIdx = 0; rayIdx < raysPerPixel; rayIdx++)
+            // Ray Initialisation
+            vec3_t rayPosition = (camera->defocusAngle <= 0.0f) ? camera->lookFrom : randomDefocusedRayPosition(&seed, &camera->lookFrom, &camera->defocus_disk_u, &camera->defocus_disk_v);
+            vec3_t rayDirection = vec3_sub(&pixelPosition, &rayPosition);
+            color_t rayColor = { 1.0f, 1.0f, 1.0f };
+            if (counters)
+                counters->samples++;
+
+            // Bounce loop
+            uint8_t isSkyHit = 0;
+            for (depthIdx = 0; depthIdx < raysDepth && !isSkyHit; depthIdx++)
             {
-                // Pixel position (Ray position in viewport plane)
-                vec3_t pixelPosition_u = vec3_scalarMul_return(&camera->step_u, i + randomFloatInUnitInterval(&seed));
-                vec3_t pixelPosition_v = vec3_scalarMul_return(&camera->step_v, j + randomFloatInUnitInterval(&seed));
-                vec3_t pixelPosition = camera->viewportUpperLeft;
-                pixelPosition = vec3_add(&pixelPosition, &pixelPosition_u);
-                pixelPosition = vec3_add(&pixelPosition, &pixelPosition_v);
-
-                // Ray Initialisation
-                vec3_t rayPosition = (camera->defocusAngle <= 0.0f) ? camera->lookFrom : randomDefocusedRayPosition(&seed, &camera->lookFrom, &camera->defocus_disk_u, &camera->defocus_disk_v);
-                vec3_t rayDirection = vec3_sub(&pixelPosition, &rayPosition);
-                color_t rayColor = { 1.0f, 1.0f, 1.0f };
-
-                // Bounce loop
-                uint8_t isSkyHit = 0;
-                for (depthIdx = 0; depthIdx < raysDepth && !isSkyHit; depthIdx++)
+                // Iterate through spheres to get the closest one
+                float closestSphereDistance = INFINITY;
+                int16_t closestSphereIndex = -1;
+                if (counters)
                 {
-                    // Iterate through spheres to get the closest one
-                    float closestSphereDistance = INFINITY;
-                    int16_t closestSphereIndex = -1;
-                    for (k = 0; k < numberOfSpheres; k++)
-                    {   
-                        // Maths (line == sphere equation)
-                        vec3_t originToCenter = vec3_sub(&rayPosition, &spheres[k].position);
-                        float a = vec3_dot(&rayDirection, &rayDirection);
-                        float half_b = vec3_dot(&originToCenter, &rayDirection);
-                        float c = vec3_dot(&originToCenter, &originToCenter) - spheres[k].radius * spheres[k].radius;
-                        float delta = half_b*half_b - a*c;
-
-                        // 1 or 2 solutions => sphere hit
-                        if (delta >= 0)
-                        {
-                            float newDistance = (-half_b - sqrtf(delta))/ a;
-
-                            // Ignore digital noise
-                            if (newDistance <=  0.001f)
-                                continue;
-
-                            // Update sphere
-                            if (newDistance < closestSphereDistance)
-                            {
-                                closestSphereDistance = newDistance;
-                                closestSphereIndex = k;
-                            }
-                        }
+                    counters->rays++;
+                    counters->sphereTests += numberOfSpheres;
+                }
+                for (k = 0; k < numberOfSpheres; k++)
+                {   
+                    // Update sphere
+                    const float newDistance = raySphereDistance(&rayPosition, &rayDirection, &spheres[k]);
+                    if (newDistance < closestSphereDistance)
+                    {
+                        closestSphereDistance = newDistance;
+                        closestSphereIndex = k;
                     }
+                }
 
-                    // If sphere hit, else sky hit
-                    if (closestSphereIndex != -1)
-                    {
-                        // Ray-sphere hit position
-                        vec3_t hitPosition = vec3_scalarMul_return(&rayDirection, closestSphereDistance);
-                        hitPosition = vec3_add(&rayPosition, &hitPosition);
+                // If sphere hit, else sky hit
+                if (closestSphereIndex != -1)
+                {
+                    // Ray-sphere hit position
+                    vec3_t hitPosition = vec3_scalarMul_return(&rayDirection, closestSphereDistance);
+                    hitPosition = vec3_add(&rayPosition, &hitPosition);
 
-                        // Get sphere normal on hit position
-                        vec3_t sphereNormal = vec3_sub(&hitPosition, &spheres[closestSphereIndex].position);
-                        vec3_scalarMul(&sphereNormal, 1.0f / spheres[closestSphereIndex].radius);   
+                    // Get sphere normal on hit position
+                    vec3_t sphereNormal = vec3_sub(&hitPosition, &spheres[closestSphereIndex].position);
+                    vec3_scalarMul(&sphereNormal, 1.0f / spheres[closestSphereIndex].radius);   
 
-                        // Which face hit ?
-                        uint8_t isFrontFace = vec3_dot(&rayDirection, &sphereNormal) > 0 ? 0 : 1;
+                    // Which face hit ?
+                    uint8_t isFrontFace = vec3_dot(&rayDirection, &sphereNormal) > 0 ? 0 : 1;
 
-                        // The ray hit a sphere => Update ray position + direction & add color info
-                        rayPosition = hitPosition;
-                        switch (spheres[closestSphereIndex].material)
-                        {
-                            case LAMBERTIAN:
-                                // Bad hemisphere diffusion  
-                                // rayDirection = randomInHemisphere(&seed, &sphereNormal); 
-                                
-                                // True Lambertian diffusion
-                                rayDirection = randomUnitVector(&seed);
-                                vec3_scalarMul(&rayDirection, spheres[closestSphereIndex].roughness);
-                                rayDirection = vec3_add(&rayDirection, &sphereNormal);      
-                                if (vec3_isNearZero(&rayDirection))
-                                    rayDirection = sphereNormal;
-                                break;
-                                
-                            case METAL:
-                            {
-                                vec3_t roughnessVector = randomUnitVector(&seed);
-                                vec3_scalarMul(&roughnessVector, spheres[closestSphereIndex].fuzziness);
-                                rayDirection = vec3_reflect(&rayDirection, &sphereNormal);
-                                rayDirection = vec3_add(&rayDirection, &roughnessVector);
-                                break;
-                            }
-
-                            case DIELECTRIC:
-                            {
-
-                                float refractionRatio = isFrontFace ? 1.0f / spheres[closestSphereIndex].refractionIndex : spheres[closestSphereIndex].refractionIndex;
-                                vec3_t uRayDirection = rayDirection;
-                                vec3_normalize(&uRayDirection);
-                                rayDirection = vec3_refract(&uRayDirection, &sphereNormal, refractionRatio, &seed);
-                                break;
-                            }
+                    // The ray hit a sphere => Update ray position + direction & add color info
+                    rayPosition = hitPosition;
+                    switch (spheres[closestSphereIndex].material)
+                    {
+                        case LAMBERTIAN:
+                            // Bad hemisphere diffusion  
+                            // rayDirection = randomInHemisphere(&seed, &sphereNormal); 
                             
-                            default:
-                                printf("ERROR::BAD_SPHERE_MATERIAL: %d\n", spheres[closestSphereIndex].material);
-                                exit(EXIT_FAILURE);
-                                break;
+                            // True Lambertian diffusion
+                            rayDirection = randomUnitVector(&seed);
+                            vec3_scalarMul(&rayDirection, spheres[closestSphereIndex].roughness);
+                            rayDirection = vec3_add(&rayDirection, &sphereNormal);      
+                            if (vec3_isNearZero(&rayDirection))
+                                rayDirection = sphereNormal;
+                            break;
+                            
+                        case METAL:
+                        {
+                            vec3_t roughnessVector = randomUnitVector(&seed);
+                            vec3_scalarMul(&roughnessVector, spheres[closestSphereIndex].fuzziness);
+                            rayDirection = vec3_reflect(&rayDirection, &sphereNormal);
+                            rayDirection = vec3_add(&rayDirection, &roughnessVector);
+                            break;
+                        }
+
+                        case DIELECTRIC:
+                        {
+
+                            float refractionRatio = isFrontFace ? 1.0f / spheres[closestSphereIndex].refractionIndex : spheres[closestSphereIndex].refractionIndex;
+                            vec3_t uRayDirection = rayDirection;
+                            vec3_normalize(&uRayDirection);
+                            rayDirection = vec3_refract(&uRayDirection, &sphereNormal, refractionRatio, &seed);
+                            break;
                         }
-                        rayColor = color_mul(&rayColor, &spheres[closestSphereIndex].albedo);
+                        
+                        default:
+                            printf("ERROR::BAD_SPHERE_MATERIAL: %d\n", spheres[closestSphereIndex].material);
+                            exit(EXIT_FAILURE);
+                            break;
                     }
-                    else
+                    rayColor = color_mul(&rayColor, &spheres[closestSphereIndex].albedo);
+                    if (counters)
+                        counters->materialHits[spheres[closestSphereIndex].material]++;
+                }
+                else
+                {
+                    // The ray hit the sky, the loop must stop
+                    isSkyHit = 1;
+                    if (counters)
                     {
-                        // The ray hit the sky, the loop must stop
-                        isSkyHit = 1;
-                        float skyGradiant = 0.5f * (rayDirection.y / vec3_magnitude(&rayDirection) + 1.0f);
-                        const color_t skyColor = (color_t){ (1.0f - skyGradiant)*1.0f + skyGradiant*0.5f, (1.0f - skyGradiant)*1.0f + skyGradiant*0.7f, (1.0f- skyGradiant)*1.0f + skyGradiant*1.0f };
-                        rayColor = color_mul(&rayColor, &skyColor);
+                        counters->skyHits++;
+                        counters->depth[depthIdx < CPU_RAY_STATS_DEPTH_BINS - 1 ? depthIdx : CPU_RAY_STATS_DEPTH_BINS - 1]++;
                     }
+                    float skyGradiant = 0.5f * (rayDirection.y / vec3_magnitude(&rayDirection) + 1.0f);
+                    const color_t skyColor = (color_t){ (1.0f - skyGradiant)*1.0f + skyGradiant*0.5f, (1.0f - skyGradiant)*1.0f + skyGradiant*0.7f, (1.0f- skyGradiant)*1.0f + skyGradiant*1.0f };
+                    rayColor = color_mul(&rayColor, &skyColor);
                 }
+            }
+
+            if (isSkyHit)
+                pixelColor = color_add(&pixelColor, &rayColor);
+            else 
+            {
+                pixelColor = color_add(&pixelColor, &BLACK);
+                if (counters)
+                    counters->truncated++;
+            }
+        }
+
+        // image holds the mean of the sampleOffset samples of the previous passes
+        if (sampleOffset != 0)
+        {
+            color_t previousColor = row[i];
+            color_scalarMul(&previousColor, (float)sampleOffset);
+            pixelColor = color_add(&pixelColor, &previousColor);
+        }
+        color_scalarMul(&pixelColor, inv_numberOfSamples);
+        row[i] = pixelColor;
+    }
+}
+
+#if CPU_RAY_STATS
+static void addCpuRayCounters(cpuRayCounters_t* counters, const cpuRayCounters_t* added)
+{
+    uint8_t k;
+    counters->samples += added->samples;
+    counters->rays += added->rays;
+    counters->sphereTests += added->sphereTests;
+    counters->skyHits += added->skyHits;
+    counters->truncated += added->truncated;
+    for (k = 0; k < NUMBER_OF_MATERIAL; k++)
+        counters->materialHits[k] += added->materialHits[k];
+    for (k = 0; k < CPU_RAY_STATS_DEPTH_BINS; k++)
+        counters->depth[k] += added->depth[k];
+}
+#endif
+
+void raytracingRows(color_t* image, const uint16_t width, const uint16_t firstRow, const uint16_t numberOfRows, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, const uint32_t sampleOffset, cpuRayStats_t* stats)
+{
+    raytracingBand(image + (size_t)firstRow * width, width, firstRow, numberOfRows, raysPerPixel, raysDepth, spheres, numberOfSpheres, camera, sampleOffset, stats);
+}
+
+void raytracingBand(color_t* band, const uint16_t width, const uint16_t firstRow, const uint16_t numberOfRows, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, const uint32_t sampleOffset, cpuRayStats_t* stats)
+{
+    const uint16_t lastRow = firstRow + numberOfRows;
+    // --timeline: one span per row on the row of its thread (stragglers & idle threads at the end of the frame)
+    const uint8_t isTimeline = isTimelineEnabled();
+
+    #pragma omp parallel
+    {
+        uint16_t j;
+#if CPU_RAY_STATS
+        if (stats)
+        {
+            // Thread-local counters, merged once the thread has no row left
+            cpuRayCounters_t counters;
+            memset(&counters, 0, sizeof(counters));
+            #pragma omp for schedule(dynamic)
+            for (j = firstRow; j < lastRow; j++)
+            {
+                const uint64_t rowBegin = isTimeline ? timelineNow() : 0;
+                traceRow(band + (size_t)(j - firstRow) * width, width, j, raysPerPixel, raysDepth, sampleOffset, spheres, numberOfSpheres, camera, &counters);
+                if (isTimeline)
+                    recordTimelineSpan("row", rowBegin, timelineNow(), j);
+            }
 
-                if (isSkyHit)
-                    pixelColor = color_add(&pixelColor, &rayColor);
-                else 
-                    pixelColor = color_add(&pixelColor, &BLACK);
+            const uint16_t thread = omp_get_thread_num() < CPU_RAY_STATS_MAX_THREADS ? omp_get_thread_num() : CPU_RAY_STATS_MAX_THREADS - 1;
+            #pragma omp critical
+            {
+                addCpuRayCounters(&stats->threads[thread], &counters);
+                addCpuRayCounters(&stats->total, &counters);
+                if (thread >= stats->numberOfThreads)
+                    stats->numberOfThreads = thread + 1;
             }
-            color_scalarMul(&pixelColor, inv_raysPerPixel);
-            image[i + j * width] = pixelColor;
         }
+        else
+#endif
+        {
+            #pragma omp for schedule(dynamic)
+            for (j = firstRow; j < lastRow; j++)
+            {
+                const uint64_t rowBegin = isTimeline ? timelineNow() : 0;
+                traceRow(band + (size_t)(j - firstRow) * width, width, j, raysPerPixel, raysDepth, sampleOffset, spheres, numberOfSpheres, camera, NULL);
+                if (isTimeline)
+                    recordTimelineSpan("row", rowBegin, timelineNow(), j);
+            }
+        }
+    }
+}
+
+void raytracingStreamed(const char* filename, const uint16_t width, const uint16_t height, const uint16_t bandRows, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, cpuRayStats_t* stats)
+{
+    color_t* band = trackedMalloc((size_t)width * bandRows * sizeof(color_t));
+    pngStream_t stream;
+    openPngStream(&stream, filename, width, height);
+
+    // Top band first (PNG row order)
+    const uint16_t numberOfBands = (height + bandRows - 1) / bandRows;
+    uint16_t bandIdx;
+    for (bandIdx = numberOfBands; bandIdx-- > 0;)
+    {
+        const uint16_t firstRow = bandIdx * bandRows;
+        const uint16_t rows = (height - firstRow < bandRows) ? height - firstRow : bandRows;
+        raytracingBand(band, width, firstRow, rows, raysPerPixel, raysDepth, spheres, numberOfSpheres, camera, 0, stats);
+        writePngStreamRows(&stream, band, rows);
+    }
+
+    closePngStream(&stream);
+    trackedFree(band);
+}
+
+uint32_t raytracingBudget(color_t* image, const uint16_t width, const uint16_t height, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const camera_t* camera, const uint64_t timeBudget, cpuRayStats_t* stats)
+{
+    const uint64_t start = monotonicTime();
+    uint32_t sampleOffset = 0;
+    uint16_t passSamples = 1;
+    while (passSamples)
+    {
+        const uint64_t passStart = monotonicTime();
+        raytracingRows(image, width, 0, height, passSamples, raysDepth, spheres, numberOfSpheres, camera, sampleOffset, stats);
+        sampleOffset += passSamples;
+
+        const uint64_t now = monotonicTime();
+        passSamples = nextPassSamples(now - start, timeBudget, now - passStart, passSamples);
+    }
+    return sampleOffset;
+}
+
+void resetCpuRayStats(cpuRayStats_t* stats)
+{
+    memset(stats, 0, sizeof(cpuRayStats_t));
+}
+
+void reportCpuRayStats(const cpuRayStats_t* stats)
+{
+    const cpuRayCounters_t* total = &stats->total;
+    uint16_t k;
+#if !CPU_RAY_STATS
+    printf("WARNING::CPU_RAY_STATS_NOT_BUILT: rebuild with make CPU_RAY_STATS=1 to count the CPU rays\n");
+    return;
+#endif
+    if (!total->samples || !total->rays)
+    {
+        printf("CPU ray stats: no samples counted\n");
+        return;
+    }
+
+    const uint64_t sphereHits = total->rays - total->skyHits;
+    printf("CPU ray stats: %lu samples, %lu rays (%.2f per sample), %lu sphere tests (%.1f per ray)\n",
+           total->samples, total->rays, (double)total->rays / total->samples, total->sphereTests, (double)total->sphereTests / total->rays);
+    printf("CPU ray stats: sky hits %.1f%%, truncated paths %.1f%%\n", 100.0 * total->skyHits / total->samples, 100.0 * total->truncated / total->samples);
+    printf("CPU ray stats: sphere hits lambertian %.1f%%, metal %.1f%%, dielectric %.1f%%\n",
+           sphereHits ? 100.0 * total->materialHits[LAMBERTIAN] / sphereHits : 0.0, sphereHits ? 100.0 * total->materialHits[METAL] / sphereHits : 0.0,
+           sphereHits ? 100.0 * total->materialHits[DIELECTRIC] / sphereHits : 0.0);
+    printf("CPU ray stats: bounces before the sky:");
+    for (k = 0; k < CPU_RAY_STATS_DEPTH_BINS; k++)
+        if (total->depth[k])
+            printf(" %u%s:%.1f%%", k, k == CPU_RAY_STATS_DEPTH_BINS - 1 ? "+" : "", 100.0 * total->depth[k] / total->samples);
+    printf("\n");
+
+    // Share of the rays of each thread: the load balance of the dynamic schedule in traced work
+    uint64_t maxRays = 0;
+    for (k = 0; k < stats->numberOfThreads; k++)
+    {
+        const cpuRayCounters_t* thread = &stats->threads[k];
+        printf("CPU ray stats: thread %u: %lu samples, %lu rays (%.1f%%), sky hits %.1f%%\n", k, thread->samples, thread->rays,
+               100.0 * thread->rays / total->rays, thread->samples ? 100.0 * thread->skyHits / thread->samples : 0.0);
+        if (thread->rays > maxRays)
+            maxRays = thread->rays;
     }
+    printf("CPU ray stats: %u threads, busiest thread %.2fx the mean rays\n", stats->numberOfThreads, (double)maxRays * stats->numberOfThreads / total->rays);
 }
@@ -1,136 +1,872 @@
 #include "raytracing_openCL.h"
 
 #include <stdio.h>
-#include <CL/cl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
 
-void raytracing_openCL(color_t *image, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t *spheres, const uint16_t numberOfSpheres, const camera_t *camera)
+#include "autotune.h"
+#include "wavefront_openCL.h"
+#include "packed_scene.h"
+#include "utils.h"
+#include "perf_counters.h"
+#include "memory_tracker.h"
+#include "timeline.h"
+
+void initializeOpenCL(openCL_t *openCL, const options_t* options)
+{
+    // Getting platform and device information: first platform, default device
+    cl_platform_id platformId;
+    cl_device_id deviceID;
+    cl_uint retNumDevices;
+    cl_uint retNumPlatforms;
+    cl_int ret = clGetPlatformIDs(1, &platformId, &retNumPlatforms);
+    if (ret != CL_SUCCESS || !retNumPlatforms)
+    {
+        printf("ERROR::OPENCL_NO_PLATFORM: %d\n", ret);
+        exit(EXIT_FAILURE);
+    }
+    ret = clGetDeviceIDs(platformId, CL_DEVICE_TYPE_DEFAULT, 1, &deviceID, &retNumDevices);
+    if (ret != CL_SUCCESS || !retNumDevices)
+    {
+        printf("ERROR::OPENCL_NO_DEVICE: %d\n", ret);
+        exit(EXIT_FAILURE);
+    }
+    if (initializeOpenCLDevice(openCL, platformId, deviceID, options) != CL_SUCCESS)
+        exit(EXIT_FAILURE);
+    nameTimelineDevice(openCL->timelineDevice, openCL->deviceName);
+}
+
+cl_int initializeOpenCLDevice(openCL_t *openCL, cl_platform_id platformId, cl_device_id deviceID, const options_t* options)
 {
     // Template found on "https://github.com/Abercus/openCL/"
-	// Load kernel from file kernel/raytracing.cl
+    // Load kernel from file kernel/raytracing_gpu.cl (or its float4 variant)
 
-	FILE *kernelFile;
-	char *kernelSource;
-	size_t kernelSize;
-    const char* path = "kernel/raytracing_gpu.cl";
+    FILE *kernelFile;
+    openCL->isPackedScene = options->kernel == KERNEL_FLOAT4;
+    const char* path = openCL->isPackedScene ? "kernel/raytracing_float4.cl" : "kernel/raytracing_gpu.cl";
 
-	kernelFile = fopen(path, "r");
+    kernelFile = fopen(path, "r");
 
-	if (!kernelFile) {
+    if (!kernelFile) {
 
-		fprintf(stderr, "No file named %s was found\n", path);
+        fprintf(stderr, "No file named %s was found\n", path);
 
-		exit(-1);
+        exit(-1);
 
-	}
-	fseek(kernelFile, 0, SEEK_END);
-	long fsize = ftell(kernelFile);
-	fseek(kernelFile, 0, SEEK_SET);  /* same as rewind(f); */
+    }
+    fseek(kernelFile, 0, SEEK_END);
+    long fsize = ftell(kernelFile);
+    fseek(kernelFile, 0, SEEK_SET);  /* same as rewind(f); */
 
-	kernelSource = (char*)malloc(fsize+1);
-	kernelSize = fread(kernelSource, 1, fsize, kernelFile);
-	fclose(kernelFile);
+    openCL->kernelSource = (char*)malloc(fsize+1);
+    openCL->kernelSize = fread(openCL->kernelSource, 1, fsize, kernelFile);
+    fclose(kernelFile);
 
-	// Getting platform and device information
-	cl_platform_id platformId = NULL;
-	cl_device_id deviceID = NULL;
-	cl_uint retNumDevices;
-	cl_uint retNumPlatforms;
-	cl_int ret = clGetPlatformIDs(1, &platformId, &retNumPlatforms);
-	ret = clGetDeviceIDs(platformId, CL_DEVICE_TYPE_DEFAULT, 1, &deviceID, &retNumDevices);
+    // Device information
+    cl_int ret;
+    openCL->platformId = platformId;
+    openCL->deviceID = deviceID;
+    clGetDeviceInfo(openCL->deviceID, CL_DEVICE_NAME, sizeof(openCL->deviceName), openCL->deviceName, NULL);
+    clGetDeviceInfo(openCL->deviceID, CL_DRIVER_VERSION, sizeof(openCL->driverVersion), openCL->driverVersion, NULL);
+    clGetDeviceInfo(openCL->deviceID, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(openCL->computeUnits), &openCL->computeUnits, NULL);
+    clGetDeviceInfo(openCL->deviceID, CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE, sizeof(openCL->maxConstantBufferSize), &openCL->maxConstantBufferSize, NULL);
+    clGetDeviceInfo(openCL->deviceID, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(openCL->localMemSize), &openCL->localMemSize, NULL);
+    clGetDeviceInfo(openCL->deviceID, CL_DEVICE_LOCAL_MEM_TYPE, sizeof(openCL->localMemType), &openCL->localMemType, NULL);
+
+    // Half precision image & path throughput: half arithmetic needs cl_khr_fp16
+    openCL->isHalfImage = 0;
+    if (options->kernel == KERNEL_HALF)
+    {
+        size_t extensionsSize = 0;
+        clGetDeviceInfo(openCL->deviceID, CL_DEVICE_EXTENSIONS, 0, NULL, &extensionsSize);
+        char* extensions = calloc(extensionsSize + 1, sizeof(char));
+        clGetDeviceInfo(openCL->deviceID, CL_DEVICE_EXTENSIONS, extensionsSize, extensions, NULL);
+        openCL->isHalfImage = strstr(extensions, "cl_khr_fp16") != NULL;
+        free(extensions);
+        if (!openCL->isHalfImage)
+            printf("WARNING::NO_CL_KHR_FP16: %s, using the float megakernel\n", openCL->deviceName);
+        else if (options->zeroCopy != ZERO_COPY_NONE)
+            printf("WARNING::HALF_IMAGE_WITHOUT_ZERO_COPY: the half image is read back & converted\n");
+    }
+
+    // Ray counters: every kernel but the wavefront ones (their lane utilization comes from their queue counters)
+    openCL->isRayStats = options->isRayStats;
+    openCL->timelineDevice = 0;
+    if (openCL->isRayStats && options->kernel == KERNEL_WAVEFRONT)
+    {
+        printf("WARNING::RAY_STATS_UNSUPPORTED_KERNEL: no counters in the wavefront kernels\n");
+        openCL->isRayStats = 0;
+    }
+
+    // Creating context.
+    openCL->context = clCreateContext(NULL, 1, &openCL->deviceID, NULL, NULL,  &ret);
+
+    // Creating command queue (profiled: kernel times of the launches)
+    openCL->commandQueue = clCreateCommandQueue(openCL->context, openCL->deviceID, CL_QUEUE_PROFILING_ENABLE, &ret);
+    openCL->transferQueue = clCreateCommandQueue(openCL->context, openCL->deviceID, 0, &ret);
+
+    openCL->accel = options->accel;
+    openCL->sphereMemoryOption = options->sphereMemory;
+    openCL->sphereMemory = SPHERE_MEMORY_GLOBAL;
+    openCL->localChunkSize = 0;
+    openCL->sampleSeedBase = options->sampleSeedBase;
+
+    // Launch configuration: defaults < autotuned profile of this device < command line
+    openCL->launch.localSize[0] = 8;
+    openCL->launch.localSize[1] = 8;
+    openCL->launch.sppChunk = 0;
+    openCL->launch.buildOptions[0] = '\0';
+    if (!options->isProfileIgnored && loadLaunchConfig(openCL->deviceName, openCL->driverVersion, &openCL->launch))
+        printf("Using autotuned profile of %s (%s).\n", openCL->deviceName, openCL->driverVersion);
+    if (options->localSize[0] && !options->isProfileIgnored)
+    {
+        openCL->launch.localSize[0] = options->localSize[0];
+        openCL->launch.localSize[1] = options->localSize[1];
+    }
 
-	// Creating context.
-	cl_context context = clCreateContext(NULL, 1, &deviceID, NULL, NULL,  &ret);
+    // Build program
+    openCL->program = NULL;
+    openCL->kernel = NULL;
+    openCL->persistentKernel = NULL;
+    openCL->localKernel = NULL;
+    openCL->batchKernel = NULL;
+    openCL->halfKernel = NULL;
+    openCL->wavefrontGenerateKernel = NULL;
+    openCL->wavefrontExtendKernel = NULL;
+    openCL->wavefrontShadeKernel = NULL;
+    openCL->wavefrontAccumulateKernel = NULL;
 
+    // No scene & output image yet
+    openCL->sphereMemObj = NULL;
+    openCL->cameraMemObj = NULL;
+    openCL->bvhMemObj = NULL;
+    openCL->numberOfNodes = 0;
+    openCL->workCounterMemObj = NULL;
+    openCL->statsMemObj = NULL;
+    openCL->wavefrontPoolSize = 0;
+    openCL->imageMemObj = NULL;
+    openCL->imageSize = 0;
+    openCL->mappedImage = NULL;
 
-	// Creating command queue
-	cl_command_queue commandQueue = clCreateCommandQueue(context, deviceID, 0, &ret);
+    ret = buildProgram_openCL(openCL, openCL->launch.buildOptions);
+    if (ret != CL_SUCCESS)
+    {
+        releaseOpenCL(openCL);
+        return ret;
+    }
 
-	// Memory buffers for each array
-	cl_mem imageMemObj = clCreateBuffer(context, CL_MEM_WRITE_ONLY, width * height * sizeof(color_t), NULL, &ret);
-	cl_mem cameraMemObj = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(camera_t), NULL, &ret);
-	cl_mem sphereMemObj = clCreateBuffer(context, CL_MEM_READ_ONLY, numberOfSpheres * sizeof(sphere_t), NULL, &ret);
+    openCL->workCounterMemObj = createBuffer_openCL(openCL->context, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &ret);
+    openCL->statsMemObj = openCL->isRayStats ? createBuffer_openCL(openCL->context, CL_MEM_READ_WRITE, 2 * RAY_STATS_COUNTERS * sizeof(cl_uint), NULL, &ret) : NULL;
+    if (openCL->isRayStats)
+        resetRayStats_openCL(openCL);
+    return CL_SUCCESS;
+}
 
+cl_int buildProgram_openCL(openCL_t *openCL, const char *buildOptions)
+{
+    cl_int ret;
+    if (openCL->kernel)
+        clReleaseKernel(openCL->kernel);
+    if (openCL->persistentKernel)
+        clReleaseKernel(openCL->persistentKernel);
+    if (openCL->localKernel)
+        clReleaseKernel(openCL->localKernel);
+    if (openCL->batchKernel)
+        clReleaseKernel(openCL->batchKernel);
+    if (openCL->halfKernel)
+        clReleaseKernel(openCL->halfKernel);
+    if (openCL->wavefrontGenerateKernel)
+        clReleaseKernel(openCL->wavefrontGenerateKernel);
+    if (openCL->wavefrontExtendKernel)
+        clReleaseKernel(openCL->wavefrontExtendKernel);
+    if (openCL->wavefrontShadeKernel)
+        clReleaseKernel(openCL->wavefrontShadeKernel);
+    if (openCL->wavefrontAccumulateKernel)
+        clReleaseKernel(openCL->wavefrontAccumulateKernel);
+    if (openCL->program)
+        clReleaseProgram(openCL->program);
+    openCL->kernel = NULL;
+    openCL->persistentKernel = NULL;
+    openCL->localKernel = NULL;
+    openCL->batchKernel = NULL;
+    openCL->halfKernel = NULL;
+    openCL->wavefrontGenerateKernel = NULL;
+    openCL->wavefrontExtendKernel = NULL;
+    openCL->wavefrontShadeKernel = NULL;
+    openCL->wavefrontAccumulateKernel = NULL;
 
-	// Copy lists to memory buffers
-	ret = clEnqueueWriteBuffer(commandQueue, cameraMemObj, CL_TRUE, 0, sizeof(camera_t), camera, 0, NULL, NULL);
-	ret = clEnqueueWriteBuffer(commandQueue, sphereMemObj, CL_TRUE, 0, numberOfSpheres * sizeof(sphere_t), spheres, 0, NULL, NULL);
+    // Spheres in __constant memory are a build time choice (address spaces are static in OpenCL C), so are the counters
+    // & the random sequences of the reference renders
+    char seedBase[32] = "";
+    if (openCL->sampleSeedBase)
+        snprintf(seedBase, sizeof(seedBase), " -DSAMPLE_SEED_BASE=%uu", openCL->sampleSeedBase);
+    char programOptions[BUILD_OPTIONS_LENGTH + 96];
+    snprintf(programOptions, sizeof(programOptions), "%s%s%s%s", buildOptions, openCL->sphereMemory == SPHERE_MEMORY_CONSTANT ? " -DSPHERE_ADDRESS_SPACE=__constant" : "",
+             openCL->isRayStats ? " -DRAY_STATS" : "", seedBase);
 
-	// Create program from kernel source
-	cl_program program = clCreateProgramWithSource(context, 1, (const char **)&kernelSource, (const size_t *)&kernelSize, &ret);	
+    // Create program from kernel source
+    openCL->program = clCreateProgramWithSource(openCL->context, 1, (const char **)&openCL->kernelSource, (const size_t *)&openCL->kernelSize, &ret);
 
-	// Build program
-	ret = clBuildProgram(program, 1, &deviceID, NULL, NULL, NULL);
+    // Build program
+    ret = clBuildProgram(openCL->program, 1, &openCL->deviceID, programOptions, NULL, NULL);
     if (ret != CL_SUCCESS)
     {
-        printf("\n\nERROR!!!\n\n");
+        printf("\n\nERROR!!! (build options: \"%s\")\n\n", programOptions);
         size_t len = 0;
-        cl_int ret = CL_SUCCESS;
-        ret = clGetProgramBuildInfo(program, deviceID, CL_PROGRAM_BUILD_LOG, 0, NULL, &len);
+        clGetProgramBuildInfo(openCL->program, openCL->deviceID, CL_PROGRAM_BUILD_LOG, 0, NULL, &len);
         char *buffer = calloc(len, sizeof(char));
-        ret = clGetProgramBuildInfo(program, deviceID, CL_PROGRAM_BUILD_LOG, len, buffer, NULL);
+        clGetProgramBuildInfo(openCL->program, openCL->deviceID, CL_PROGRAM_BUILD_LOG, len, buffer, NULL);
         printf("%s\n", buffer);
+        free(buffer);
+        return ret;
+    }
+
+    // Create kernels (the float4 variant only has the megakernel)
+    openCL->kernel = clCreateKernel(openCL->program, "raytracing", &ret);
+    if (ret == CL_SUCCESS && !openCL->isPackedScene)
+        openCL->persistentKernel = clCreateKernel(openCL->program, "raytracing_persistent", &ret);
+    if (ret == CL_SUCCESS && !openCL->isPackedScene)
+        openCL->localKernel = clCreateKernel(openCL->program, "raytracing_local", &ret);
+    if (ret == CL_SUCCESS && !openCL->isPackedScene)
+        openCL->batchKernel = clCreateKernel(openCL->program, "raytracing_batch", &ret);
+    if (ret == CL_SUCCESS && openCL->isHalfImage)
+        openCL->halfKernel = clCreateKernel(openCL->program, "raytracing_half", &ret);
+    if (ret == CL_SUCCESS && !openCL->isPackedScene)
+    {
+        openCL->wavefrontGenerateKernel = clCreateKernel(openCL->program, "wavefront_generate", &ret);
+        openCL->wavefrontExtendKernel = clCreateKernel(openCL->program, "wavefront_extend", &ret);
+        openCL->wavefrontShadeKernel = clCreateKernel(openCL->program, "wavefront_shade", &ret);
+        openCL->wavefrontAccumulateKernel = clCreateKernel(openCL->program, "wavefront_accumulate", &ret);
+    }
+    return ret;
+}
+
+void releaseOpenCL(openCL_t *openCL)
+{
+    unmapImage_openCL(openCL);
+
+    // Clean up, release memory.
+    clFlush(openCL->commandQueue);
+    clFinish(openCL->commandQueue);
+    clReleaseCommandQueue(openCL->commandQueue);
+    clFinish(openCL->transferQueue);
+    clReleaseCommandQueue(openCL->transferQueue);
+    // Only the kernels of the variant & device exist (no half kernel without fp16, only the megakernel in float4)
+    if (openCL->kernel)
+        clReleaseKernel(openCL->kernel);
+    if (openCL->persistentKernel)
+        clReleaseKernel(openCL->persistentKernel);
+    if (openCL->localKernel)
+        clReleaseKernel(openCL->localKernel);
+    if (openCL->batchKernel)
+        clReleaseKernel(openCL->batchKernel);
+    if (openCL->halfKernel)
+        clReleaseKernel(openCL->halfKernel);
+    if (openCL->wavefrontGenerateKernel)
+        clReleaseKernel(openCL->wavefrontGenerateKernel);
+    if (openCL->wavefrontExtendKernel)
+        clReleaseKernel(openCL->wavefrontExtendKernel);
+    if (openCL->wavefrontShadeKernel)
+        clReleaseKernel(openCL->wavefrontShadeKernel);
+    if (openCL->wavefrontAccumulateKernel)
+        clReleaseKernel(openCL->wavefrontAccumulateKernel);
+    if (openCL->program)
+        clReleaseProgram(openCL->program);
+    releaseWavefront_openCL(openCL);
+    releaseBuffer_openCL(openCL->workCounterMemObj);
+    if (openCL->statsMemObj)
+        releaseBuffer_openCL(openCL->statsMemObj);
+    if (openCL->imageMemObj)
+        releaseBuffer_openCL(openCL->imageMemObj);
+    if (openCL->sphereMemObj)
+        releaseBuffer_openCL(openCL->sphereMemObj);
+    if (openCL->cameraMemObj)
+        releaseBuffer_openCL(openCL->cameraMemObj);
+    if (openCL->bvhMemObj)
+        releaseBuffer_openCL(openCL->bvhMemObj);
+    clReleaseContext(openCL->context);
+    free(openCL->kernelSource);
+}
+
+cl_mem createBuffer_openCL(cl_context context, cl_mem_flags flags, size_t size, void *hostPtr, cl_int *ret)
+{
+    cl_mem memObj = clCreateBuffer(context, flags, size, hostPtr, ret);
+    if (memObj && !(flags & CL_MEM_USE_HOST_PTR))
+        trackMemory(MEMORY_DEVICE, size);
+    return memObj;
+}
+
+void releaseBuffer_openCL(cl_mem memObj)
+{
+    if (!memObj)
+        return;
+    cl_mem_flags flags;
+    size_t size;
+    if (clGetMemObjectInfo(memObj, CL_MEM_FLAGS, sizeof(flags), &flags, NULL) == CL_SUCCESS && !(flags & CL_MEM_USE_HOST_PTR)
+        && clGetMemObjectInfo(memObj, CL_MEM_SIZE, sizeof(size), &size, NULL) == CL_SUCCESS)
+        trackMemory(MEMORY_DEVICE, -(int64_t)size);
+    clReleaseMemObject(memObj);
+}
+
+static sphereMemory_t selectSphereMemory(const openCL_t* openCL, const uint16_t numberOfSpheres)
+{
+    const cl_ulong spheresSize = numberOfSpheres * (openCL->isPackedScene ? sizeof(sphere4_t) : sizeof(sphere_t));
+    switch (openCL->sphereMemoryOption)
+    {
+        case SPHERE_MEMORY_CONSTANT:
+            if (spheresSize <= openCL->maxConstantBufferSize)
+                return SPHERE_MEMORY_CONSTANT;
+            printf("WARNING::SPHERES_TOO_LARGE_FOR_CONSTANT_MEMORY: %lu > %lu bytes, using global memory\n", spheresSize, openCL->maxConstantBufferSize);
+            return SPHERE_MEMORY_GLOBAL;
+
+        case SPHERE_MEMORY_LOCAL:
+            if (!openCL->numberOfNodes && openCL->localKernel && !openCL->isHalfImage)
+                return SPHERE_MEMORY_LOCAL;
+            printf("WARNING::LOCAL_MEMORY_STAGING_NEEDS_NO_BVH_NOT_FLOAT4_NOT_HALF: using global memory\n");
+            return SPHERE_MEMORY_GLOBAL;
+
+        case SPHERE_MEMORY_GLOBAL:
+            return SPHERE_MEMORY_GLOBAL;
+
+        default:
+            // Constant memory is cached & broadcast, local memory staging only pays off on a dedicated local memory
+            if (spheresSize <= openCL->maxConstantBufferSize)
+                return SPHERE_MEMORY_CONSTANT;
+            if (!openCL->numberOfNodes && openCL->localKernel && !openCL->isHalfImage && openCL->localMemType == CL_LOCAL)
+                return SPHERE_MEMORY_LOCAL;
+            return SPHERE_MEMORY_GLOBAL;
+    }
+}
+
+void uploadScene_openCL(openCL_t *openCL, const sphere_t *spheres, const uint16_t numberOfSpheres, const camera_t *camera)
+{
+    cl_int ret;
+    if (openCL->sphereMemObj)
+        releaseBuffer_openCL(openCL->sphereMemObj);
+    if (openCL->cameraMemObj)
+        releaseBuffer_openCL(openCL->cameraMemObj);
+    if (openCL->bvhMemObj)
+        releaseBuffer_openCL(openCL->bvhMemObj);
+
+    // Scene in the layout of the kernel: host structs, or packed float4 for the float4 variant
+    camera4_t packedCamera;
+    sphere4_t* packedSpheres = NULL;
+    const void* cameraData = camera;
+    const void* sphereData = spheres;
+    size_t cameraSize = sizeof(camera_t);
+    size_t spheresSize = numberOfSpheres * sizeof(sphere_t);
+    if (openCL->isPackedScene)
+    {
+        packedCamera = packCamera(camera);
+        packedSpheres = malloc(numberOfSpheres * sizeof(sphere4_t));
+        packSpheres(packedSpheres, spheres, numberOfSpheres);
+        cameraData = &packedCamera;
+        sphereData = packedSpheres;
+        cameraSize = sizeof(camera4_t);
+        spheresSize = numberOfSpheres * sizeof(sphere4_t);
+    }
+
+    // Memory buffers for each array
+    openCL->cameraMemObj = createBuffer_openCL(openCL->context, CL_MEM_READ_ONLY, cameraSize, NULL, &ret);
+    openCL->sphereMemObj = createBuffer_openCL(openCL->context, CL_MEM_READ_ONLY, spheresSize, NULL, &ret);
+
+    // Copy lists to memory buffers
+    ret = clEnqueueWriteBuffer(openCL->commandQueue, openCL->cameraMemObj, CL_TRUE, 0, cameraSize, cameraData, 0, NULL, NULL);
+    ret = clEnqueueWriteBuffer(openCL->commandQueue, openCL->sphereMemObj, CL_TRUE, 0, spheresSize, sphereData, 0, NULL, NULL);
+    free(packedSpheres);
+
+    // Acceleration structure (the kernels always get a valid buffer, numberOfNodes == 0 disables it)
+    bvhNode_t* nodes = malloc(BVH_NUMBER_OF_NODES(numberOfSpheres) * sizeof(bvhNode_t));
+    const uint32_t numberOfNodes = buildBVH(nodes, spheres, numberOfSpheres);
+    openCL->bvhMemObj = createBuffer_openCL(openCL->context, CL_MEM_READ_ONLY, numberOfNodes * sizeof(bvhNode_t), NULL, &ret);
+    ret = clEnqueueWriteBuffer(openCL->commandQueue, openCL->bvhMemObj, CL_TRUE, 0, numberOfNodes * sizeof(bvhNode_t), nodes, 0, NULL, NULL);
+    free(nodes);
+
+    const uint8_t isBVHUsed = openCL->accel == ACCEL_BVH || (openCL->accel == ACCEL_AUTO && numberOfSpheres >= BVH_MIN_SPHERES);
+    openCL->numberOfNodes = isBVHUsed ? numberOfNodes : 0;
+
+    // Sphere memory for this scene, the program is rebuilt when entering or leaving __constant memory
+    const sphereMemory_t sphereMemory = selectSphereMemory(openCL, numberOfSpheres);
+    const uint8_t isRebuildNeeded = (sphereMemory == SPHERE_MEMORY_CONSTANT) != (openCL->sphereMemory == SPHERE_MEMORY_CONSTANT);
+    openCL->sphereMemory = sphereMemory;
+    if (isRebuildNeeded && buildProgram_openCL(openCL, openCL->launch.buildOptions) != CL_SUCCESS)
+        exit(EXIT_FAILURE);
+
+    // Half of the local memory for the staged spheres
+    const cl_ulong localChunkSize = openCL->localMemSize / 2 / sizeof(sphere_t);
+    openCL->localChunkSize = localChunkSize < numberOfSpheres ? localChunkSize : numberOfSpheres;
+}
+
+void createImage_openCL(openCL_t *openCL, color_t *image, const uint16_t width, const uint16_t height, const zeroCopyMode_t zeroCopy)
+{
+    cl_int ret;
+    const size_t imageSize = width * height * (openCL->isHalfImage ? 3 * sizeof(cl_half) : sizeof(color_t));
+
+    // The previous output must not be mapped anymore
+    unmapImage_openCL(openCL);
+    if (openCL->imageMemObj)
+        releaseBuffer_openCL(openCL->imageMemObj);
+
+    // Read & write: the kernel accumulates the samples of successive launches (the half image is always read back)
+    switch (openCL->isHalfImage ? ZERO_COPY_NONE : zeroCopy)
+    {
+        case ZERO_COPY_ALLOC_HOST_PTR:
+            openCL->imageMemObj = createBuffer_openCL(openCL->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, imageSize, NULL, &ret);
+            break;
+
+        case ZERO_COPY_USE_HOST_PTR:
+            // "image" must be ZERO_COPY_ALIGNMENT aligned, or the driver falls back to a hidden copy
+            openCL->imageMemObj = createBuffer_openCL(openCL->context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, imageSize, image, &ret);
+            break;
+
+        default:
+            openCL->imageMemObj = createBuffer_openCL(openCL->context, CL_MEM_READ_WRITE, imageSize, NULL, &ret);
+            break;
+    }
+    openCL->imageSize = imageSize;
+}
+
+cl_int enqueueRaytracing_openCL(openCL_t *openCL, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint16_t numberOfSpheres, const uint32_t sampleOffset, cl_event* event)
+{
+    return enqueueRaytracingRows_openCL(openCL, openCL->imageMemObj, width, 0, height, raysPerPixel, raysDepth, numberOfSpheres, sampleOffset, NULL, event);
+}
+
+cl_int enqueueRaytracingRows_openCL(openCL_t *openCL, cl_mem imageMemObj, const uint16_t width, const uint16_t firstRow, const uint16_t numberOfRows, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint16_t numberOfSpheres, const uint32_t sampleOffset, const cl_event* waitEvent, cl_event* event)
+{
+    // Same first arguments for all the kernels
+    cl_kernel kernel = openCL->isHalfImage ? openCL->halfKernel : (openCL->sphereMemory == SPHERE_MEMORY_LOCAL ? openCL->localKernel : openCL->kernel);
+
+    // The kernel only traces rows below "height", and writes row firstRow at the start of imageMemObj
+    const uint16_t height = firstRow + numberOfRows;
+
+    // Set arguments for kernel
+    clSetKernelArg(kernel, 0, sizeof(cl_mem), (void *)&imageMemObj);
+    clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *)&openCL->sphereMemObj);
+    clSetKernelArg(kernel, 2, sizeof(cl_mem), (void *)&openCL->cameraMemObj);
+    clSetKernelArg(kernel, 3, sizeof(width), (void *)&width);
+    clSetKernelArg(kernel, 4, sizeof(height), (void *)&height);
+    clSetKernelArg(kernel, 5, sizeof(raysPerPixel), (void *)&raysPerPixel);
+    clSetKernelArg(kernel, 6, sizeof(raysDepth), (void *)&raysDepth);
+    clSetKernelArg(kernel, 7, sizeof(numberOfSpheres), (void *)&numberOfSpheres);
+    clSetKernelArg(kernel, 8, sizeof(sampleOffset), (void *)&sampleOffset);
+    if (kernel == openCL->localKernel)
+    {
+        clSetKernelArg(kernel, 9, openCL->localChunkSize * sizeof(sphere_t), NULL);
+        clSetKernelArg(kernel, 10, sizeof(openCL->localChunkSize), (void *)&openCL->localChunkSize);
+    }
+    else
+    {
+        clSetKernelArg(kernel, 9, sizeof(cl_mem), (void *)&openCL->bvhMemObj);
+        clSetKernelArg(kernel, 10, sizeof(openCL->numberOfNodes), (void *)&openCL->numberOfNodes);
+    }
+    if (openCL->isRayStats)
+        clSetKernelArg(kernel, 11, sizeof(cl_mem), (void *)&openCL->statsMemObj);
+
+    // Execute the kernel: one work-item per pixel, the global range is rounded up to whole work-groups
+    // (out of image work-items return immediately, or keep sweeping the local memory chunks)
+    size_t localItemSize[2] = { openCL->launch.localSize[0], openCL->launch.localSize[1] };
+    size_t globalItemSize[2] = { (width + localItemSize[0] - 1) / localItemSize[0] * localItemSize[0],
+                                 (numberOfRows + localItemSize[1] - 1) / localItemSize[1] * localItemSize[1] };
+    size_t globalItemOffset[2] = { 0, firstRow };
+    return clEnqueueNDRangeKernel(openCL->commandQueue, kernel, 2, globalItemOffset, globalItemSize, localItemSize, waitEvent ? 1 : 0, waitEvent, event);
+}
+
+cl_int renderRows_openCL(openCL_t *openCL, cl_mem tileMemObj, color_t *image, const uint16_t width, const uint16_t firstRow, const uint16_t numberOfRows, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint16_t numberOfSpheres, const uint16_t sppChunk)
+{
+    // Rows rendered at the start of tileMemObj in launches of sppChunk samples, then read back to their place in image
+    // (the launches & the readback are kept for the timeline with --timeline)
+    const uint16_t numberOfLaunches = (raysPerPixel + sppChunk - 1) / sppChunk;
+    cl_event* events = isTimelineEnabled() ? calloc(numberOfLaunches + 1, sizeof(cl_event)) : NULL;
+    const uint64_t enqueueTime = timelineNow();
+    cl_int ret = CL_SUCCESS;
+    uint32_t sampleOffset;
+    uint16_t launchIdx = 0;
+    for (sampleOffset = 0; sampleOffset < raysPerPixel && ret == CL_SUCCESS; sampleOffset += sppChunk, launchIdx++)
+    {
+        const uint16_t samples = (raysPerPixel - sampleOffset < sppChunk) ? raysPerPixel - sampleOffset : sppChunk;
+        ret = enqueueRaytracingRows_openCL(openCL, tileMemObj, width, firstRow, numberOfRows, samples, raysDepth, numberOfSpheres, sampleOffset, NULL, events ? &events[launchIdx] : NULL);
+        clFlush(openCL->commandQueue);
+    }
+    if (ret == CL_SUCCESS)
+        ret = clEnqueueReadBuffer(openCL->commandQueue, tileMemObj, CL_TRUE, 0, (size_t)width * numberOfRows * sizeof(color_t), image + (size_t)firstRow * width, 0, NULL, events ? &events[numberOfLaunches] : NULL);
+
+    if (events)
+    {
+        uint16_t eventIdx;
+        for (eventIdx = 0; eventIdx <= numberOfLaunches; eventIdx++)
+        {
+            if (!events[eventIdx])
+                continue;
+            if (ret == CL_SUCCESS)
+                recordTimelineCommand_openCL(openCL, eventIdx < numberOfLaunches ? "rows kernel" : "rows readback", events[eventIdx], firstRow, events[0], enqueueTime);
+            clReleaseEvent(events[eventIdx]);
+        }
+        free(events);
+    }
+    return ret;
+}
+
+cl_int enqueuePersistent_openCL(openCL_t *openCL, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint16_t numberOfSpheres, const uint32_t sampleOffset, const uint32_t batchSize, cl_event* event)
+{
+    const cl_uint zero = 0;
+    cl_kernel kernel = openCL->persistentKernel;
+
+    // Set arguments for kernel
+    clSetKernelArg(kernel, 0, sizeof(cl_mem), (void *)&openCL->imageMemObj);
+    clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *)&openCL->sphereMemObj);
+    clSetKernelArg(kernel, 2, sizeof(cl_mem), (void *)&openCL->cameraMemObj);
+    clSetKernelArg(kernel, 3, sizeof(width), (void *)&width);
+    clSetKernelArg(kernel, 4, sizeof(height), (void *)&height);
+    clSetKernelArg(kernel, 5, sizeof(raysPerPixel), (void *)&raysPerPixel);
+    clSetKernelArg(kernel, 6, sizeof(raysDepth), (void *)&raysDepth);
+    clSetKernelArg(kernel, 7, sizeof(numberOfSpheres), (void *)&numberOfSpheres);
+    clSetKernelArg(kernel, 8, sizeof(sampleOffset), (void *)&sampleOffset);
+    clSetKernelArg(kernel, 9, sizeof(cl_mem), (void *)&openCL->workCounterMemObj);
+    clSetKernelArg(kernel, 10, sizeof(batchSize), (void *)&batchSize);
+    clSetKernelArg(kernel, 11, sizeof(cl_mem), (void *)&openCL->bvhMemObj);
+    clSetKernelArg(kernel, 12, sizeof(openCL->numberOfNodes), (void *)&openCL->numberOfNodes);
+    if (openCL->isRayStats)
+        clSetKernelArg(kernel, 13, sizeof(cl_mem), (void *)&openCL->statsMemObj);
+
+    // The work queue starts at the first pixel
+    clEnqueueFillBuffer(openCL->commandQueue, openCL->workCounterMemObj, &zero, sizeof(zero), 0, sizeof(zero), 0, NULL, NULL);
+
+    // Execute the kernel: about one wave of work-items (1D work-groups of the tuned size), never more than there are batches
+    size_t localItemSize = openCL->launch.localSize[0] * openCL->launch.localSize[1];
+    size_t batches = (width * height + batchSize - 1) / batchSize;
+    size_t globalItemSize = (size_t)openCL->computeUnits * PERSISTENT_GROUPS_PER_COMPUTE_UNIT * localItemSize;
+    if (globalItemSize > batches)
+        globalItemSize = (batches + localItemSize - 1) / localItemSize * localItemSize;
+    return clEnqueueNDRangeKernel(openCL->commandQueue, kernel, 1, NULL, &globalItemSize, &localItemSize, 0, NULL, event);
+}
+
+// Profiled kernel time of the launches, and without BVH the sphere reads of a work-group during one closest hit search
+// (every work-item reads every sphere from __global, __constant goes through the constant cache, __local staging reads
+// every sphere once per work-group from __global)
+static void reportSphereMemory(const openCL_t* openCL, cl_event* launchEvents, const uint16_t numberOfLaunches, const uint16_t numberOfSpheres, const kernelVariant_t kernel)
+{
+    static const char* SPHERE_MEMORY_NAMES[] = { "auto", "global", "constant", "local" };
+    cl_ulong kernelTime = 0;
+    uint16_t launchIdx;
+    for (launchIdx = 0; launchIdx < numberOfLaunches; launchIdx++)
+    {
+        // Wavefront launches are not profiled
+        if (!launchEvents[launchIdx])
+            continue;
+        cl_ulong start, end;
+        clGetEventProfilingInfo(launchEvents[launchIdx], CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+        clGetEventProfilingInfo(launchEvents[launchIdx], CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+        kernelTime += end - start;
+        clReleaseEvent(launchEvents[launchIdx]);
+    }
+
+    // Only the megakernel has a local memory staging version
+    sphereMemory_t sphereMemory = openCL->sphereMemory;
+    if (sphereMemory == SPHERE_MEMORY_LOCAL && kernel != KERNEL_MEGAKERNEL)
+        sphereMemory = SPHERE_MEMORY_GLOBAL;
+
+    printf("Sphere memory: %s, kernel time (profiling): %lu us\n", SPHERE_MEMORY_NAMES[sphereMemory], kernelTime / 1000);
+
+    // Traffic counted from the work-group shape & the scene, not profiled: the profiled effect of the memory is the kernel
+    // time against a --sphere-memory=global run of the same launch (timing_sphere_memory.sh). The BVH search reads the
+    // spheres of the visited leaves only, not counted
+    if (openCL->numberOfNodes)
+        return;
+    const uint32_t groupSize = openCL->launch.localSize[0] * openCL->launch.localSize[1];
+    const uint32_t sphereReads = numberOfSpheres * groupSize;
+    const size_t sphereSize = openCL->isPackedScene ? sizeof(sphere4_t) : sizeof(sphere_t);
+    switch (sphereMemory)
+    {
+        case SPHERE_MEMORY_CONSTANT:
+            printf("Sphere memory (estimate, not profiled): %u sphere reads per work-group search through the constant cache, global traffic not estimated\n", sphereReads);
+            break;
+
+        case SPHERE_MEMORY_LOCAL:
+            printf("Sphere memory (estimate, not profiled): %u sphere reads per work-group search from local memory, staged by %u reads from global memory (%lu bytes saved)\n",
+                   sphereReads, numberOfSpheres, (sphereReads - numberOfSpheres) * sphereSize);
+            break;
+
+        default:
+            printf("Sphere memory (estimate, not profiled): %u sphere reads per work-group search from global memory (%lu bytes)\n", sphereReads, sphereReads * sphereSize);
+            break;
     }
+}
 
-	// Create kernel
-	cl_kernel kernel = clCreateKernel(program, "raytracing", &ret);
+uint16_t samplesPerLaunch_openCL(const openCL_t *openCL, const uint16_t raysPerPixel, const options_t *options)
+{
+    // --progressive, autotuned chunk, or everything at once
+    uint16_t sppChunk = options->launches ? (raysPerPixel + options->launches - 1) / options->launches : openCL->launch.sppChunk;
+    if (!sppChunk || sppChunk > raysPerPixel)
+        sppChunk = raysPerPixel;
+    return sppChunk;
+}
 
+// Blocking readback of the output into a float image (the half image is converted on the host)
+cl_int readImage_openCL(openCL_t* openCL, color_t* image, const uint32_t numberOfPixels)
+{
+    if (!openCL->isHalfImage)
+        return clEnqueueReadBuffer(openCL->commandQueue, openCL->imageMemObj, CL_TRUE, 0, openCL->imageSize, image, 0, NULL, NULL);
 
-	// Set arguments for kernel
-	ret = clSetKernelArg(kernel, 0, sizeof(cl_mem), (void *)&imageMemObj);	
-	ret = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *)&sphereMemObj);	
-	ret = clSetKernelArg(kernel, 2, sizeof(cl_mem), (void *)&cameraMemObj);	
-	ret = clSetKernelArg(kernel, 3, sizeof(width), (void *)&width);	
-	ret = clSetKernelArg(kernel, 4, sizeof(height), (void *)&height);	
-	ret = clSetKernelArg(kernel, 5, sizeof(raysPerPixel), (void *)&raysPerPixel);	
-	ret = clSetKernelArg(kernel, 6, sizeof(raysDepth), (void *)&raysDepth);	
-	ret = clSetKernelArg(kernel, 7, sizeof(numberOfSpheres), (void *)&numberOfSpheres);	
+    cl_half* halfImage = trackedMalloc(openCL->imageSize);
+    const cl_int ret = clEnqueueReadBuffer(openCL->commandQueue, openCL->imageMemObj, CL_TRUE, 0, openCL->imageSize, halfImage, 0, NULL, NULL);
+    imageHalfToFloat(halfImage, image, numberOfPixels);
+    trackedFree(halfImage);
+    return ret;
+}
 
+color_t* raytracing_openCL(openCL_t* openCL, color_t *image, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t *spheres, const uint16_t numberOfSpheres, const camera_t *camera, const options_t* options)
+{
+    cl_int ret;
+    const size_t imageSize = width * height * sizeof(color_t);
 
-	// Execute the kernel
-	size_t globalItemSize = width * height;
-	size_t localItemSize = 64; // globalItemSize has to be a multiple of localItemSize. 1024/64 = 16 
+    const zeroCopyMode_t zeroCopy = openCL->isHalfImage ? ZERO_COPY_NONE : options->zeroCopy;
+    createImage_openCL(openCL, image, width, height, zeroCopy);
+    uploadScene_openCL(openCL, spheres, numberOfSpheres, camera);
 
     // Time measure
     struct timeval start, end;
+    perfPhase_t phase;
     printf("Trace rays!");
     fflush(stdout);
     gettimeofday(&start, NULL);
+    startPerfPhase(&phase);
 
-    // Render image
-	ret = clEnqueueNDRangeKernel(commandQueue, kernel, 1, NULL, &globalItemSize, &localItemSize, 0, NULL, NULL);	
+    const uint16_t sppChunk = samplesPerLaunch_openCL(openCL, raysPerPixel, options);
+    if (openCL->isRayStats)
+        resetRayStats_openCL(openCL);
+    const uint64_t enqueueTime = timelineNow();
+
+    // Render image (wait for the kernel, so that the transfer below is measured alone)
+    uint32_t sampleOffset;
+    uint16_t launchIdx = 0;
+    wavefrontStats_t wavefrontStats = { 0, 0, 0 };
+    cl_event* launchEvents = calloc((raysPerPixel + sppChunk - 1) / sppChunk, sizeof(cl_event));
+    for (sampleOffset = 0; sampleOffset < raysPerPixel; sampleOffset += sppChunk)
+    {
+        const uint16_t samples = (raysPerPixel - sampleOffset < sppChunk) ? raysPerPixel - sampleOffset : sppChunk;
+        if (options->kernel == KERNEL_WAVEFRONT)
+            ret = enqueueWavefront_openCL(openCL, width, height, samples, raysDepth, numberOfSpheres, sampleOffset, &wavefrontStats);
+        else if (options->kernel == KERNEL_PERSISTENT)
+            ret = enqueuePersistent_openCL(openCL, width, height, samples, raysDepth, numberOfSpheres, sampleOffset, options->batchSize, &launchEvents[launchIdx]);
+        else
+            ret = enqueueRaytracing_openCL(openCL, width, height, samples, raysDepth, numberOfSpheres, sampleOffset, &launchEvents[launchIdx]);
+        if (ret != CL_SUCCESS)
+        {
+            printf("\nERROR::OPENCL_ENQUEUE_KERNEL: %d (work-group %ux%u)\n", ret, openCL->launch.localSize[0], openCL->launch.localSize[1]);
+            exit(EXIT_FAILURE);
+        }
+        // Submit each launch on its own, they stay short (device watchdogs)
+        clFlush(openCL->commandQueue);
+        launchIdx++;
+
+        // Intermediate image
+        if (options->readbackInterval && launchIdx % options->readbackInterval == 0 && sampleOffset + samples < raysPerPixel)
+        {
+            char filename[64];
+            color_t* intermediateImage = trackedMalloc(imageSize);
+            readImage_openCL(openCL, intermediateImage, width * height);
+            snprintf(filename, sizeof(filename), "OpenCL_%u_spp.png", sampleOffset + samples);
+            renderImage(intermediateImage, filename, width, height);
+            trackedFree(intermediateImage);
+        }
+    }
+    clFinish(openCL->commandQueue);
 
     // Elapsed time
     gettimeofday(&end, NULL);
+    stopPerfPhase(&phase);
     printf("\t\t\tDone!\n");
+
     uint64_t elapsedTime = (end.tv_sec - start.tv_sec) * 1000000ull + (end.tv_usec - start.tv_usec);
-    printf("Raytracing_OpenCL elapsed time: %lu us\n", elapsedTime);
-    printf("Cycles per pixel: %f\n", elapsedTime * 2.8e3f / (width * height));
-    
+    printf("Raytracing_OpenCL elapsed time: %lu us (work-group %ux%u, %u launches)\n", elapsedTime, openCL->launch.localSize[0], openCL->launch.localSize[1], launchIdx);
+    reportPerfPhase("trace OpenCL", &phase, width * height);
+    if (openCL->numberOfNodes)
+        printf("BVH: %u nodes for %u spheres\n", openCL->numberOfNodes, numberOfSpheres);
+    if (isTimelineEnabled() && launchEvents[0])
+    {
+        uint16_t eventIdx;
+        for (eventIdx = 0; eventIdx < launchIdx; eventIdx++)
+            recordTimelineCommand_openCL(openCL, "kernel", launchEvents[eventIdx], eventIdx, launchEvents[0], enqueueTime);
+    }
+    reportSphereMemory(openCL, launchEvents, launchIdx, numberOfSpheres, options->kernel);
+    free(launchEvents);
+    if (options->kernel == KERNEL_WAVEFRONT)
+        printf("Wavefront: %lu rays, %f Mrays/s, SIMD lane utilization %.1f%%\n", wavefrontStats.rays, (double)wavefrontStats.rays / elapsedTime,
+               100.0 * wavefrontStats.usefulItems / wavefrontStats.launchedItems);
+    if (openCL->isRayStats)
+        reportRayStats_openCL(openCL);
 
-	// Read from device back to host.
-	printf("Data transfert: Device -> Host");
-    fflush(stdout);
-    gettimeofday(&start, NULL);
+    color_t* result = image;
+    const uint64_t readbackStart = timelineNow();
+    if (zeroCopy == ZERO_COPY_NONE)
+    {
+        // Read from device back to host.
+        printf("Data transfert: Device -> Host");
+        fflush(stdout);
+        gettimeofday(&start, NULL);
+        startPerfPhase(&phase);
+        ret = readImage_openCL(openCL, image, width * height);
+    }
+    else
+    {
+        // Map the device buffer, the host works directly on the mapped pointer (no copy on shared memory devices)
+        printf("Data transfert: Map -> Host");
+        fflush(stdout);
+        gettimeofday(&start, NULL);
+        startPerfPhase(&phase);
+        openCL->mappedImage = clEnqueueMapBuffer(openCL->commandQueue, openCL->imageMemObj, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, imageSize, 0, NULL, NULL, &ret);
+        result = openCL->mappedImage;
+    }
 
-    ret = clEnqueueReadBuffer(commandQueue, imageMemObj, CL_TRUE, 0, width * height * sizeof(color_t), image, 0, NULL, NULL);
-    
     gettimeofday(&end, NULL);
+    stopPerfPhase(&phase);
+    recordTimelineSpan(zeroCopy == ZERO_COPY_NONE ? "readback" : "map", readbackStart, timelineNow(), 0);
     printf("\t\t\tDone!\n");
+
+    if (ret != CL_SUCCESS)
+    {
+        printf("ERROR::OPENCL_IMAGE_TRANSFERT: %d\n", ret);
+        exit(EXIT_FAILURE);
+    }
+
     elapsedTime = (end.tv_sec - start.tv_sec) * 1000000ull + (end.tv_usec - start.tv_usec);
-    printf("Data transfert: Device -> Host elapsed time: %lu us\n", elapsedTime);
-    printf("Cycles per pixel: %f\n", elapsedTime * 2.8e3f / (width * height));
-    
-
-
-	// Clean up, release memory.
-	ret = clFlush(commandQueue);
-	ret = clFinish(commandQueue);
-	ret = clReleaseCommandQueue(commandQueue);
-	ret = clReleaseKernel(kernel);
-	ret = clReleaseProgram(program);
-	ret = clReleaseMemObject(imageMemObj);
-	ret = clReleaseMemObject(sphereMemObj);
-	ret = clReleaseMemObject(cameraMemObj);
-	ret = clReleaseContext(context);
-    free(kernelSource);
+    printf("Data transfert: Device -> Host elapsed time: %lu us (%lu bytes)\n", elapsedTime, openCL->imageSize);
+    reportPerfPhase("readback", &phase, width * height);
+
+    return result;
+}
+
+uint32_t raytracingBudget_openCL(openCL_t *openCL, color_t *image, const uint16_t width, const uint16_t height, const uint8_t raysDepth, const sphere_t *spheres, const uint16_t numberOfSpheres, const camera_t *camera, const uint64_t timeBudget, const options_t *options)
+{
+    if (options->kernel == KERNEL_WAVEFRONT)
+        printf("WARNING::BUDGET_WAVEFRONT_UNSUPPORTED: rendering with the megakernel\n");
+    createImage_openCL(openCL, NULL, width, height, ZERO_COPY_NONE);
+    uploadScene_openCL(openCL, spheres, numberOfSpheres, camera);
+
+    // A pass is split in launches of at most the autotuned samples per launch (device watchdogs)
+    const uint16_t maxLaunchSamples = openCL->launch.sppChunk ? openCL->launch.sppChunk : UINT16_MAX;
+    const uint64_t start = monotonicTime();
+    uint32_t sampleOffset = 0;
+    uint16_t passSamples = 1;
+    while (passSamples)
+    {
+        const uint64_t passStart = monotonicTime();
+        uint16_t launchedSamples = 0;
+        while (launchedSamples < passSamples)
+        {
+            const uint16_t samples = (passSamples - launchedSamples < maxLaunchSamples) ? passSamples - launchedSamples : maxLaunchSamples;
+            const cl_int ret = (options->kernel == KERNEL_PERSISTENT)
+                ? enqueuePersistent_openCL(openCL, width, height, samples, raysDepth, numberOfSpheres, sampleOffset + launchedSamples, options->batchSize, NULL)
+                : enqueueRaytracing_openCL(openCL, width, height, samples, raysDepth, numberOfSpheres, sampleOffset + launchedSamples, NULL);
+            if (ret != CL_SUCCESS)
+            {
+                printf("ERROR::OPENCL_ENQUEUE_KERNEL: %d (budget pass at %u spp)\n", ret, sampleOffset);
+                exit(EXIT_FAILURE);
+            }
+            clFlush(openCL->commandQueue);
+            launchedSamples += samples;
+        }
+        clFinish(openCL->commandQueue);
+        sampleOffset += passSamples;
+
+        const uint64_t now = monotonicTime();
+        passSamples = nextPassSamples(now - start, timeBudget, now - passStart, passSamples);
+    }
+
+    const cl_int ret = readImage_openCL(openCL, image, width * height);
+    if (ret != CL_SUCCESS)
+    {
+        printf("ERROR::OPENCL_IMAGE_TRANSFERT: %d\n", ret);
+        exit(EXIT_FAILURE);
+    }
+    return sampleOffset;
+}
+
+void unmapImage_openCL(openCL_t *openCL)
+{
+    if (!openCL->mappedImage)
+        return;
+
+    clEnqueueUnmapMemObject(openCL->commandQueue, openCL->imageMemObj, openCL->mappedImage, 0, NULL, NULL);
+    clFinish(openCL->commandQueue);
+    openCL->mappedImage = NULL;
+}
+
+void recordTimelineCommand_openCL(const openCL_t *openCL, const char *name, cl_event event, const uint32_t arg, cl_event reference, const uint64_t referenceTime)
+{
+    // Device clock: ns since an unspecified origin, shifted to the host clock by the queued time of the reference
+    cl_ulong queued, start, end;
+    if (clGetEventProfilingInfo(reference, CL_PROFILING_COMMAND_QUEUED, sizeof(queued), &queued, NULL) != CL_SUCCESS
+        || clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL) != CL_SUCCESS
+        || clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL) != CL_SUCCESS)
+        return;
+    recordTimelineDeviceSpan(openCL->timelineDevice, name, referenceTime + (start - queued), referenceTime + (end - queued), arg);
+}
+
+void resetRayStats_openCL(openCL_t *openCL)
+{
+    const cl_uint zero = 0;
+    clEnqueueFillBuffer(openCL->commandQueue, openCL->statsMemObj, &zero, sizeof(zero), 0, 2 * RAY_STATS_COUNTERS * sizeof(cl_uint), 0, NULL, NULL);
+}
+
+void readRayStats_openCL(openCL_t *openCL, uint64_t counters[RAY_STATS_COUNTERS])
+{
+    cl_uint words[2 * RAY_STATS_COUNTERS];
+    clEnqueueReadBuffer(openCL->commandQueue, openCL->statsMemObj, CL_TRUE, 0, sizeof(words), words, 0, NULL, NULL);
+    uint8_t k;
+    for (k = 0; k < RAY_STATS_COUNTERS; k++)
+        counters[k] = words[2 * k] | (uint64_t)words[2 * k + 1] << 32;
+}
+
+void reportRayStats_openCL(openCL_t *openCL)
+{
+    uint64_t counters[RAY_STATS_COUNTERS];
+    readRayStats_openCL(openCL, counters);
+    uint8_t k;
+
+    const uint64_t samples = counters[RAY_STATS_SAMPLES], rays = counters[RAY_STATS_RAYS];
+    if (!samples || !rays)
+    {
+        printf("Ray stats: no samples counted\n");
+        return;
+    }
+    printf("Ray stats: %lu samples, %lu rays (%.2f per sample), %lu sphere tests (%.1f per ray), %lu BVH node tests (%.1f per ray)\n",
+           samples, rays, (double)rays / samples, counters[RAY_STATS_SPHERE_TESTS], (double)counters[RAY_STATS_SPHERE_TESTS] / rays,
+           counters[RAY_STATS_NODE_TESTS], (double)counters[RAY_STATS_NODE_TESTS] / rays);
+    printf("Ray stats: sky hits %.1f%%, truncated paths %.1f%%\n", 100.0 * counters[RAY_STATS_SKY_HITS] / samples, 100.0 * counters[RAY_STATS_TRUNCATED] / samples);
+    if (counters[RAY_STATS_LANE_SLOTS])
+        printf("Ray stats: SIMD lane utilization %.1f%% (rays vs. work-group size x rays of its longest work-item)\n", 100.0 * rays / counters[RAY_STATS_LANE_SLOTS]);
+    printf("Ray stats: bounces before the sky:");
+    for (k = 0; k < RAY_STATS_DEPTH_BINS; k++)
+        if (counters[RAY_STATS_DEPTH + k])
+            printf(" %u%s:%.1f%%", k, k == RAY_STATS_DEPTH_BINS - 1 ? "+" : "", 100.0 * counters[RAY_STATS_DEPTH + k] / samples);
+    printf("\n");
+}
+
+uint8_t validate_openCL(const color_t *image, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t *spheres, const uint16_t numberOfSpheres, const camera_t *camera, const options_t *options)
+{
+    // Reference: brute force megakernel from global memory, in one launch, default shape & build options (the autotuned
+    // ones may relax the floating point math)
+    options_t referenceOptions;
+    initializeOptions(&referenceOptions);
+    referenceOptions.accel = ACCEL_NONE;
+    referenceOptions.sphereMemory = SPHERE_MEMORY_GLOBAL;
+    referenceOptions.isProfileIgnored = 1;
+    referenceOptions.launches = 1;
+
+    printf("Validation: reference image\n");
+    color_t* referenceImage = trackedMalloc(width * height * sizeof(color_t));
+    openCL_t openCL;
+    initializeOpenCL(&openCL, &referenceOptions);
+    raytracing_openCL(&openCL, referenceImage, width, height, raysPerPixel, raysDepth, spheres, numberOfSpheres, camera, &referenceOptions);
+    releaseOpenCL(&openCL);
+
+    float maxError;
+    const float rmse = imageRMSE(image, referenceImage, width * height, &maxError);
+    trackedFree(referenceImage);
+
+    const uint8_t isValid = rmse <= VALIDATION_RMSE_TOLERANCE;
+    printf("Validation: RMSE %e, max error %e (tolerance %e)\t%s\n", rmse, maxError, VALIDATION_RMSE_TOLERANCE, isValid ? "PASSED" : "FAILED");
+    return isValid;
 }
@@ -0,0 +1,187 @@
+#define _GNU_SOURCE
+#include "scaling.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sched.h>
+#include <omp.h>
+
+#include "raytracing.h"
+#include "camera.h"
+#include "sphere.h"
+#include "bench.h"
+#include "perf_counters.h"
+
+static const char* PINNING_NAMES[] = { "none", "close", "spread" };
+
+typedef struct scalingRun_t
+{
+    uint64_t time;              // Median of the timed renders (us)
+    uint64_t cycles;            // Sums over the timed renders
+    uint64_t instructions;
+    uint64_t cacheMisses;
+    double busiestThread;       // Rays of the busiest thread / mean rays per thread
+} scalingRun_t;
+
+static int compareU64(const void* a, const void* b)
+{
+    const uint64_t x = *(const uint64_t*)a;
+    const uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Threads of the next parallel regions pinned to one CPU each (close: consecutive CPUs, spread: evenly spaced over the
+// CPUs of the process), or allowed on all of them. libgomp keeps its pool threads from one region to the next
+static void pinThreads(const pinning_t pinning, const uint16_t numberOfThreads, const cpu_set_t* processCpus)
+{
+    uint16_t cpus[CPU_SETSIZE];
+    uint16_t numberOfCpus = 0, cpu;
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, processCpus))
+            cpus[numberOfCpus++] = cpu;
+
+    #pragma omp parallel num_threads(numberOfThreads)
+    {
+        const uint16_t thread = omp_get_thread_num();
+        cpu_set_t threadCpus = *processCpus;
+        if (pinning != PINNING_NONE)
+        {
+            const uint16_t cpuIdx = pinning == PINNING_CLOSE ? thread % numberOfCpus : (uint32_t)thread * numberOfCpus / numberOfThreads;
+            CPU_ZERO(&threadCpus);
+            CPU_SET(cpus[cpuIdx], &threadCpus);
+        }
+        if (sched_setaffinity(0, sizeof(threadCpus), &threadCpus))
+            printf("WARNING::SCALING_PINNING_FAILED: thread %u\n", thread);
+    }
+}
+
+static scalingRun_t timeRenders(color_t* image, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const sphere_t* spheres, const uint16_t numberOfSpheres, const options_t* options, uint64_t* times, cpuRayStats_t* stats)
+{
+    const camera_t camera = initializeCamera(width, height);
+    scalingRun_t run = { 0, 0, 0, 0, 1.0 };
+    uint16_t runIdx;
+    resetCpuRayStats(stats);
+    for (runIdx = 0; runIdx < options->warmups + options->repetitions; runIdx++)
+    {
+        // Rays of the threads on the first render (a warm-up one unless --warmup=0)
+        perfPhase_t phase;
+        startPerfPhase(&phase);
+        raytracing(image, width, height, raysPerPixel, raysDepth, spheres, numberOfSpheres, &camera, runIdx == 0 ? stats : NULL);
+        stopPerfPhase(&phase);
+        if (runIdx < options->warmups)
+            continue;
+        times[runIdx - options->warmups] = phase.time;
+        run.cycles += phase.counts[PERF_CYCLES];
+        run.instructions += phase.counts[PERF_INSTRUCTIONS];
+        run.cacheMisses += phase.counts[PERF_CACHE_MISSES];
+    }
+    qsort(times, options->repetitions, sizeof(uint64_t), compareU64);
+    run.time = times[(options->repetitions - 1) / 2];
+
+    uint64_t maxRays = 0;
+    for (runIdx = 0; runIdx < stats->numberOfThreads; runIdx++)
+        if (stats->threads[runIdx].rays > maxRays)
+            maxRays = stats->threads[runIdx].rays;
+    if (stats->total.rays)
+        run.busiestThread = (double)maxRays * stats->numberOfThreads / stats->total.rays;
+    return run;
+}
+
+int scaling(const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint8_t sqrtNumberOfSpheres, const options_t *options)
+{
+    const uint32_t seed = options->isSeedSet ? options->seed : BENCH_SEED;
+    const uint16_t maxThreads = omp_get_max_threads();
+    const uint16_t numberOfSpheres = sqrtNumberOfSpheres * sqrtNumberOfSpheres + 4;
+    sphere_t* spheres = malloc(numberOfSpheres * sizeof(sphere_t));
+    srand(seed);
+    initializeSpheres(spheres, sqrtNumberOfSpheres);
+
+    cpu_set_t processCpus;
+    sched_getaffinity(0, sizeof(processCpus), &processCpus);
+
+    FILE* resultFile = fopen(SCALING_RESULT_PATH, "w");
+    if (!resultFile)
+    {
+        printf("ERROR::CANNOT_WRITE_SCALING_RESULT: %s\n", SCALING_RESULT_PATH);
+        free(spheres);
+        return EXIT_FAILURE;
+    }
+    fprintf(resultFile, "threads;pinning;width;height;time_strong;speedup_strong;efficiency_strong;width_weak;height_weak;time_weak;efficiency_weak;ipc;cache_misses_per_pixel;busiest_thread;limit\n");
+
+    color_t* image = malloc((size_t)width * height * sizeof(color_t));
+    uint64_t* times = malloc(options->repetitions * sizeof(uint64_t));
+    cpuRayStats_t* stats = malloc(sizeof(cpuRayStats_t));
+
+    printf("Scaling %ux%u, %u spp, depth %u, %u spheres: 1 to %u threads (pinning %s), %u warm-up & %u timed runs, results in %s\n",
+           width, height, raysPerPixel, raysDepth, numberOfSpheres, maxThreads, PINNING_NAMES[options->pinning], options->warmups, options->repetitions, SCALING_RESULT_PATH);
+    printf("Threads | Strong: time (us)  speed-up  efficiency | Weak: frame      time (us)  efficiency |   IPC  cache misses/px  busiest thread | Limit\n");
+
+    scalingRun_t strongBase, weakBase;
+    uint32_t weakBasePixels = 1;
+    uint16_t numberOfThreads = 1;
+    while (1)
+    {
+        omp_set_num_threads(numberOfThreads);
+        pinThreads(options->pinning, numberOfThreads, &processCpus);
+
+        // Weak: same view, pixels in proportion to the threads
+        const double weakScale = sqrt((double)numberOfThreads / maxThreads);
+        const uint16_t weakWidth = fmax(1.0, round(width * weakScale));
+        const uint16_t weakHeight = fmax(1.0, round(height * weakScale));
+        const uint32_t weakPixels = weakWidth * weakHeight;
+
+        const scalingRun_t strong = timeRenders(image, width, height, raysPerPixel, raysDepth, spheres, numberOfSpheres, options, times, stats);
+        const scalingRun_t weak = timeRenders(image, weakWidth, weakHeight, raysPerPixel, raysDepth, spheres, numberOfSpheres, options, times, stats);
+        if (numberOfThreads == 1)
+        {
+            strongBase = strong;
+            weakBase = weak;
+            weakBasePixels = weakPixels;
+        }
+
+        // Parallel efficiency: speed-up per thread, pixel throughput per thread relative to one thread
+        const double speedup = (double)strongBase.time / strong.time;
+        const double strongEfficiency = speedup / numberOfThreads;
+        const double weakEfficiency = ((double)weakPixels / weak.time) / (numberOfThreads * (double)weakBasePixels / weakBase.time);
+        const uint8_t hasCounters = isPerfEventAvailable(PERF_CYCLES) && isPerfEventAvailable(PERF_INSTRUCTIONS) && strong.cycles && strongBase.cycles;
+        const double ipc = hasCounters ? (double)strong.instructions / strong.cycles : NAN;
+        const double baseIpc = hasCounters ? (double)strongBase.instructions / strongBase.cycles : NAN;
+        const double cacheMissesPerPixel = isPerfEventAvailable(PERF_CACHE_MISSES) ? (double)strong.cacheMisses / options->repetitions / ((uint32_t)width * height) : NAN;
+
+        const char* limit = "-";
+        if (strongEfficiency < SCALING_EFFICIENCY || weakEfficiency < SCALING_EFFICIENCY)
+        {
+            if (numberOfThreads > CPU_COUNT(&processCpus))
+                limit = "oversubscribed (threads > CPUs)";
+            else if (strong.busiestThread > SCALING_IMBALANCE)
+                limit = "scheduling (load imbalance)";
+            else if (hasCounters && ipc < SCALING_IPC_DROP * baseIpc)
+                limit = "memory / shared core (IPC drop)";
+            else
+                limit = "runtime overhead / clock";
+        }
+
+        printf("%7u | %17lu  %7.2fx  %9.1f%% | %5ux%-5u  %10lu  %9.1f%% | %5.2f  %15.2f  %13.2fx | %s\n", numberOfThreads, strong.time, speedup, 100.0 * strongEfficiency,
+               weakWidth, weakHeight, weak.time, 100.0 * weakEfficiency, ipc, cacheMissesPerPixel, strong.busiestThread, limit);
+        fprintf(resultFile, "%u;%s;%u;%u;%lu;%f;%f;%u;%u;%lu;%f;%f;%f;%f;%s\n", numberOfThreads, PINNING_NAMES[options->pinning], width, height, strong.time, speedup, strongEfficiency,
+                weakWidth, weakHeight, weak.time, weakEfficiency, ipc, cacheMissesPerPixel, strong.busiestThread, limit);
+        fflush(resultFile);
+
+        // Powers of two, then the maximum
+        if (numberOfThreads == maxThreads)
+            break;
+        numberOfThreads = (numberOfThreads * 2 < maxThreads) ? numberOfThreads * 2 : maxThreads;
+    }
+
+    // Back to the default team, free to run on every CPU of the process
+    omp_set_num_threads(maxThreads);
+    pinThreads(PINNING_NONE, maxThreads, &processCpus);
+
+    fclose(resultFile);
+    free(stats);
+    free(times);
+    free(image);
+    free(spheres);
+    return EXIT_SUCCESS;
+}
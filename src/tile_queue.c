@@ -0,0 +1,59 @@
+#include "tile_queue.h"
+
+void initializeTileQueue(tileQueue_t *queue, const uint16_t height, const uint8_t numberOfWorkers)
+{
+    queue->nextRow = 0;
+    queue->height = height;
+    queue->numberOfWorkers = numberOfWorkers;
+    uint8_t worker;
+    for (worker = 0; worker < TILE_QUEUE_MAX_WORKERS; worker++)
+        queue->rowsPerSecond[worker] = 0.0;
+}
+
+uint16_t pullTile(tileQueue_t *queue, const uint8_t worker, const uint16_t granularity, uint16_t *numberOfRows)
+{
+    // Measured throughputs & rows left (read while the other workers update them)
+    double ownRate = 0.0, totalRate = 0.0;
+    uint8_t otherWorker;
+    for (otherWorker = 0; otherWorker < queue->numberOfWorkers; otherWorker++)
+    {
+        double rate;
+        #pragma omp atomic read
+        rate = queue->rowsPerSecond[otherWorker];
+        totalRate += rate;
+        if (otherWorker == worker)
+            ownRate = rate;
+    }
+    uint32_t nextRow;
+    #pragma omp atomic read
+    nextRow = queue->nextRow;
+    const uint32_t remainingRows = nextRow < queue->height ? queue->height - nextRow : 0;
+
+    // TILE_QUEUE_TILE_TIME of work at the measured throughput (a single granule to probe it first), but never more than
+    // the throughput share of the rows left
+    double rows = granularity;
+    if (ownRate > 0.0)
+    {
+        rows = ownRate * TILE_QUEUE_TILE_TIME;
+        if (rows > remainingRows * ownRate / totalRate)
+            rows = remainingRows * ownRate / totalRate;
+    }
+    uint32_t wholeRows = ((uint32_t)rows + granularity - 1) / granularity * granularity;
+    if (!wholeRows)
+        wholeRows = granularity;
+
+    uint32_t firstRow;
+    #pragma omp atomic capture
+    { firstRow = queue->nextRow; queue->nextRow += wholeRows; }
+    if (firstRow >= queue->height)
+        return queue->height;
+
+    *numberOfRows = (wholeRows < queue->height - firstRow) ? wholeRows : queue->height - firstRow;
+    return firstRow;
+}
+
+void reportTile(tileQueue_t *queue, const uint8_t worker, const uint16_t numberOfRows, const double seconds)
+{
+    #pragma omp atomic write
+    queue->rowsPerSecond[worker] = numberOfRows / seconds;
+}
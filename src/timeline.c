@@ -0,0 +1,176 @@
+#include "timeline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Only its thread writes a ring: the head is published with a release store, read by writeTimeline() with an acquire load
+typedef struct timelineRing_t
+{
+    timelineEvent_t events[TIMELINE_RING_EVENTS];
+    uint64_t head;      // Events recorded since the start, the ring keeps the last TIMELINE_RING_EVENTS
+} timelineRing_t;
+
+static const char* timelinePath = NULL;     // NULL: not recording
+static uint64_t timelineOrigin;
+static timelineRing_t* rings[TIMELINE_MAX_THREADS];
+static uint32_t numberOfRings = 0;
+static uint64_t lostEvents = 0;             // Recorded by the threads beyond TIMELINE_MAX_THREADS
+static char deviceNames[TIMELINE_MAX_DEVICES][128];
+
+// Ring of the calling thread, taken on its first span (NULL: no ring left)
+static __thread timelineRing_t* threadRing = NULL;
+static __thread uint8_t hasThreadRing = 0;
+
+static uint64_t monotonicNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+void initializeTimeline(const char *path)
+{
+    memset(rings, 0, sizeof(rings));
+    memset(deviceNames, 0, sizeof(deviceNames));
+    numberOfRings = 0;
+    lostEvents = 0;
+    timelineOrigin = monotonicNs();
+    timelinePath = path;
+}
+
+uint8_t isTimelineEnabled(void)
+{
+    return timelinePath != NULL;
+}
+
+uint64_t timelineNow(void)
+{
+    return monotonicNs() - timelineOrigin;
+}
+
+void nameTimelineDevice(const uint16_t device, const char *name)
+{
+    if (device < TIMELINE_MAX_DEVICES)
+        snprintf(deviceNames[device], sizeof(deviceNames[device]), "%s", name);
+}
+
+static timelineRing_t* getThreadRing(void)
+{
+    if (!hasThreadRing)
+    {
+        hasThreadRing = 1;
+        const uint32_t ringIdx = __atomic_fetch_add(&numberOfRings, 1, __ATOMIC_RELAXED);
+        if (ringIdx < TIMELINE_MAX_THREADS)
+        {
+            threadRing = calloc(1, sizeof(timelineRing_t));
+            __atomic_store_n(&rings[ringIdx], threadRing, __ATOMIC_RELEASE);
+        }
+    }
+    return threadRing;
+}
+
+static void recordEvent(const timelineProcess_t process, const uint16_t track, const char* name, const uint64_t begin, const uint64_t end, const uint32_t arg)
+{
+    if (!timelinePath)
+        return;
+    timelineRing_t* ring = getThreadRing();
+    if (!ring)
+    {
+        __atomic_fetch_add(&lostEvents, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    const uint64_t head = ring->head;
+    timelineEvent_t* event = &ring->events[head % TIMELINE_RING_EVENTS];
+    event->name = name;
+    event->begin = begin;
+    event->end = end;
+    event->arg = arg;
+    event->track = track;
+    event->process = process;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void recordTimelineSpan(const char *name, const uint64_t begin, const uint64_t end, const uint32_t arg)
+{
+    recordEvent(TIMELINE_HOST, 0, name, begin, end, arg);
+}
+
+void recordTimelineDeviceSpan(const uint16_t device, const char *name, const uint64_t begin, const uint64_t end, const uint32_t arg)
+{
+    recordEvent(TIMELINE_OPENCL, device, name, begin, end, arg);
+}
+
+// JSON string without its quotes & backslashes (device names)
+static void writeName(FILE* file, const char* name)
+{
+    for (; *name; name++)
+        fputc((*name == '"' || *name == '\\') ? ' ' : *name, file);
+}
+
+void writeTimeline(void)
+{
+    if (!timelinePath)
+        return;
+    const char* path = timelinePath;
+    timelinePath = NULL;
+
+    FILE* file = fopen(path, "w");
+    if (!file)
+        printf("WARNING::CANNOT_WRITE_TIMELINE: %s\n", path);
+
+    // Host threads: process 1, one row per ring. OpenCL devices: process 2, one row per device
+    const uint32_t usedRings = numberOfRings < TIMELINE_MAX_THREADS ? numberOfRings : TIMELINE_MAX_THREADS;
+    uint64_t numberOfEvents = 0, overwrittenEvents = 0;
+    uint32_t ringIdx;
+    uint16_t device;
+    if (file)
+    {
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Host threads\"}},\n");
+        fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"OpenCL devices\"}}");
+        for (device = 0; device < TIMELINE_MAX_DEVICES; device++)
+            if (deviceNames[device][0])
+            {
+                fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":2,\"tid\":%u,\"args\":{\"name\":\"Device %u: ", device, device);
+                writeName(file, deviceNames[device]);
+                fprintf(file, "\"}}");
+            }
+    }
+    for (ringIdx = 0; ringIdx < usedRings; ringIdx++)
+    {
+        timelineRing_t* ring = __atomic_load_n(&rings[ringIdx], __ATOMIC_ACQUIRE);
+        if (!ring)
+            continue;
+        const uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        const uint64_t first = head > TIMELINE_RING_EVENTS ? head - TIMELINE_RING_EVENTS : 0;
+        overwrittenEvents += first;
+        numberOfEvents += head - first;
+
+        uint64_t eventIdx;
+        if (file)
+        {
+            fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"Thread %u\"}}", ringIdx, ringIdx);
+            for (eventIdx = first; eventIdx < head; eventIdx++)
+            {
+                // Complete events ("X"), times in us
+                const timelineEvent_t* event = &ring->events[eventIdx % TIMELINE_RING_EVENTS];
+                const uint8_t isDevice = event->process == TIMELINE_OPENCL;
+                fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"index\":%u}}",
+                        event->name, isDevice ? "opencl" : "host", isDevice ? 2 : 1, isDevice ? event->track : ringIdx,
+                        event->begin / 1000.0, (event->end - event->begin) / 1000.0, event->arg);
+            }
+        }
+        free(ring);
+        rings[ringIdx] = NULL;
+    }
+
+    if (file)
+    {
+        fprintf(file, "\n]}\n");
+        fclose(file);
+        printf("Timeline: %lu events of %u threads written to %s (%lu overwritten, %lu lost)\n", numberOfEvents, usedRings, path, overwrittenEvents, lostEvents);
+    }
+}
@@ -1,8 +1,17 @@
 #include "utils.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
-static uint32_t pcg_hash(uint32_t* seed)
+#include "stb_image_write.h"
+#include "perf_counters.h"
+#include "memory_tracker.h"
+
+#define CHANNEL_NUM 3
+
+uint32_t pcg_hash(uint32_t* seed)
 {
     uint32_t state = *seed;
     *seed = *seed * 747796405u + 2891336453u;
@@ -21,6 +30,46 @@ void imageFloatToU8(const color_t *src, color_u8_t *dst, uint32_t imgSize)
     }
 }
 
+// IEEE 754 binary16 -> binary32
+static float halfToFloat(const uint16_t h)
+{
+    const uint32_t sign = (uint32_t)(h & 0x8000u) << 16;
+    uint32_t exponent = (h >> 10) & 0x1Fu;
+    uint32_t mantissa = h & 0x3FFu;
+    uint32_t bits;
+    if (exponent == 0x1Fu)
+        bits = sign | 0x7F800000u | (mantissa << 13);           // Inf & NaN
+    else if (exponent)
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    else if (!mantissa)
+        bits = sign;                                            // Zero
+    else
+    {
+        // Subnormal: normalized in float
+        exponent = 113;
+        while (!(mantissa & 0x400u))
+        {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3FFu) << 13);
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+void imageHalfToFloat(const uint16_t *src, color_t *dst, uint32_t imgSize)
+{
+    uint32_t i;
+    for (i = 0; i < imgSize; i++)
+    {
+        dst[i].r = halfToFloat(src[3 * i]);
+        dst[i].g = halfToFloat(src[3 * i + 1]);
+        dst[i].b = halfToFloat(src[3 * i + 2]);
+    }
+}
+
 void imageLinearToGamma(color_t *image, uint32_t imgSize)
 {
     uint32_t i;
@@ -32,6 +81,102 @@ void imageLinearToGamma(color_t *image, uint32_t imgSize)
     }
 }
 
+void imageLinearToGammaU8(const color_t *src, color_u8_t *dst, uint32_t imgSize)
+{
+    // Both steps of renderImage in one pass, the linear image is left untouched
+    uint32_t i;
+    for (i = 0; i < imgSize; i++)
+    {
+        dst[i].r = (uint8_t)(sqrtf(src[i].r) * 255.999f);
+        dst[i].g = (uint8_t)(sqrtf(src[i].g) * 255.999f);
+        dst[i].b = (uint8_t)(sqrtf(src[i].b) * 255.999f);
+    }
+}
+
+void renderImage(color_t *image, const char* filename, const uint16_t width, const uint16_t height)
+{
+    perfPhase_t phase;
+
+    // Linear space to Gamma space tranformation
+    startPerfPhase(&phase);
+    imageLinearToGamma(image, width * height);
+    stopPerfPhase(&phase);
+    reportPerfPhase("gamma", &phase, width * height);
+
+    // Output image allocation & copy
+    startPerfPhase(&phase);
+    color_u8_t* image_u8 = trackedMalloc(width * height * sizeof(color_u8_t));
+    imageFloatToU8(image, image_u8, width * height);
+    stopPerfPhase(&phase);
+    reportPerfPhase("quantize", &phase, width * height);
+
+    // Save image
+    startPerfPhase(&phase);
+    stbi_write_png(filename, width, height, CHANNEL_NUM, image_u8, width * CHANNEL_NUM);
+    stopPerfPhase(&phase);
+    reportPerfPhase("encode", &phase, width * height);
+
+    // Destroy image
+    trackedFree(image_u8);
+}
+
+uint64_t monotonicTime(void)
+{
+    // Not affected by the wall clock adjustments (NTP, gettimeofday)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+}
+
+uint16_t nextPassSamples(const uint64_t elapsedTime, const uint64_t timeBudget, const uint64_t passTime, const uint16_t passSamples)
+{
+    if (elapsedTime >= timeBudget)
+        return 0;
+    const double sampleTime = (passTime ? (double)passTime : 1.0) / passSamples;
+    // Planned to end a little before the deadline (speed of the next pass vs. the previous one)
+    const double timeLeft = (timeBudget - elapsedTime) * BUDGET_MARGIN;
+    if (timeLeft < sampleTime)
+        return 0;
+    const double samples = (timeLeft < timeBudget / BUDGET_PASSES ? timeLeft : timeBudget / BUDGET_PASSES) / sampleTime;
+    if (samples < 1.0)
+        return 1;
+    return samples > UINT16_MAX ? UINT16_MAX : (uint16_t)samples;
+}
+
+float imageRelativeMSE(const color_t *image, const color_t *reference, uint32_t imgSize)
+{
+    double relativeError = 0.0;
+    uint32_t i;
+    for (i = 0; i < imgSize; i++)
+    {
+        const float errors[3] = { (image[i].r - reference[i].r) / (reference[i].r + RELATIVE_MSE_EPSILON),
+                                  (image[i].g - reference[i].g) / (reference[i].g + RELATIVE_MSE_EPSILON),
+                                  (image[i].b - reference[i].b) / (reference[i].b + RELATIVE_MSE_EPSILON) };
+        relativeError += errors[0] * errors[0] + errors[1] * errors[1] + errors[2] * errors[2];
+    }
+    return relativeError / (3.0 * imgSize);
+}
+
+float imageRMSE(const color_t *image, const color_t *reference, uint32_t imgSize, float *maxError)
+{
+    // Linear colors, over the 3 channels
+    double squaredError = 0.0;
+    *maxError = 0.0f;
+    uint32_t i;
+    for (i = 0; i < imgSize; i++)
+    {
+        const float errors[3] = { image[i].r - reference[i].r, image[i].g - reference[i].g, image[i].b - reference[i].b };
+        uint8_t c;
+        for (c = 0; c < 3; c++)
+        {
+            squaredError += errors[c] * errors[c];
+            if (fabsf(errors[c]) > *maxError)
+                *maxError = fabsf(errors[c]);
+        }
+    }
+    return sqrt(squaredError / (3.0 * imgSize));
+}
+
 float randomFloatInUnitInterval(uint32_t* seed)
 {
     return (float)pcg_hash(seed) * (1.0f / UINT32_MAX);
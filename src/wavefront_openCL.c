@@ -0,0 +1,228 @@
+#include "wavefront_openCL.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Queue counters after one bounce, read back without waiting
+typedef struct bounceCounts_t
+{
+    cl_uint counters[WAVEFRONT_QUEUE_COUNTERS];
+    cl_event event;
+    uint8_t isShaded;       // The last bounce only extends (the paths left in the material queues are black)
+} bounceCounts_t;
+
+// Bounces enqueued for one sample
+typedef struct sampleCounts_t
+{
+    bounceCounts_t* bounces;
+    uint8_t numberOfBounces;
+} sampleCounts_t;
+
+static cl_int enqueue1D(openCL_t* openCL, cl_kernel kernel, const uint32_t items, wavefrontStats_t* stats)
+{
+    size_t localItemSize = WAVEFRONT_LOCAL_SIZE;
+    size_t globalItemSize = (items + WAVEFRONT_LOCAL_SIZE - 1) / WAVEFRONT_LOCAL_SIZE * WAVEFRONT_LOCAL_SIZE;
+    if (stats)
+        stats->launchedItems += globalItemSize;
+    return clEnqueueNDRangeKernel(openCL->commandQueue, kernel, 1, NULL, &globalItemSize, &localItemSize, 0, NULL, NULL);
+}
+
+// Paths left after the last bounce of the sample read back so far (in order queue: the latest complete read is enough)
+static uint8_t isSampleDone(const sampleCounts_t* sample)
+{
+    uint8_t depthIdx;
+    for (depthIdx = sample->numberOfBounces; depthIdx-- > 0;)
+    {
+        cl_int status;
+        clGetEventInfo(sample->bounces[depthIdx].event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+        if (status == CL_COMPLETE)
+            return sample->bounces[depthIdx].isShaded && !sample->bounces[depthIdx].counters[WAVEFRONT_RAY_COUNTER + (depthIdx + 1) % 2];
+    }
+    return 0;
+}
+
+// Waits for the counters of the sample: rays of the extend launches & paths of the shade ones
+static void collectSampleCounts(sampleCounts_t* sample, wavefrontStats_t* stats)
+{
+    uint8_t depthIdx, material;
+    for (depthIdx = 0; depthIdx < sample->numberOfBounces; depthIdx++)
+    {
+        bounceCounts_t* bounce = &sample->bounces[depthIdx];
+        clWaitForEvents(1, &bounce->event);
+        clReleaseEvent(bounce->event);
+        if (!stats)
+            continue;
+
+        const cl_uint rays = bounce->counters[WAVEFRONT_RAY_COUNTER + depthIdx % 2];
+        stats->rays += rays;
+        stats->usefulItems += rays;
+        if (bounce->isShaded)
+            for (material = 0; material < NUMBER_OF_MATERIAL; material++)
+                stats->usefulItems += bounce->counters[material];
+    }
+    sample->numberOfBounces = 0;
+}
+
+// Path pool & queues: ray queues (double buffered), one queue per material and their counters
+static cl_int createWavefront_openCL(openCL_t* openCL, const uint32_t poolSize)
+{
+    cl_int ret[6];
+    releaseWavefront_openCL(openCL);
+    openCL->pathMemObj = createBuffer_openCL(openCL->context, CL_MEM_READ_WRITE, poolSize * sizeof(wavefrontPath_t), NULL, &ret[0]);
+    openCL->rayQueueMemObj[0] = createBuffer_openCL(openCL->context, CL_MEM_READ_WRITE, poolSize * sizeof(cl_uint), NULL, &ret[1]);
+    openCL->rayQueueMemObj[1] = createBuffer_openCL(openCL->context, CL_MEM_READ_WRITE, poolSize * sizeof(cl_uint), NULL, &ret[2]);
+    openCL->materialQueueMemObj = createBuffer_openCL(openCL->context, CL_MEM_READ_WRITE, NUMBER_OF_MATERIAL * poolSize * sizeof(cl_uint), NULL, &ret[3]);
+    openCL->queueCounterMemObj = createBuffer_openCL(openCL->context, CL_MEM_READ_WRITE, WAVEFRONT_QUEUE_COUNTERS * sizeof(cl_uint), NULL, &ret[4]);
+    openCL->sampleColorMemObj = createBuffer_openCL(openCL->context, CL_MEM_READ_WRITE, poolSize * sizeof(color_t), NULL, &ret[5]);
+    openCL->wavefrontPoolSize = poolSize;
+
+    // First failed allocation: no pool at all (the next call allocates it again)
+    uint8_t bufferIdx;
+    for (bufferIdx = 0; bufferIdx < sizeof(ret) / sizeof(ret[0]); bufferIdx++)
+        if (ret[bufferIdx] != CL_SUCCESS)
+        {
+            releaseWavefront_openCL(openCL);
+            return ret[bufferIdx];
+        }
+    return CL_SUCCESS;
+}
+
+void releaseWavefront_openCL(openCL_t *openCL)
+{
+    if (!openCL->wavefrontPoolSize)
+        return;
+    releaseBuffer_openCL(openCL->sampleColorMemObj);
+    releaseBuffer_openCL(openCL->queueCounterMemObj);
+    releaseBuffer_openCL(openCL->materialQueueMemObj);
+    releaseBuffer_openCL(openCL->rayQueueMemObj[1]);
+    releaseBuffer_openCL(openCL->rayQueueMemObj[0]);
+    releaseBuffer_openCL(openCL->pathMemObj);
+    openCL->wavefrontPoolSize = 0;
+}
+
+cl_int enqueueWavefront_openCL(openCL_t *openCL, const uint16_t width, const uint16_t height, const uint16_t raysPerPixel, const uint8_t raysDepth, const uint16_t numberOfSpheres, const uint32_t sampleOffset, wavefrontStats_t *stats)
+{
+    cl_int ret = CL_SUCCESS;
+    const uint32_t numberOfPixels = width * height;
+    const uint32_t poolSize = numberOfPixels < WAVEFRONT_POOL_SIZE ? numberOfPixels : WAVEFRONT_POOL_SIZE;
+    const cl_uint zero = 0;
+
+    if (openCL->wavefrontPoolSize != poolSize)
+        ret = createWavefront_openCL(openCL, poolSize);
+    if (ret != CL_SUCCESS)
+    {
+        printf("ERROR::OPENCL_WAVEFRONT_BUFFERS: %d\n", ret);
+        return ret;
+    }
+
+    // Arguments constant over the call (the scene buffers may change between calls)
+    cl_kernel generateKernel = openCL->wavefrontGenerateKernel;
+    cl_kernel extendKernel = openCL->wavefrontExtendKernel;
+    cl_kernel shadeKernel = openCL->wavefrontShadeKernel;
+    cl_kernel accumulateKernel = openCL->wavefrontAccumulateKernel;
+    clSetKernelArg(generateKernel, 0, sizeof(cl_mem), &openCL->pathMemObj);
+    clSetKernelArg(generateKernel, 1, sizeof(cl_mem), &openCL->rayQueueMemObj[0]);
+    clSetKernelArg(generateKernel, 2, sizeof(cl_mem), &openCL->sampleColorMemObj);
+    clSetKernelArg(generateKernel, 3, sizeof(cl_mem), &openCL->cameraMemObj);
+    clSetKernelArg(generateKernel, 4, sizeof(width), &width);
+
+    clSetKernelArg(extendKernel, 0, sizeof(cl_mem), &openCL->pathMemObj);
+    clSetKernelArg(extendKernel, 3, sizeof(cl_mem), &openCL->sphereMemObj);
+    clSetKernelArg(extendKernel, 4, sizeof(numberOfSpheres), &numberOfSpheres);
+    clSetKernelArg(extendKernel, 5, sizeof(cl_mem), &openCL->materialQueueMemObj);
+    clSetKernelArg(extendKernel, 6, sizeof(poolSize), &poolSize);
+    clSetKernelArg(extendKernel, 7, sizeof(cl_mem), &openCL->queueCounterMemObj);
+    clSetKernelArg(extendKernel, 8, sizeof(cl_mem), &openCL->sampleColorMemObj);
+    clSetKernelArg(extendKernel, 9, sizeof(cl_mem), &openCL->bvhMemObj);
+    clSetKernelArg(extendKernel, 10, sizeof(openCL->numberOfNodes), &openCL->numberOfNodes);
+
+    clSetKernelArg(shadeKernel, 0, sizeof(cl_mem), &openCL->pathMemObj);
+    clSetKernelArg(shadeKernel, 1, sizeof(cl_mem), &openCL->materialQueueMemObj);
+    clSetKernelArg(shadeKernel, 2, sizeof(poolSize), &poolSize);
+    clSetKernelArg(shadeKernel, 4, sizeof(cl_mem), &openCL->sphereMemObj);
+    clSetKernelArg(shadeKernel, 6, sizeof(cl_mem), &openCL->queueCounterMemObj);
+
+    clSetKernelArg(accumulateKernel, 0, sizeof(cl_mem), &openCL->imageMemObj);
+    clSetKernelArg(accumulateKernel, 1, sizeof(cl_mem), &openCL->sampleColorMemObj);
+
+    // Counters of the current sample & of the previous one, still in flight
+    sampleCounts_t samples[2];
+    samples[0].bounces = malloc(raysDepth * sizeof(bounceCounts_t));
+    samples[1].bounces = malloc(raysDepth * sizeof(bounceCounts_t));
+    samples[0].numberOfBounces = 0;
+    samples[1].numberOfBounces = 0;
+    uint32_t sampleCount = 0;
+
+    uint32_t pixelOffset, sampleIdx, material;
+    uint8_t depthIdx;
+    for (pixelOffset = 0; pixelOffset < numberOfPixels && ret == CL_SUCCESS; pixelOffset += poolSize)
+    {
+        const uint32_t pathCount = (numberOfPixels - pixelOffset < poolSize) ? numberOfPixels - pixelOffset : poolSize;
+
+        for (sampleIdx = sampleOffset; sampleIdx < sampleOffset + raysPerPixel && ret == CL_SUCCESS; sampleIdx++)
+        {
+            // Counters of two samples ago: the previous sample is queued behind them, the device stays busy
+            sampleCounts_t* sample = &samples[sampleCount++ % 2];
+            collectSampleCounts(sample, stats);
+
+            // Generate: one path per pixel of the pool, all in the first ray queue
+            clSetKernelArg(generateKernel, 5, sizeof(pixelOffset), &pixelOffset);
+            clSetKernelArg(generateKernel, 6, sizeof(pathCount), &pathCount);
+            clSetKernelArg(generateKernel, 7, sizeof(sampleIdx), &sampleIdx);
+            ret = enqueue1D(openCL, generateKernel, pathCount, stats);
+            if (stats)
+                stats->usefulItems += pathCount;
+            clEnqueueFillBuffer(openCL->commandQueue, openCL->queueCounterMemObj, &pathCount, sizeof(pathCount), WAVEFRONT_RAY_COUNTER * sizeof(cl_uint), sizeof(cl_uint), 0, NULL, NULL);
+
+            for (depthIdx = 0; depthIdx < raysDepth && ret == CL_SUCCESS; depthIdx++)
+            {
+                // Every path of the sample ended in an earlier bounce
+                if (depthIdx && isSampleDone(sample))
+                    break;
+
+                // Extend: closest hit, sky hits end here, the other paths are sorted by material
+                const cl_uint rayCounterIdx = WAVEFRONT_RAY_COUNTER + depthIdx % 2;
+                const cl_uint nextRayCounterIdx = WAVEFRONT_RAY_COUNTER + (depthIdx + 1) % 2;
+                clEnqueueFillBuffer(openCL->commandQueue, openCL->queueCounterMemObj, &zero, sizeof(zero), 0, NUMBER_OF_MATERIAL * sizeof(cl_uint), 0, NULL, NULL);
+                clEnqueueFillBuffer(openCL->commandQueue, openCL->queueCounterMemObj, &zero, sizeof(zero), nextRayCounterIdx * sizeof(cl_uint), sizeof(cl_uint), 0, NULL, NULL);
+                clSetKernelArg(extendKernel, 1, sizeof(cl_mem), &openCL->rayQueueMemObj[depthIdx % 2]);
+                clSetKernelArg(extendKernel, 2, sizeof(rayCounterIdx), &rayCounterIdx);
+                ret = enqueue1D(openCL, extendKernel, pathCount, stats);
+
+                // Shade: one launch per material (paths still in a sphere after the last bounce are black), the surviving
+                // paths are compacted in the next ray queue
+                bounceCounts_t* bounce = &sample->bounces[sample->numberOfBounces++];
+                bounce->isShaded = depthIdx < raysDepth - 1;
+                if (bounce->isShaded)
+                {
+                    clSetKernelArg(shadeKernel, 5, sizeof(cl_mem), &openCL->rayQueueMemObj[(depthIdx + 1) % 2]);
+                    clSetKernelArg(shadeKernel, 7, sizeof(nextRayCounterIdx), &nextRayCounterIdx);
+                    for (material = 0; material < NUMBER_OF_MATERIAL && ret == CL_SUCCESS; material++)
+                    {
+                        clSetKernelArg(shadeKernel, 3, sizeof(material), &material);
+                        ret = enqueue1D(openCL, shadeKernel, pathCount, stats);
+                    }
+                }
+
+                // Queue lengths for the statistics & the end of the sample, read back without waiting
+                clEnqueueReadBuffer(openCL->commandQueue, openCL->queueCounterMemObj, CL_FALSE, 0, sizeof(bounce->counters), bounce->counters, 0, NULL, &bounce->event);
+                clFlush(openCL->commandQueue);
+            }
+
+            // Accumulate: running mean of the samples in the output image
+            clSetKernelArg(accumulateKernel, 2, sizeof(pixelOffset), &pixelOffset);
+            clSetKernelArg(accumulateKernel, 3, sizeof(pathCount), &pathCount);
+            clSetKernelArg(accumulateKernel, 4, sizeof(sampleIdx), &sampleIdx);
+            ret = enqueue1D(openCL, accumulateKernel, pathCount, stats);
+            if (stats)
+                stats->usefulItems += pathCount;
+        }
+    }
+    clFinish(openCL->commandQueue);
+    collectSampleCounts(&samples[0], stats);
+    collectSampleCounts(&samples[1], stats);
+    free(samples[0].bounces);
+    free(samples[1].bounces);
+
+    return ret;
+}
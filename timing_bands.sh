@@ -0,0 +1,16 @@
+#/bin/bash
+
+# End-to-end latency (render, readback, conversion & PNG encoding) of 4K & 8K frames: serial flow vs. overlapped bands
+echo "width;height;bands;latency" | tee result_bands.csv
+
+for resolution in 3840x2160 7680x4320
+do
+    width=${resolution%x*}
+    height=${resolution#*x}
+    for bands in 0 4 8 16 32
+    do
+        option=$([ $bands -eq 0 ] || echo "--bands=$bands")
+        latency=$(./raytracing-app $width $height 10 15 11 --seed=42 $option | grep "OpenCL end-to-end latency" | cut -d' ' -f4)
+        echo "$width;$height;$bands;$latency" | tee -a result_bands.csv
+    done
+done
@@ -0,0 +1,13 @@
+#/bin/bash
+
+# Thumbnail workload: images per second of one OpenCL call per image vs. batched launches
+echo "images;width;height;per_call_images_per_s;batched_images_per_s;speedup" | tee result_batch.csv
+
+for images in 16 256 1024 4096
+do
+    output=$(./raytracing-app 256 144 4 10 6 --seed=42 --thumbnails=$images)
+    per_call=$(echo "$output" | grep "One call per image" | cut -d' ' -f7)
+    batched=$(echo "$output" | grep "Batched (" | cut -d' ' -f8)
+    speedup=$(echo "$output" | grep "Batched (" | cut -d' ' -f11 | tr -d 'x')
+    echo "$images;256;144;$per_call;$batched;$speedup" | tee -a result_batch.csv
+done
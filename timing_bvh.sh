@@ -0,0 +1,16 @@
+#/bin/bash
+
+# Scene size sweep: brute force vs. BVH closest hit search on the same scene (--seed), the images must be identical
+SEED=42
+
+echo "sqrt_spheres;number_of_spheres;time_brute_force;time_bvh;same_image" | tee result_bvh.csv
+
+for sqrt_spheres in 2 6 11 22 45 90 128
+do
+    time_none=$(./raytracing-app 640 360 10 15 $sqrt_spheres --seed=$SEED --accel=none | grep "Raytracing_OpenCL elapsed time" | cut -d' ' -f4)
+    cp OpenCL.png OpenCL_brute_force.png
+    time_bvh=$(./raytracing-app 640 360 10 15 $sqrt_spheres --seed=$SEED --accel=bvh | grep "Raytracing_OpenCL elapsed time" | cut -d' ' -f4)
+    same_image=$(cmp -s OpenCL.png OpenCL_brute_force.png && echo yes || echo no)
+    echo "$sqrt_spheres;$(($sqrt_spheres*$sqrt_spheres+4));$time_none;$time_bvh;$same_image" | tee -a result_bvh.csv
+done
+rm -f OpenCL_brute_force.png
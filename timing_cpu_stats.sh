@@ -0,0 +1,24 @@
+#/bin/bash
+
+# Cost of the CPU ray counters (--stats): same CPU render without & with the per thread counters, over the scene size &
+# depth grid, with the counted work per sample
+echo "sqrt_spheres;rays_depth;time_cpu;time_cpu_stats;overhead_percent;rays_per_sample;sphere_tests_per_ray;sky_hits_percent;busiest_thread" | tee result_cpu_stats_overhead.csv
+
+for sqrt_spheres in 2 6 11 22
+do
+    for rays_depth in 5 15 50
+    do
+        time_cpu=$(./raytracing-app 1280 720 10 $rays_depth $sqrt_spheres --seed=42 | grep "^Raytracing elapsed time" | cut -d' ' -f4)
+        output=$(./raytracing-app 1280 720 10 $rays_depth $sqrt_spheres --seed=42 --stats)
+        time_stats=$(echo "$output" | grep "^Raytracing elapsed time" | cut -d' ' -f4)
+        tests=$(echo "$output" | grep "CPU ray stats: .* samples, .* sphere tests")
+        paths=$(echo "$output" | grep "CPU ray stats: sky hits")
+        threads=$(echo "$output" | grep "CPU ray stats: .* busiest thread")
+        overhead=$(awk "BEGIN { printf \"%.2f\", 100.0 * ($time_stats - $time_cpu) / $time_cpu }")
+        rays_per_sample=$(echo "$tests" | cut -d' ' -f8 | tr -d '(')
+        sphere_tests=$(echo "$tests" | cut -d' ' -f14 | tr -d '(')
+        sky_hits=$(echo "$paths" | cut -d' ' -f6 | tr -d '%,')
+        busiest=$(echo "$threads" | cut -d' ' -f8 | tr -d 'x')
+        echo "$sqrt_spheres;$rays_depth;$time_cpu;$time_stats;$overhead;$rays_per_sample;$sphere_tests;$sky_hits;$busiest" | tee -a result_cpu_stats_overhead.csv
+    done
+done
@@ -0,0 +1,17 @@
+#/bin/bash
+
+# OpenCL + CPU cooperative render: share of the rows done by the device & speed-up over each side alone
+# (with PoCL as the OpenCL platform, the "device" is the CPU itself: the split then stays close to 50/50)
+echo "sqrt_spheres;device_rows_percent;cpu_rows_percent;speedup_vs_opencl;speedup_vs_cpu" | tee result_hetero.csv
+
+for sqrt_spheres in 2 6 11 22
+do
+    output=$(./raytracing-app 1280 720 10 15 $sqrt_spheres --seed=42 --hetero)
+    work=$(echo "$output" | grep "Heterogeneous work")
+    speedup=$(echo "$output" | grep "Heterogeneous speed-up")
+    device_percent=$(echo "$work" | cut -d' ' -f6 | tr -d '(%)')
+    cpu_percent=$(echo "$work" | cut -d' ' -f13 | tr -d '(%)')
+    speedup_opencl=$(echo "$speedup" | cut -d' ' -f3 | tr -d 'x')
+    speedup_cpu=$(echo "$speedup" | cut -d' ' -f7 | tr -d 'x')
+    echo "$sqrt_spheres;$device_percent;$cpu_percent;$speedup_opencl;$speedup_cpu" | tee -a result_hetero.csv
+done
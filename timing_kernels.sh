@@ -0,0 +1,37 @@
+#/bin/bash
+
+# OpenCL kernel organization comparison on the timing.sh grid: time, throughput and SIMD lane utilization
+echo "kernel;sqrt_spheres;rays_per_pixel;rays_depth;resolution;time_opencl;rays;mrays_per_s;lane_utilization" | tee result_kernels.csv
+
+for sqrt_spheres in 2 6 11
+do
+    for rays_per_pixel in 1 10 50 100
+    do
+        for rays_depth in 5 15 50
+        do
+            for width in 256 640 848 1280 1920 2560 3840 7680
+            do
+                for kernel in megakernel wavefront persistent float4 half
+                do
+                    output=$(./raytracing-app $width $(($width * 9 / 16)) $rays_per_pixel $rays_depth $sqrt_spheres --seed=42 --kernel=$kernel)
+                    time_opencl=$(echo "$output" | grep "Raytracing_OpenCL elapsed time" | cut -d' ' -f4)
+                    if [ $kernel == wavefront ]
+                    then
+                        # Queue occupancy of the wavefront launches
+                        wavefront=$(echo "$output" | grep "^Wavefront:")
+                        rays=$(echo "$wavefront" | cut -d' ' -f2)
+                        lane_utilization=$(echo "$wavefront" | cut -d' ' -f9 | tr -d '%')
+                    else
+                        # Ray counters of a second, untimed render (--stats slows the kernels down): active lanes of the
+                        # work-groups
+                        stats=$(./raytracing-app $width $(($width * 9 / 16)) $rays_per_pixel $rays_depth $sqrt_spheres --seed=42 --kernel=$kernel --stats | grep "^Ray stats:")
+                        rays=$(echo "$stats" | grep "samples," | cut -d' ' -f5)
+                        lane_utilization=$(echo "$stats" | grep "lane utilization" | cut -d' ' -f6 | tr -d '%')
+                    fi
+                    mrays_per_s=$(awk "BEGIN { printf \"%.2f\", $rays / $time_opencl }")
+                    echo "$kernel;$sqrt_spheres;$rays_per_pixel;$rays_depth;$(($width*$width*9/16));$time_opencl;$rays;$mrays_per_s;$lane_utilization" | tee -a result_kernels.csv
+                done
+            done
+        done
+    done
+done
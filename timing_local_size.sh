@@ -0,0 +1,17 @@
+#/bin/bash
+
+# OpenCL work-group shape sweep (one image size per line, one shape per column)
+LOCAL_SIZES="64x1 32x2 16x4 8x8 4x16 32x4 16x8 8x16 16x16"
+
+echo "resolution;$(echo $LOCAL_SIZES | tr ' ' ';')" | tee result_local_size.csv
+
+for width in 256 640 848 1280 1920 2560 3840 7680
+do
+    line="$width x $(($width * 9 / 16))"
+    for local_size in $LOCAL_SIZES
+    do
+        time_opencl=$(./raytracing-app $width $(($width * 9 / 16)) 10 15 11 --seed=42 --local-size=$local_size | grep "Raytracing_OpenCL elapsed time" | cut -d' ' -f4)
+        line="$line;$time_opencl"
+    done
+    echo "$line" | tee -a result_local_size.csv
+done
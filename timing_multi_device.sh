@@ -0,0 +1,15 @@
+#/bin/bash
+
+# One OpenCL device vs. every available device sharing the frame (throughput proportional row tiles)
+# With PoCL, POCL_DEVICES="cpu cpu" exposes two CPU devices to exercise the split on a single machine
+echo "sqrt_spheres;single_device_us;multi_device_us;device0_rows_percent;speedup" | tee result_multi_device.csv
+
+for sqrt_spheres in 2 6 11 22
+do
+    single=$(./raytracing-app 1280 720 10 15 $sqrt_spheres --seed=42 | grep "Raytracing_OpenCL elapsed time" | cut -d' ' -f4)
+    output=$(./raytracing-app 1280 720 10 15 $sqrt_spheres --seed=42 --multi-device)
+    multi=$(echo "$output" | grep "Raytracing_OpenCL elapsed time" | cut -d' ' -f4)
+    device0_percent=$(echo "$output" | grep "^Device 0:.*rows" | cut -d' ' -f5 | tr -d '(%)')
+    speedup=$(awk "BEGIN { printf \"%.2f\", $single / $multi }")
+    echo "$sqrt_spheres;$single;$multi;$device0_percent;$speedup" | tee -a result_multi_device.csv
+done
@@ -0,0 +1,20 @@
+#/bin/bash
+
+# Persistent threads vs. one work-item per pixel: the gap grows with the path length divergence (rays depth)
+BATCH_SIZES="1 4 16 64"
+
+echo "rays_depth;resolution;time_megakernel;$(echo $BATCH_SIZES | sed 's/[0-9]*/time_persistent_&/g' | tr ' ' ';')" | tee result_persistent.csv
+
+for rays_depth in 5 15 50
+do
+    for width in 256 640 848 1280 1920 2560 3840 7680
+    do
+        line="$rays_depth;$(($width*$width*9/16));$(./raytracing-app $width $(($width * 9 / 16)) 10 $rays_depth 11 --seed=42 | grep "Raytracing_OpenCL elapsed time" | cut -d' ' -f4)"
+        for batch in $BATCH_SIZES
+        do
+            time_opencl=$(./raytracing-app $width $(($width * 9 / 16)) 10 $rays_depth 11 --seed=42 --kernel=persistent --batch=$batch | grep "Raytracing_OpenCL elapsed time" | cut -d' ' -f4)
+            line="$line;$time_opencl"
+        done
+        echo "$line" | tee -a result_persistent.csv
+    done
+done
@@ -0,0 +1,17 @@
+#/bin/bash
+
+# Sphere memory sweep (brute force search): profiled kernel time of each memory per scene size
+SPHERE_MEMORIES="global constant local"
+
+echo "sqrt_spheres;number_of_spheres;$(echo $SPHERE_MEMORIES | sed 's/[a-z]*/kernel_time_&/g' | tr ' ' ';')" | tee result_sphere_memory.csv
+
+for sqrt_spheres in 2 6 11 22 45 90
+do
+    line="$sqrt_spheres;$(($sqrt_spheres*$sqrt_spheres+4))"
+    for sphere_memory in $SPHERE_MEMORIES
+    do
+        kernel_time=$(./raytracing-app 1280 720 10 15 $sqrt_spheres --seed=42 --accel=none --sphere-memory=$sphere_memory | grep "kernel time (profiling)" | cut -d' ' -f7)
+        line="$line;$kernel_time"
+    done
+    echo "$line" | tee -a result_sphere_memory.csv
+done
@@ -0,0 +1,23 @@
+#/bin/bash
+
+# Device ray counters (--stats) over the scene size & depth grid: work per sample & per ray behind the times of timing.sh,
+# and the cost of the counters (same run without --stats)
+echo "sqrt_spheres;rays_depth;time_opencl;time_opencl_stats;rays_per_sample;sphere_tests_per_ray;node_tests_per_ray;sky_hits_percent;truncated_percent" | tee result_stats.csv
+
+for sqrt_spheres in 2 6 11 22
+do
+    for rays_depth in 5 15 50
+    do
+        time_opencl=$(./raytracing-app 1280 720 10 $rays_depth $sqrt_spheres --seed=42 | grep "Raytracing_OpenCL elapsed time" | cut -d' ' -f4)
+        output=$(./raytracing-app 1280 720 10 $rays_depth $sqrt_spheres --seed=42 --stats)
+        time_stats=$(echo "$output" | grep "Raytracing_OpenCL elapsed time" | cut -d' ' -f4)
+        tests=$(echo "$output" | grep "Ray stats: .* samples")
+        paths=$(echo "$output" | grep "Ray stats: sky hits")
+        rays_per_sample=$(echo "$tests" | cut -d' ' -f7 | tr -d '(')
+        sphere_tests=$(echo "$tests" | cut -d' ' -f13 | tr -d '(')
+        node_tests=$(echo "$tests" | cut -d' ' -f20 | tr -d '(')
+        sky_hits=$(echo "$paths" | cut -d' ' -f5 | tr -d '%,')
+        truncated=$(echo "$paths" | cut -d' ' -f8 | tr -d '%')
+        echo "$sqrt_spheres;$rays_depth;$time_opencl;$time_stats;$rays_per_sample;$sphere_tests;$node_tests;$sky_hits;$truncated" | tee -a result_stats.csv
+    done
+done
@@ -0,0 +1,15 @@
+#!/bin/bash
+
+# Every OpenCL kernel variant against the reference megakernel image (--validate), non-zero exit on the first failure
+set -o pipefail
+for kernel in megakernel wavefront persistent float4 half
+do
+    for sqrt_spheres in 2 11 30
+    do
+        for rays_per_pixel in 1 10 100
+        do
+            echo "$kernel: $sqrt_spheres spheres^0.5, $rays_per_pixel rays per pixel"
+            ./raytracing-app 640 360 $rays_per_pixel 15 $sqrt_spheres --seed=42 --kernel=$kernel --validate | grep "^Validation: RMSE" || exit 1
+        done
+    done
+done